@@ -0,0 +1,230 @@
+#include "affinity.h"
+
+#include <algorithm>
+#include <fstream>
+#include <new>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace netkit {
+
+#if defined(__linux__)
+// Parses "0-3,8,10-11"
+static std::vector<int> ParseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::size_t pos = 0;
+  while (pos < list.size()) {
+    auto end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    auto range = list.substr(pos, end - pos);
+    auto dash = range.find('-');
+    try {
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first
+                                           : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    } catch (const std::exception&) {
+    }
+    pos = end + 1;
+  }
+  return cpus;
+}
+
+static std::string ReadLine(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+#endif
+
+NumaTopology::NumaTopology() {
+#if defined(__linux__)
+  auto online = ParseCpuList(ReadLine("/sys/devices/system/node/online"));
+  for (auto node : online) {
+    if (static_cast<std::size_t>(node) >= nodes_.size()) {
+      nodes_.resize(node + 1);
+    }
+    nodes_[node] = ParseCpuList(ReadLine("/sys/devices/system/node/node" +
+                                         std::to_string(node) + "/cpulist"));
+  }
+#elif defined(_WIN32)
+  ULONG highest = 0;
+  if (GetNumaHighestNodeNumber(&highest)) {
+    for (ULONG node = 0; node <= highest; ++node) {
+      ULONGLONG mask = 0;
+      std::vector<int> cpus;
+      if (GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask)) {
+        for (int cpu = 0; cpu < 64; ++cpu) {
+          if (mask & (1ULL << cpu)) {
+            cpus.push_back(cpu);
+          }
+        }
+      }
+      nodes_.emplace_back(std::move(cpus));
+    }
+  }
+#endif
+  // Indexes are node ids, memoryless or offline nodes stay empty
+  if (std::all_of(nodes_.begin(), nodes_.end(),
+                  [](const auto& cpus) { return cpus.empty(); })) {
+    nodes_.clear();
+    nodes_.emplace_back();
+    auto count = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned cpu = 0; cpu < count; ++cpu) {
+      nodes_[0].push_back(cpu);
+    }
+  }
+}
+
+const NumaTopology& NumaTopology::Get() {
+  static NumaTopology topology;
+  return topology;
+}
+
+int NumaTopology::NodeOf(int cpu) const noexcept {
+  for (std::size_t node = 0; node < nodes_.size(); ++node) {
+    for (auto val : nodes_[node]) {
+      if (val == cpu) {
+        return static_cast<int>(node);
+      }
+    }
+  }
+  return 0;
+}
+
+bool PinCurrentThread(const std::vector<int>& cpus) noexcept {
+  if (cpus.empty()) {
+    return false;
+  }
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+  DWORD_PTR mask = 0;
+  for (auto cpu : cpus) {
+    if (cpu >= 0 && cpu < static_cast<int>(sizeof(mask) * 8)) {
+      mask |= DWORD_PTR(1) << cpu;
+    }
+  }
+  return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+  return false;
+#endif
+}
+
+int CurrentCpu() noexcept {
+#if defined(__linux__)
+  return sched_getcpu();
+#elif defined(_WIN32)
+  return static_cast<int>(GetCurrentProcessorNumber());
+#else
+  return -1;
+#endif
+}
+
+int CurrentNode() noexcept {
+  auto cpu = CurrentCpu();
+  return cpu < 0 ? 0 : NumaTopology::Get().NodeOf(cpu);
+}
+
+int DeviceNode(const std::string& interface_name) {
+#if defined(__linux__)
+  try {
+    return std::stoi(
+        ReadLine("/sys/class/net/" + interface_name + "/device/numa_node"));
+  } catch (const std::exception&) {
+  }
+#endif
+  return -1;
+}
+
+#if defined(__linux__) || defined(_WIN32)
+static std::size_t PageSize() noexcept {
+#if defined(__linux__)
+  static const auto size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+  static const auto size = []() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return static_cast<std::size_t>(info.dwPageSize);
+  }();
+#endif
+  return size;
+}
+#endif
+
+void* NodeMemoryResource::do_allocate(std::size_t bytes,
+                                      std::size_t alignment) {
+#if defined(__linux__) || defined(_WIN32)
+  auto page_size = PageSize();
+  if (node_ >= 0 && alignment <= page_size) {
+    bytes = (std::max<std::size_t>(bytes, 1) + page_size - 1) / page_size *
+            page_size;
+#if defined(__linux__)
+    auto p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    // Preferred rather than bound, a full node falls back to the others
+    unsigned long mask[16] = {};
+    if (static_cast<std::size_t>(node_) < sizeof(mask) * 8) {
+      mask[node_ / (sizeof(mask[0]) * 8)] |=
+          1UL << (node_ % (sizeof(mask[0]) * 8));
+      syscall(SYS_mbind, p, bytes, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0);
+    }
+    return p;
+#else
+    auto p = VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes,
+                                MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE,
+                                static_cast<DWORD>(node_));
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return p;
+#endif
+  }
+#endif
+  return ::operator new(bytes, std::align_val_t(alignment));
+}
+
+void NodeMemoryResource::do_deallocate(void* p, std::size_t bytes,
+                                       std::size_t alignment) {
+#if defined(__linux__) || defined(_WIN32)
+  auto page_size = PageSize();
+  if (node_ >= 0 && alignment <= page_size) {
+#if defined(__linux__)
+    bytes = (std::max<std::size_t>(bytes, 1) + page_size - 1) / page_size *
+            page_size;
+    munmap(p, bytes);
+#else
+    VirtualFree(p, 0, MEM_RELEASE);
+#endif
+    return;
+  }
+#endif
+  ::operator delete(p, std::align_val_t(alignment));
+}
+
+}  // namespace netkit
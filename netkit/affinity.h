@@ -0,0 +1,103 @@
+#pragma once
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace netkit {
+
+// CPUs of every NUMA node by node id, a single node holding all CPUs when the
+// topology is unknown
+class NumaTopology {
+ public:
+  static const NumaTopology& Get();
+
+  std::size_t size() const noexcept { return nodes_.size(); }
+
+  const std::vector<int>& cpus(std::size_t node) const noexcept {
+    return nodes_[node];
+  }
+
+  // Node of the cpu, 0 when unknown
+  int NodeOf(int cpu) const noexcept;
+
+ private:
+  NumaTopology();
+
+ private:
+  std::vector<std::vector<int>> nodes_;
+};
+
+// Restricts the calling thread to the cpus, returns false when the platform
+// refuses it
+bool PinCurrentThread(const std::vector<int>& cpus) noexcept;
+
+// CPU the calling thread runs on, -1 when unknown
+int CurrentCpu() noexcept;
+
+// NUMA node of the calling thread
+int CurrentNode() noexcept;
+
+// NUMA node the network interface is attached to, -1 when unknown
+int DeviceNode(const std::string& interface_name);
+
+// Pages bound to a NUMA node (mbind() on Linux, VirtualAllocExNuma() on
+// Windows), the upstream of the IoContextPool arenas. Every allocation maps
+// whole pages, the pool resources in front of it carve them up. A negative
+// node or another platform allocates with operator new.
+class NodeMemoryResource : public std::pmr::memory_resource {
+ public:
+  explicit NodeMemoryResource(int node) noexcept : node_(node) {}
+
+  int node() const noexcept { return node_; }
+
+ private:
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+  void do_deallocate(void* p, std::size_t bytes,
+                     std::size_t alignment) override;
+
+  bool do_is_equal(
+      const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+ private:
+  int node_;
+};
+
+// Placement of the threads of an IoContextPool
+class AffinityOptions {
+ public:
+  // Thread i is pinned to cpus[i % size], takes precedence over numa_spread
+  const std::vector<int>& cpus() const noexcept { return cpus_; }
+
+  AffinityOptions& set_cpus(const std::vector<int>& val) {
+    cpus_ = val;
+    return *this;
+  }
+
+  // Threads are dealt across the NUMA nodes in turn, each one pinned to a
+  // CPU of its node
+  bool numa_spread() const noexcept { return numa_spread_; }
+
+  AffinityOptions& set_numa_spread(bool val) noexcept {
+    numa_spread_ = val;
+    return *this;
+  }
+
+  // Every context gets a memory pool allocating from the node of its
+  // thread, see IoContextPool::arena()
+  bool arenas() const noexcept { return arenas_; }
+
+  AffinityOptions& set_arenas(bool val) noexcept {
+    arenas_ = val;
+    return *this;
+  }
+
+ private:
+  std::vector<int> cpus_;
+  bool numa_spread_ = false;
+  bool arenas_ = false;
+};
+
+}  // namespace netkit
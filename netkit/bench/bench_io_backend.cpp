@@ -0,0 +1,163 @@
+// Throughput and server-side cost per request of the Asio backend netkit was
+// built with. Build once with and once without NETKIT_IO_URING to compare
+// io_uring with epoll on the same workload.
+// Usage: bench_io_backend [connections] [seconds] [threads]
+#include <netkit/http/server.h>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using namespace netkit;
+
+namespace {
+
+constexpr std::uint16_t kPort = 18600;
+
+// Counts the syscalls of the process and of the threads it starts later,
+// -1 without tracefs or perf permissions
+int OpenSyscallCounter() {
+  for (const char* path : {"/sys/kernel/tracing/events/raw_syscalls/"
+                           "sys_enter/id",
+                           "/sys/kernel/debug/tracing/events/raw_syscalls/"
+                           "sys_enter/id"}) {
+    std::ifstream file(path);
+    std::uint64_t id = 0;
+    if (!(file >> id)) {
+      continue;
+    }
+    perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.config = id;
+    attr.inherit = 1;
+    attr.disabled = 1;
+    return static_cast<int>(
+        syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+  }
+  return -1;
+}
+
+// Keep-alive GETs on every connection until the time is up, writes the
+// number of responses to fd
+void RunClients(std::size_t connections, std::chrono::seconds duration,
+                int fd) {
+  std::atomic<std::uint64_t> total = 0;
+  std::vector<std::thread> threads;
+  auto deadline = std::chrono::steady_clock::now() + duration;
+  for (std::size_t i = 0; i < connections; ++i) {
+    threads.emplace_back([&total, deadline]() {
+      try {
+        boost::asio::io_context ioc;
+        boost::asio::ip::tcp::socket socket(ioc);
+        socket.connect({boost::asio::ip::make_address("127.0.0.1"), kPort});
+        socket.set_option(boost::asio::ip::tcp::no_delay(true));
+        const std::string request =
+            "GET /json HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        boost::beast::flat_buffer buffer;
+        std::uint64_t count = 0;
+        while (std::chrono::steady_clock::now() < deadline) {
+          boost::asio::write(socket, boost::asio::buffer(request));
+          boost::beast::http::response<boost::beast::http::string_body> resp;
+          boost::beast::http::read(socket, buffer, resp);
+          ++count;
+        }
+        total += count;
+      } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::uint64_t result = total;
+  ::write(fd, &result, sizeof(result));
+}
+
+double CpuSeconds(const rusage& usage) {
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t connections = argc > 1 ? std::stoul(argv[1]) : 16;
+  std::chrono::seconds duration(argc > 2 ? std::stoul(argv[2]) : 5);
+  std::size_t threads = argc > 3 ? std::stoul(argv[3]) : 1;
+
+  // The load generator runs in a child so that only the server is measured
+  int start_pipe[2], result_pipe[2];
+  if (pipe(start_pipe) != 0 || pipe(result_pipe) != 0) {
+    return 1;
+  }
+  auto pid = fork();
+  if (pid == 0) {
+    char start = 0;
+    ::read(start_pipe[0], &start, 1);
+    RunClients(connections, duration, result_pipe[1]);
+    _exit(0);
+  }
+
+  int counter = OpenSyscallCounter();
+  IoContextPool pool(threads);
+  std::thread thread([&pool]() { pool.Run(); });
+  auto server = std::make_shared<http::PlainServer>(pool);
+  server->HandleFunc(
+      "/json",
+      [](const http::Context::Ptr& ctx) {
+        ctx->Ok(R"({"ok":true})", "application/json");
+      },
+      {"GET"});
+  server->ListenAndServe("127.0.0.1", kPort);
+
+  rusage before = {}, after = {};
+  getrusage(RUSAGE_SELF, &before);
+  if (counter >= 0) {
+    ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  ::write(start_pipe[1], "s", 1);
+  std::uint64_t requests = 0;
+  ::read(result_pipe[0], &requests, sizeof(requests));
+  std::uint64_t syscalls = 0;
+  if (counter >= 0) {
+    ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+    ::read(counter, &syscalls, sizeof(syscalls));
+  }
+  getrusage(RUSAGE_SELF, &after);
+  waitpid(pid, nullptr, 0);
+
+  server->Close();
+  pool.Stop();
+  thread.join();
+
+  auto cpu = CpuSeconds(after) - CpuSeconds(before);
+  auto per_request = requests > 0 ? 1.0 / requests : 0.0;
+  std::cout << "backend            " << IoContextPool::backend() << std::endl
+            << "requests/s         " << requests / duration.count()
+            << std::endl
+            << "server cpu us/req  " << cpu * 1e6 * per_request << std::endl
+            << "context switches   "
+            << ((after.ru_nvcsw + after.ru_nivcsw) -
+                (before.ru_nvcsw + before.ru_nivcsw)) *
+                   per_request
+            << " per request" << std::endl;
+  if (counter >= 0) {
+    std::cout << "syscalls           " << syscalls * per_request
+              << " per request" << std::endl;
+  } else {
+    std::cout << "syscalls           n/a (needs tracefs and perf access)"
+              << std::endl;
+  }
+}
@@ -0,0 +1,142 @@
+// Loopback request latency of a PlainServer for several socket options.
+// Usage: bench_socket_options [iterations]
+#include <netkit/http/server.h>
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+
+using namespace netkit;
+
+namespace {
+
+struct Variant {
+  const char* name;
+  tcp::SocketOptions options;
+};
+
+struct Result {
+  double p50 = 0;
+  double p99 = 0;
+};
+
+Result Summarize(std::vector<double>& samples) {
+  Result result;
+  if (samples.empty()) {
+    return result;
+  }
+  std::sort(samples.begin(), samples.end());
+  result.p50 = samples[samples.size() / 2];
+  result.p99 = samples[samples.size() * 99 / 100];
+  return result;
+}
+
+double ElapsedUs(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void ReadResponse(boost::asio::ip::tcp::socket& socket,
+                  boost::beast::flat_buffer& buffer) {
+  boost::beast::http::response<boost::beast::http::string_body> resp;
+  boost::beast::http::read(socket, buffer, resp);
+}
+
+// Keep-alive POSTs whose header and body go out in separate writes, the
+// usual pattern where Nagle meets delayed ACKs
+Result KeepAlive(std::uint16_t port, std::size_t iterations) {
+  boost::asio::io_context ioc;
+  boost::asio::ip::tcp::socket socket(ioc);
+  socket.connect({boost::asio::ip::make_address("127.0.0.1"), port});
+  const std::string body = R"({"id":42,"name":"netkit"})";
+  const std::string header =
+      "POST /json HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+      "Content-Type: application/json\r\nContent-Length: " +
+      std::to_string(body.size()) + "\r\n\r\n";
+  boost::beast::flat_buffer buffer;
+  std::vector<double> samples;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    boost::asio::write(socket, boost::asio::buffer(header));
+    boost::asio::write(socket, boost::asio::buffer(body));
+    ReadResponse(socket, buffer);
+    samples.push_back(ElapsedUs(start));
+  }
+  return Summarize(samples);
+}
+
+// Connect, GET and close for every request
+Result NewConnection(std::uint16_t port, std::size_t iterations) {
+  boost::asio::io_context ioc;
+  const std::string request =
+      "GET /json HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+  std::vector<double> samples;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    boost::asio::ip::tcp::socket socket(ioc);
+    socket.connect({boost::asio::ip::make_address("127.0.0.1"), port});
+    boost::asio::write(socket, boost::asio::buffer(request));
+    boost::beast::flat_buffer buffer;
+    ReadResponse(socket, buffer);
+    samples.push_back(ElapsedUs(start));
+  }
+  return Summarize(samples);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 200;
+  IoContextPool pool(1);
+  std::thread thread([&pool]() { pool.Run(); });
+
+  std::vector<Variant> variants = {
+      {"system defaults", tcp::SocketOptions().set_no_delay(false)},
+      {"no_delay", tcp::SocketOptions()},
+      {"no_delay quick_ack", tcp::SocketOptions().set_quick_ack(true)},
+      {"no_delay busy_poll=50us",
+       tcp::SocketOptions().set_busy_poll(std::chrono::microseconds(50))},
+      {"no_delay defer_accept=1s",
+       tcp::SocketOptions().set_defer_accept(std::chrono::seconds(1))},
+      {"no_delay fast_open=256", tcp::SocketOptions().set_fast_open(256)},
+      {"no_delay buffers=256K", tcp::SocketOptions()
+                                    .set_receive_buffer_size(256 * 1024)
+                                    .set_send_buffer_size(256 * 1024)},
+  };
+
+  std::cout << std::left << std::setw(28) << "options" << std::right
+            << std::setw(14) << "keepalive p50" << std::setw(8) << "p99"
+            << std::setw(14) << "connect p50" << std::setw(8) << "p99"
+            << "  (us)" << std::endl;
+  std::uint16_t port = 18500;
+  for (const auto& variant : variants) {
+    ++port;
+    auto server = std::make_shared<http::PlainServer>(pool);
+    server->settings().set_socket_options(variant.options);
+    server->HandleFunc(
+        "/json",
+        [](const http::Context::Ptr& ctx) {
+          ctx->Ok(R"({"ok":true})", "application/json");
+        },
+        {"GET", "POST"});
+    try {
+      server->ListenAndServe("127.0.0.1", port);
+      auto keep_alive = KeepAlive(port, iterations);
+      auto new_connection = NewConnection(port, iterations);
+      std::cout << std::left << std::setw(28) << variant.name << std::right
+                << std::fixed << std::setprecision(0) << std::setw(14)
+                << keep_alive.p50 << std::setw(8) << keep_alive.p99
+                << std::setw(14) << new_connection.p50 << std::setw(8)
+                << new_connection.p99 << std::endl;
+    } catch (const std::exception& e) {
+      std::cout << std::left << std::setw(28) << variant.name << e.what()
+                << std::endl;
+    }
+    server->Close();
+  }
+
+  pool.Stop();
+  thread.join();
+}
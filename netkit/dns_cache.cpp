@@ -0,0 +1,245 @@
+#include <netkit/dns_cache.h>
+
+#include <algorithm>
+#include <future>
+#include <sstream>
+
+namespace netkit {
+
+SystemResolver::SystemResolver()
+    : work_(boost::asio::make_work_guard(ioc_)),
+      thread_([this]() { ioc_.run(); }) {}
+
+SystemResolver::~SystemResolver() noexcept {
+  work_.reset();
+  ioc_.stop();
+  thread_.join();
+}
+
+void SystemResolver::AsyncResolve(const std::string& host,
+                                  const std::string& port,
+                                  Callback&& callback) {
+  auto resolver = std::make_shared<boost::asio::ip::tcp::resolver>(ioc_);
+  resolver->async_resolve(
+      host, port,
+      [resolver, callback = std::move(callback)](
+          const boost::system::error_code& ec,
+          boost::asio::ip::tcp::resolver::results_type results) {
+        Endpoints endpoints;
+        for (const auto& entry : results) {
+          endpoints.emplace_back(entry.endpoint());
+        }
+        callback(ec, std::move(endpoints));
+      });
+}
+
+HostsResolver& HostsResolver::Load(std::istream& is) {
+  std::string line;
+  while (std::getline(is, line)) {
+    auto pos = line.find('#');
+    if (pos != std::string::npos) {
+      line.erase(pos);
+    }
+    std::istringstream fields(line);
+    std::string address;
+    std::string host;
+    if (!(fields >> address)) {
+      continue;
+    }
+    while (fields >> host) {
+      Add(host, address);
+    }
+  }
+  return *this;
+}
+
+HostsResolver& HostsResolver::Add(const std::string& host,
+                                  const std::string& address) {
+  auto parsed = boost::asio::ip::make_address(address);
+  std::lock_guard<std::mutex> lock(mutex_);
+  hosts_[host].emplace_back(parsed);
+  return *this;
+}
+
+HostsResolver& HostsResolver::Remove(const std::string& host) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  hosts_.erase(host);
+  return *this;
+}
+
+void HostsResolver::AsyncResolve(const std::string& host,
+                                 const std::string& port,
+                                 Callback&& callback) {
+  Endpoints endpoints;
+  std::uint16_t port_num = 0;
+  try {
+    port_num = static_cast<std::uint16_t>(std::stoul(port));
+  } catch (const std::exception&) {
+    return callback(boost::asio::error::service_not_found, {});
+  }
+  boost::system::error_code ec;
+  auto address = boost::asio::ip::make_address(host, ec);
+  if (!ec) {
+    endpoints.emplace_back(address, port_num);
+  } else {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = hosts_.find(host);
+    if (it != hosts_.end()) {
+      for (const auto& item : it->second) {
+        endpoints.emplace_back(item, port_num);
+      }
+    }
+  }
+  if (endpoints.empty()) {
+    return callback(boost::asio::error::host_not_found, {});
+  }
+  callback({}, std::move(endpoints));
+}
+
+DnsCache::DnsCache(IoContextPool& pool, std::shared_ptr<NameResolver> resolver)
+    : pool_(pool), resolver_(std::move(resolver)) {
+  if (!resolver_) {
+    resolver_ = std::make_shared<SystemResolver>();
+  }
+}
+
+DnsCache::Results DnsCache::Resolve(const std::string& host,
+                                    const std::string& port) {
+  std::promise<Results> promise;
+  auto future = promise.get_future();
+  Lookup(host, port,
+         [&promise](const boost::system::error_code& ec, Results&& results) {
+           if (ec) {
+             promise.set_exception(std::make_exception_ptr(
+                 boost::system::system_error(ec, "resolve")));
+           } else {
+             promise.set_value(std::move(results));
+           }
+         });
+  return future.get();
+}
+
+DnsStats DnsCache::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void DnsCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Resolutions in progress keep their entries for the waiters
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if (it->second.resolving) {
+      it->second.endpoints.clear();
+      ++it;
+    } else {
+      it = entries_.erase(it);
+    }
+  }
+}
+
+void DnsCache::Lookup(const std::string& host, const std::string& port,
+                      Callback&& callback) {
+  Results results;
+  bool refresh = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    auto& entry = entries_[host + ":" + port];
+    bool expired = now >= entry.expires;
+    // The resolver already failed, waiting for it again would not help
+    bool stale = expired && entry.failed && now < entry.expires + max_stale_;
+    if (entry.endpoints.empty() || (expired && !stale)) {
+      ++stats_.misses;
+      entry.waiters.emplace_back(std::move(callback));
+      if (entry.resolving) {
+        return;
+      }
+      entry.resolving = true;
+    } else {
+      ++stats_.hits;
+      if (stale) {
+        ++stats_.stale;
+      }
+      auto refresh_at =
+          entry.failed ? entry.retry_at : entry.expires - refresh_ahead_;
+      if (!entry.resolving && now >= refresh_at) {
+        entry.resolving = true;
+        refresh = true;
+        ++stats_.refreshes;
+      }
+      results = Rotate(entry, host, port);
+    }
+  }
+  if (!results.empty()) {
+    callback({}, std::move(results));
+    if (!refresh) {
+      return;
+    }
+  }
+  Start(host, port);
+}
+
+void DnsCache::Start(const std::string& host, const std::string& port) {
+  try {
+    resolver_->AsyncResolve(
+        host, port,
+        [this, host, port](const boost::system::error_code& ec,
+                           NameResolver::Endpoints&& endpoints) {
+          OnResolved(host, port, ec, std::move(endpoints));
+        });
+  } catch (const std::exception&) {
+    OnResolved(host, port, boost::asio::error::no_memory, {});
+  }
+}
+
+void DnsCache::OnResolved(const std::string& host, const std::string& port,
+                          const boost::system::error_code& ec,
+                          NameResolver::Endpoints&& endpoints) {
+  std::vector<Callback> waiters;
+  Results results;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    auto& entry = entries_[host + ":" + port];
+    entry.resolving = false;
+    waiters.swap(entry.waiters);
+    if (!ec && !endpoints.empty()) {
+      entry.endpoints = std::move(endpoints);
+      entry.expires = now + ttl_;
+      entry.failed = false;
+      entry.next = 0;
+    } else {
+      ++stats_.failures;
+      // The previous addresses are kept for max_stale() after the expiry
+      if (!entry.endpoints.empty() && now >= entry.expires + max_stale_) {
+        entry.endpoints.clear();
+      }
+      entry.failed = true;
+      entry.retry_at = now + retry_interval_;
+    }
+    if (!entry.endpoints.empty() && !waiters.empty()) {
+      if (now >= entry.expires) {
+        stats_.stale += waiters.size();
+      }
+      results = Rotate(entry, host, port);
+    }
+  }
+  auto error = ec ? ec : boost::asio::error::host_not_found;
+  for (auto& waiter : waiters) {
+    if (results.empty()) {
+      waiter(error, {});
+    } else {
+      waiter({}, Results(results));
+    }
+  }
+}
+
+DnsCache::Results DnsCache::Rotate(Entry& entry, const std::string& host,
+                                   const std::string& port) {
+  auto endpoints = entry.endpoints;
+  auto first = entry.next++ % endpoints.size();
+  std::rotate(endpoints.begin(), endpoints.begin() + first, endpoints.end());
+  return Results::create(endpoints.begin(), endpoints.end(), host, port);
+}
+
+}  // namespace netkit
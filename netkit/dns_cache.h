@@ -0,0 +1,218 @@
+#pragma once
+#include <netkit/io_context_pool.h>
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <chrono>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace netkit {
+
+// Source of the addresses cached by DnsCache
+class NameResolver {
+ public:
+  using Endpoints = std::vector<boost::asio::ip::tcp::endpoint>;
+  using Callback =
+      std::function<void(const boost::system::error_code&, Endpoints&&)>;
+
+  virtual ~NameResolver() noexcept {}
+
+  // callback may run on any thread, this one included
+  virtual void AsyncResolve(const std::string& host, const std::string& port,
+                            Callback&& callback) = 0;
+};
+
+// getaddrinfo() on a thread of its own, so that waiting for it never blocks
+// the thread which would complete it
+class SystemResolver : public NameResolver {
+ public:
+  SystemResolver();
+
+  ~SystemResolver() noexcept;
+
+  void AsyncResolve(const std::string& host, const std::string& port,
+                    Callback&& callback) override;
+
+ private:
+  boost::asio::io_context ioc_;
+  boost::asio::executor_work_guard<boost::asio::io_context::executor_type>
+      work_;
+  std::thread thread_;
+};
+
+// Names from an /etc/hosts style table, numeric addresses are passed
+// through. For tests and pinned upstreams.
+class HostsResolver : public NameResolver {
+  using Self = HostsResolver;
+
+ public:
+  // "address name [alias...]" per line, # starts a comment
+  Self& Load(std::istream& is);
+
+  Self& Add(const std::string& host, const std::string& address);
+
+  // Subsequent lookups of the host fail with host_not_found
+  Self& Remove(const std::string& host);
+
+  void AsyncResolve(const std::string& host, const std::string& port,
+                    Callback&& callback) override;
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::vector<boost::asio::ip::address>>
+      hosts_;
+};
+
+struct DnsStats {
+  // Lookups served from the cache and those which had to wait for the
+  // resolver
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  // Background resolutions before the expiry
+  std::uint64_t refreshes = 0;
+  // Expired addresses served because the resolver failed
+  std::uint64_t stale = 0;
+  std::uint64_t failures = 0;
+};
+
+// Resolved addresses shared by the clients. An entry is resolved again in
+// the background once it is within refresh_ahead() of its ttl(), lookups are
+// not delayed by it. An expired entry is resolved before being served, the
+// old addresses are still returned if that fails within max_stale(). Once a
+// resolution failed, lookups are served the old addresses right away and the
+// resolver is retried in the background every retry_interval(). Each lookup
+// rotates the addresses so that connections are spread over them.
+// The system resolver doesn't report record TTLs, ttl() applies to every
+// entry.
+class DnsCache {
+  using Self = DnsCache;
+
+ public:
+  using Results = boost::asio::ip::tcp::resolver::results_type;
+
+  // The system resolver when none is given
+  explicit DnsCache(IoContextPool& pool,
+                    std::shared_ptr<NameResolver> resolver = nullptr);
+
+  DnsCache(const DnsCache&) = delete;
+  DnsCache& operator=(const DnsCache&) = delete;
+
+  std::chrono::milliseconds ttl() const noexcept { return ttl_; }
+
+  Self& set_ttl(const std::chrono::milliseconds& val) noexcept {
+    ttl_ = val;
+    return *this;
+  }
+
+  std::chrono::milliseconds refresh_ahead() const noexcept {
+    return refresh_ahead_;
+  }
+
+  Self& set_refresh_ahead(const std::chrono::milliseconds& val) noexcept {
+    refresh_ahead_ = val;
+    return *this;
+  }
+
+  std::chrono::milliseconds max_stale() const noexcept { return max_stale_; }
+
+  Self& set_max_stale(const std::chrono::milliseconds& val) noexcept {
+    max_stale_ = val;
+    return *this;
+  }
+
+  std::chrono::milliseconds retry_interval() const noexcept {
+    return retry_interval_;
+  }
+
+  Self& set_retry_interval(const std::chrono::milliseconds& val) noexcept {
+    retry_interval_ = val;
+    return *this;
+  }
+
+  // Blocks on a miss, throws boost::system::system_error when the host
+  // can't be resolved
+  Results Resolve(const std::string& host, const std::string& port);
+
+  // Completes with void(boost::system::error_code, Results) on the
+  // executor of the handler, or else on a context of the pool
+  template <class CompletionToken>
+  auto AsyncResolve(const std::string& host, const std::string& port,
+                    CompletionToken&& token) {
+    return boost::asio::async_initiate<
+        CompletionToken, void(boost::system::error_code, Results)>(
+        [this](auto handler, const std::string& host,
+               const std::string& port) {
+          auto ex = boost::asio::get_associated_executor(
+              handler, pool_.Get().get_executor());
+          auto shared =
+              std::make_shared<decltype(handler)>(std::move(handler));
+          Lookup(host, port,
+                 [ex, shared](const boost::system::error_code& ec,
+                              Results&& results) {
+                   boost::asio::post(
+                       ex, [shared, ec, results = std::move(results)]() {
+                         (*shared)(ec, results);
+                       });
+                 });
+        },
+        // Copies, the strings may belong to the handler moved from token
+        token, std::string(host), std::string(port));
+  }
+
+  DnsStats stats() const;
+
+  // Drops every entry, the next lookups are misses
+  void Clear();
+
+ private:
+  using Callback =
+      std::function<void(const boost::system::error_code&, Results&&)>;
+
+  struct Entry {
+    NameResolver::Endpoints endpoints;
+    std::chrono::steady_clock::time_point expires;
+    // The last resolution failed, not resolved again before retry_at
+    bool failed = false;
+    std::chrono::steady_clock::time_point retry_at;
+    // Next address served first
+    std::size_t next = 0;
+    bool resolving = false;
+    // Lookups waiting for the resolution in progress
+    std::vector<Callback> waiters;
+  };
+
+  // callback runs on this thread on a hit, or else on the resolver's
+  void Lookup(const std::string& host, const std::string& port,
+              Callback&& callback);
+
+  void Start(const std::string& host, const std::string& port);
+
+  void OnResolved(const std::string& host, const std::string& port,
+                  const boost::system::error_code& ec,
+                  NameResolver::Endpoints&& endpoints);
+
+  // Called locked
+  static Results Rotate(Entry& entry, const std::string& host,
+                        const std::string& port);
+
+ private:
+  IoContextPool& pool_;
+  std::shared_ptr<NameResolver> resolver_;
+  std::chrono::milliseconds ttl_{60000};
+  std::chrono::milliseconds refresh_ahead_{10000};
+  std::chrono::milliseconds max_stale_{300000};
+  std::chrono::milliseconds retry_interval_{2000};
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_;
+  DnsStats stats_;
+};
+
+}  // namespace netkit
@@ -1,58 +1,611 @@
 #pragma once
+#include <netkit/dns_cache.h>
+#include <netkit/http/digest_auth.h>
+#include <netkit/http/stream_body.h>
+#include <netkit/io_context_pool.h>
+#include <netkit/local/socket.h>
+#include <netkit/ssl/client_session_cache.h>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/beast.hpp>
 #include <boost/beast/ssl.hpp>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <optional>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 namespace netkit::http {
 
-template <class T>
+// Deadlines of the phases of a request, 0 for none. A phase past its
+// deadline fails with boost::beast::error::timeout and closes the
+// connection, the next request connects again.
+class ClientTimeouts {
+  using Self = ClientTimeouts;
+
+ public:
+  std::chrono::milliseconds connect_timeout() const noexcept {
+    return connect_timeout_;
+  }
+
+  Self& set_connect_timeout(const std::chrono::milliseconds& val) noexcept {
+    connect_timeout_ = val;
+    return *this;
+  }
+
+  std::chrono::milliseconds handshake_timeout() const noexcept {
+    return handshake_timeout_;
+  }
+
+  // TLS handshake of SslClient
+  Self& set_handshake_timeout(const std::chrono::milliseconds& val) noexcept {
+    handshake_timeout_ = val;
+    return *this;
+  }
+
+  std::chrono::milliseconds write_timeout() const noexcept {
+    return write_timeout_;
+  }
+
+  Self& set_write_timeout(const std::chrono::milliseconds& val) noexcept {
+    write_timeout_ = val;
+    return *this;
+  }
+
+  std::chrono::milliseconds read_timeout() const noexcept {
+    return read_timeout_;
+  }
+
+  // The whole response, not each read
+  Self& set_read_timeout(const std::chrono::milliseconds& val) noexcept {
+    read_timeout_ = val;
+    return *this;
+  }
+
+  std::chrono::milliseconds request_timeout() const noexcept {
+    return request_timeout_;
+  }
+
+  // From resolving to the end of the response, the retry on a new
+  // connection included
+  Self& set_request_timeout(const std::chrono::milliseconds& val) noexcept {
+    request_timeout_ = val;
+    return *this;
+  }
+
+  bool empty() const noexcept {
+    return connect_timeout_.count() <= 0 && handshake_timeout_.count() <= 0 &&
+           write_timeout_.count() <= 0 && read_timeout_.count() <= 0 &&
+           request_timeout_.count() <= 0;
+  }
+
+ private:
+  std::chrono::milliseconds connect_timeout_{0};
+  std::chrono::milliseconds handshake_timeout_{0};
+  std::chrono::milliseconds write_timeout_{0};
+  std::chrono::milliseconds read_timeout_{0};
+  std::chrono::milliseconds request_timeout_{0};
+};
+
+// T is the derived client, Protocol the one of its socket, TCP or Unix
+// domain
+template <class T, class Protocol = boost::asio::ip::tcp>
 class BasicClient {
+  static constexpr std::size_t kStreamReadSize = 64 * 1024;
+  static constexpr std::chrono::milliseconds kIdleProbe{20};
+  static constexpr bool kIsLocal =
+      !std::is_same_v<Protocol, boost::asio::ip::tcp>;
+
  public:
   BasicClient(boost::asio::io_context& ioc, const std::string& host,
               std::uint16_t port) noexcept
-      : resolver_(ioc), host_(host), port_(std::to_string(port)) {}
+      : ioc_(ioc),
+        resolver_(ioc),
+        deadline_(ioc),
+        host_(host),
+        port_(std::to_string(port)) {}
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  // Unix domain socket, see local::MakeEndpoint()
+  BasicClient(boost::asio::io_context& ioc,
+              const local::Endpoint& endpoint) noexcept
+      : ioc_(ioc),
+        resolver_(ioc),
+        deadline_(ioc),
+        host_("localhost"),
+        endpoint_(endpoint) {}
+#endif
+
+  // Kept alive after the last request
+  bool connected() const noexcept { return connected_; }
+
+  // Context the connection runs on
+  boost::asio::any_io_executor get_executor() noexcept {
+    return resolver_.get_executor();
+  }
+
+  // Host names resolved through the cache instead of on every connect, it
+  // must outlive the client
+  void set_dns_cache(DnsCache* cache) noexcept { dns_cache_ = cache; }
+
+  const ClientTimeouts& timeouts() const noexcept { return timeouts_; }
+
+  void set_timeouts(const ClientTimeouts& timeouts) noexcept {
+    timeouts_ = timeouts;
+  }
 
   void AddHeader(const std::string& key, const std::string& value) noexcept {
     add_headers_.emplace_back(std::make_pair(key, value));
   }
 
+  // Answers digest challenges. After the first one, requests carry the
+  // Authorization up front; a 401 is sent again once with the new
+  // challenge when its nonce is stale or new. Streamed bodies are not sent
+  // again, the next request uses the challenge.
+  void set_digest_auth(const std::string& username,
+                       const std::string& password) {
+    digest_.emplace(username, password);
+  }
+
+  // Streamed bodies (ProducerBody, SinkBody, file_body) go through a chunk
+  // at a time, without the body limit. They are not sent again on a new
+  // connection once part of them went through.
+  //
+  // With timeouts, the request runs as AsyncSendRequest() since only the
+  // asynchronous operations can expire. The thread waits for the context of
+  // the client, or runs it when it is the one running it or when no thread
+  // does, see IsIdle().
   template <class ReqBody, class RespBody>
   void SendRequest(boost::beast::http::request<ReqBody>& req,
                    boost::beast::http::response<RespBody>& resp) {
-    req.set(boost::beast::http::field::host, host_ + ":" + port_);
-    for (const auto& pair : add_headers_) {
-      req.set(pair.first, pair.second);
+    if (timeouts_.empty()) {
+      PrepareRequest(req);
+      DoRequest(req, resp);
+      if (Reauthorize(req, resp)) {
+        DoRequest(req, resp);
+      }
+      return;
+    }
+    std::promise<boost::system::error_code> promise;
+    auto future = promise.get_future();
+    AsyncSendRequest(req, resp, [&promise](boost::system::error_code ec) {
+      promise.set_value(ec);
+    });
+    if (ioc_.get_executor().running_in_this_thread() || IsIdle(future)) {
+      while (future.wait_for(std::chrono::seconds(0)) !=
+             std::future_status::ready) {
+        if (ioc_.run_one() == 0) {
+          ioc_.restart();
+        }
+      }
+    }
+    auto ec = future.get();
+    if (ec) {
+      throw boost::system::system_error(ec);
+    }
+  }
+
+  // SendRequest() without blocking the thread, resolving and connecting
+  // included. Completes with void(boost::system::error_code) through any
+  // completion token: a callback, boost::asio::use_future,
+  // boost::asio::use_awaitable... A request failing on a kept-alive
+  // connection is retried once on a new one. req and resp must outlive the
+  // operation, and one request at a time is sent.
+  template <class ReqBody, class RespBody, class CompletionToken>
+  auto AsyncSendRequest(boost::beast::http::request<ReqBody>& req,
+                        boost::beast::http::response<RespBody>& resp,
+                        CompletionToken&& token) {
+    PrepareRequest(req);
+    cancelled_ = false;
+    timed_out_ = false;
+    ++generation_;
+    return boost::asio::async_compose<CompletionToken,
+                                      void(boost::system::error_code)>(
+        AsyncRequestOp<ReqBody, RespBody>(*this, req, resp), token,
+        resolver_);
+  }
+
+  // Aborts the AsyncSendRequest() in progress, which completes with
+  // boost::asio::error::operation_aborted and closes the connection. Call
+  // it on the executor the request completes on.
+  void Cancel() noexcept {
+    cancelled_ = true;
+    resolver_.cancel();
+    if (lookup_) {
+      lookup_->wait.cancel();
     }
-    DoRequest(req, resp);
+    boost::beast::get_lowest_layer(Derived().stream()).cancel();
   }
 
   void Close() noexcept {
     resolver_.cancel();
+    if (lookup_) {
+      lookup_->wait.cancel();
+    }
     Derived().DoClose();
     buffer_ = {};
     connected_ = false;
+    lease_.Release();
   }
 
+ protected:
+  // Counts the client as a connection of its context while connected
+  void set_pool(IoContextPool& pool) noexcept { pool_ = &pool; }
+
+  const std::string& host() const noexcept { return host_; }
+
+  // Empty for a Unix domain socket
+  const std::string& port() const noexcept { return port_; }
+
  private:
   T& Derived() noexcept { return static_cast<T&>(*this); }
 
+  // Nothing runs the context of a client off a pool, such as a context
+  // which is not run yet, when a probe posted to it doesn't run meanwhile.
+  // A context of a pool, PlainClient(pool.At(i), ...) for instance, must not
+  // run its handlers on the calling thread.
+  bool IsIdle(std::future<boost::system::error_code>& future) {
+    if (pool_) {
+      return false;
+    }
+    if (ioc_.stopped()) {
+      return true;
+    }
+    auto probed = std::make_shared<std::atomic<bool>>(false);
+    boost::asio::post(ioc_, [probed]() { *probed = true; });
+    return future.wait_for(kIdleProbe) != std::future_status::ready &&
+           !*probed;
+  }
+
+  template <class ReqBody>
+  void PrepareRequest(boost::beast::http::request<ReqBody>& req) {
+    req.set(boost::beast::http::field::host,
+            port_.empty() ? host_ : host_ + ":" + port_);
+    for (const auto& pair : add_headers_) {
+      req.set(pair.first, pair.second);
+    }
+    if (digest_) {
+      Authorize(req);
+    }
+  }
+
+  template <class ReqBody>
+  void Authorize(boost::beast::http::request<ReqBody>& req) {
+    std::optional<std::string_view> body;
+    if constexpr (std::is_same_v<ReqBody, boost::beast::http::string_body>) {
+      body = req.body();
+    } else if constexpr (std::is_same_v<ReqBody,
+                                        boost::beast::http::empty_body>) {
+      body = std::string_view();
+    }
+    auto target = req.target();
+    auto auth = digest_->Authorize(req.method_string().to_string(),
+                                   std::string(target.data(), target.size()),
+                                   body);
+    if (auth) {
+      req.set(boost::beast::http::field::authorization, *auth);
+    }
+  }
+
+  // Takes the digest challenge of a 401, true when req is authorized again
+  // and worth sending
+  template <class ReqBody, class RespBody>
+  bool Reauthorize(boost::beast::http::request<ReqBody>& req,
+                   const boost::beast::http::response<RespBody>& resp) {
+    if (!digest_ || resp.result() != boost::beast::http::status::unauthorized) {
+      return false;
+    }
+    bool retry = false;
+    auto range = resp.equal_range(boost::beast::http::field::www_authenticate);
+    for (auto it = range.first; it != range.second; ++it) {
+      auto value = it->value();
+      if (value.starts_with("Digest ")) {
+        retry =
+            digest_->OnChallenge(std::string_view(value.data(), value.size()));
+        break;
+      }
+    }
+    if (!retry || kIsStreamBody<ReqBody> || kIsStreamBody<RespBody>) {
+      return false;
+    }
+    Authorize(req);
+    return true;
+  }
+
+  // A DnsCache lookup, Cancel() and the request deadline stop waiting for
+  // it. Shared with the lookup which may complete after the client is gone.
+  struct Lookup {
+    explicit Lookup(const boost::asio::any_io_executor& ex) : wait(ex) {}
+
+    // Cancelled once the lookup completes
+    boost::asio::steady_timer wait;
+    bool done = false;
+    boost::system::error_code ec;
+    boost::asio::ip::tcp::resolver::results_type results;
+  };
+
+  // Completes with the error of the wait, see TakeLookup()
+  template <class Handler>
+  void AsyncLookup(Handler&& handler) {
+    lookup_ = std::make_shared<Lookup>(resolver_.get_executor());
+    lookup_->wait.expires_at(boost::asio::steady_timer::time_point::max());
+    lookup_->wait.async_wait(std::forward<Handler>(handler));
+    dns_cache_->AsyncResolve(
+        host_, port_,
+        boost::asio::bind_executor(
+            resolver_.get_executor(),
+            [lookup = lookup_](
+                const boost::system::error_code& ec,
+                boost::asio::ip::tcp::resolver::results_type results) {
+              lookup->done = true;
+              lookup->ec = ec;
+              lookup->results = std::move(results);
+              lookup->wait.cancel();
+            }));
+  }
+
+  // Result of AsyncLookup(), operation_aborted when it was cancelled first
+  boost::system::error_code TakeLookup(
+      boost::asio::ip::tcp::resolver::results_type& results) {
+    auto lookup = std::move(lookup_);
+    if (cancelled_ || !lookup->done) {
+      return boost::asio::error::operation_aborted;
+    }
+    results = std::move(lookup->results);
+    return lookup->ec;
+  }
+
+  boost::asio::ip::tcp::resolver::results_type Resolve() {
+    return dns_cache_ ? dns_cache_->Resolve(host_, port_)
+                      : resolver_.resolve(host_, port_);
+  }
+
+  // Connects the socket to the resolved addresses, or to the path of a
+  // Unix domain socket
+  void Connect() {
+    auto& stream = boost::beast::get_lowest_layer(Derived().stream());
+    if constexpr (kIsLocal) {
+      stream.connect(endpoint_);
+    } else {
+      stream.connect(Resolve());
+    }
+  }
+
+  // results by value, the handler may own the ones passed. Unused for a
+  // Unix domain socket.
+  template <class Handler>
+  void AsyncConnect(boost::asio::ip::tcp::resolver::results_type results,
+                    Handler&& handler) {
+    auto& stream = boost::beast::get_lowest_layer(Derived().stream());
+    if constexpr (kIsLocal) {
+      stream.async_connect(endpoint_, std::forward<Handler>(handler));
+    } else {
+      stream.async_connect(results, std::forward<Handler>(handler));
+    }
+  }
+
+  template <class Handler>
+  void AsyncHandshake(Handler&& handler) {
+    Derived().DoAsyncHandshake(std::forward<Handler>(handler));
+  }
+
+  // Deadline of the next operation on the stream, capped by the one of
+  // the request
+  void ExpiresAfter(const std::chrono::milliseconds& timeout) {
+    auto& stream = boost::beast::get_lowest_layer(Derived().stream());
+    if (timeout.count() > 0) {
+      stream.expires_after(timeout);
+    } else {
+      stream.expires_never();
+    }
+  }
+
+  template <class Executor>
+  void StartDeadline(const Executor& ex) {
+    if (timeouts_.request_timeout().count() <= 0) {
+      return;
+    }
+    deadline_.expires_after(timeouts_.request_timeout());
+    deadline_.async_wait(boost::asio::bind_executor(
+        ex, [this, generation = generation_](
+                const boost::system::error_code& ec) {
+          // Late for a request which already completed
+          if (!ec && generation == generation_) {
+            timed_out_ = true;
+            Cancel();
+          }
+        }));
+  }
+
+  void OnConnected() {
+    Derived().DoConnected();
+    if (pool_) {
+      lease_ = pool_->Track(resolver_.get_executor());
+    }
+  }
+
+  // Drops the connection without a graceful shutdown, which would block
+  void Abort() noexcept {
+    Derived().DoAbort();
+    buffer_ = {};
+    connected_ = false;
+    lease_.Release();
+  }
+
+  template <class ReqBody, class RespBody>
+  class AsyncRequestOp : public boost::asio::coroutine {
+   public:
+    AsyncRequestOp(BasicClient& client,
+                   boost::beast::http::request<ReqBody>& req,
+                   boost::beast::http::response<RespBody>& resp) noexcept
+        : client_(client), req_(req), resp_(resp) {}
+
+    // Resolved, by value to be preferred over the overload below
+    template <class Self>
+    void operator()(Self& self, boost::system::error_code ec,
+                    boost::asio::ip::tcp::resolver::results_type results) {
+      results_ = std::move(results);
+      (*this)(self, ec, 0);
+    }
+
+    template <class Self, class... Args>
+    void operator()(Self& self, boost::system::error_code ec = {},
+                    Args&&...) {
+      // Between two operations, none was pending to cancel
+      if (client_.cancelled_ && !ec) {
+        ec = boost::asio::error::operation_aborted;
+      }
+      BOOST_ASIO_CORO_REENTER(*this) {
+        client_.StartDeadline(self.get_executor());
+        for (;;) {
+          ResetResponse(resp_);
+          retry_ = client_.connected_ && !kIsStreamBody<ReqBody>;
+          if (!client_.connected_) {
+            if (!kIsLocal) {
+              if (client_.dns_cache_) {
+                BOOST_ASIO_CORO_YIELD client_.AsyncLookup(std::move(self));
+                ec = client_.TakeLookup(results_);
+              } else {
+                BOOST_ASIO_CORO_YIELD client_.resolver_.async_resolve(
+                    client_.host_, client_.port_, std::move(self));
+              }
+            }
+            if (!ec) {
+              client_.ExpiresAfter(client_.timeouts_.connect_timeout());
+              BOOST_ASIO_CORO_YIELD client_.AsyncConnect(results_,
+                                                         std::move(self));
+            }
+            if (!ec) {
+              client_.ExpiresAfter(client_.timeouts_.handshake_timeout());
+              BOOST_ASIO_CORO_YIELD client_.AsyncHandshake(std::move(self));
+            }
+            if (ec) {
+              client_.Abort();
+              return Complete(self, ec);
+            }
+            client_.OnConnected();
+          }
+          client_.ExpiresAfter(client_.timeouts_.write_timeout());
+          BOOST_ASIO_CORO_YIELD boost::beast::http::async_write(
+              client_.Derived().stream(), req_, std::move(self));
+          if (!ec) {
+            client_.ExpiresAfter(client_.timeouts_.read_timeout());
+            parser_ = client_.MakeParser(resp_);
+            BOOST_ASIO_CORO_YIELD boost::beast::http::async_read(
+                client_.Derived().stream(), client_.buffer_, *parser_,
+                std::move(self));
+            // Part of a streamed response reached its sink
+            if (kIsStreamBody<RespBody> && parser_->is_header_done()) {
+              retry_ = false;
+            }
+            resp_ = parser_->release();
+            parser_.reset();
+          }
+          if (ec) {
+            client_.Abort();
+            // A slow server is not a stale connection
+            if (!retry_ || ec == boost::asio::error::operation_aborted ||
+                ec == boost::beast::error::timeout) {
+              return Complete(self, ec);
+            }
+            continue;
+          }
+          if (req_.need_eof() || resp_.need_eof()) {
+            client_.Abort();
+          } else {
+            client_.ExpiresAfter(std::chrono::milliseconds(0));
+            client_.connected_ = true;
+          }
+          if (challenged_ || !client_.Reauthorize(req_, resp_)) {
+            break;
+          }
+          challenged_ = true;
+        }
+        Complete(self, {});
+      }
+    }
+
+   private:
+    template <class Self>
+    void Complete(Self& self, boost::system::error_code ec) {
+      client_.deadline_.cancel();
+      if (client_.timed_out_ && ec == boost::asio::error::operation_aborted) {
+        ec = boost::beast::error::timeout;
+      }
+      self.complete(ec);
+    }
+
+   private:
+    BasicClient& client_;
+    boost::beast::http::request<ReqBody>& req_;
+    boost::beast::http::response<RespBody>& resp_;
+    bool retry_ = false;
+    // Sent again after a digest challenge
+    bool challenged_ = false;
+    // On the heap, the operation moves while the read refers to it
+    std::unique_ptr<boost::beast::http::response_parser<RespBody>> parser_;
+    boost::asio::ip::tcp::resolver::results_type results_;
+  };
+
+  // A streamed body stays, only the header is cleared
+  template <class RespBody>
+  static void ResetResponse(boost::beast::http::response<RespBody>& resp) {
+    if constexpr (kIsStreamBody<RespBody>) {
+      resp.base() = {};
+    } else {
+      resp = {};
+    }
+  }
+
+  // Takes resp until released, as boost::beast::http::read() does
+  template <class RespBody>
+  std::unique_ptr<boost::beast::http::response_parser<RespBody>> MakeParser(
+      boost::beast::http::response<RespBody>& resp) {
+    auto parser =
+        std::make_unique<boost::beast::http::response_parser<RespBody>>(
+            std::move(resp));
+    parser->eager(true);
+    if constexpr (kIsStreamBody<RespBody>) {
+      parser->body_limit(boost::none);
+      // Reads grow with the capacity of the buffer, which the body never
+      // fills, 512 bytes otherwise
+      buffer_.reserve(kStreamReadSize);
+    }
+    return parser;
+  }
+
   template <class ReqBody, class RespBody>
   void DoRequest(boost::beast::http::request<ReqBody>& req,
                  boost::beast::http::response<RespBody>& resp) {
-    resp = {};
+    ResetResponse(resp);
     if (!connected_) {
-      auto results = resolver_.resolve(host_, port_);
-      Derived().DoConnect(results);
+      Connect();
+      Derived().DoHandshake();
+      OnConnected();
     }
-    bool retry = connected_;
+    bool retry = connected_ && !kIsStreamBody<ReqBody>;
     bool success = false;
+    std::unique_ptr<boost::beast::http::response_parser<RespBody>> parser;
     try {
       auto& stream = Derived().stream();
       boost::beast::http::write(stream, req);
-      boost::beast::http::read(stream, buffer_, resp);
+      parser = MakeParser(resp);
+      boost::beast::http::read(stream, buffer_, *parser);
+      resp = parser->release();
       success = true;
     } catch (const std::exception&) {
+      if (parser) {
+        // Part of a streamed response reached its sink
+        if (kIsStreamBody<RespBody> && parser->is_header_done()) {
+          retry = false;
+        }
+        resp = parser->release();
+      }
       Close();
       if (!retry) {
         throw;
@@ -71,37 +624,87 @@ class BasicClient {
 
  private:
   bool connected_ = false;
+  bool cancelled_ = false;
+  bool timed_out_ = false;
+  // Tells the deadline of a request from the next one
+  std::uint64_t generation_ = 0;
+  boost::asio::io_context& ioc_;
   boost::asio::ip::tcp::resolver resolver_;
+  boost::asio::steady_timer deadline_;
+  ClientTimeouts timeouts_;
   std::string host_;
   std::string port_;
   boost::beast::flat_buffer buffer_;
   std::vector<std::pair<std::string, std::string>> add_headers_;
+  IoContextPool* pool_ = nullptr;
+  IoContextPool::Lease lease_;
+  DnsCache* dns_cache_ = nullptr;
+  std::shared_ptr<Lookup> lookup_;
+  std::optional<DigestCredentials> digest_;
+  // Path of a Unix domain socket, unused over TCP
+  typename Protocol::endpoint endpoint_;
 };
 
-class PlainClient : public BasicClient<PlainClient> {
+// Cleartext HTTP over TCP (PlainClient) or over a Unix domain socket
+// (LocalClient)
+template <class Protocol>
+class BasicPlainClient
+    : public BasicClient<BasicPlainClient<Protocol>, Protocol> {
+  using Base = BasicClient<BasicPlainClient<Protocol>, Protocol>;
+
  public:
-  PlainClient(boost::asio::io_context& ioc, const std::string& host,
-              std::uint16_t port) noexcept
-      : BasicClient(ioc, host, port), stream_(ioc) {}
+  BasicPlainClient(boost::asio::io_context& ioc, const std::string& host,
+                   std::uint16_t port) noexcept
+      : Base(ioc, host, port), stream_(ioc) {}
+
+  // Runs on the context picked by the policy of the pool
+  BasicPlainClient(IoContextPool& pool, const std::string& host,
+                   std::uint16_t port) noexcept
+      : BasicPlainClient(pool.Get(), host, port) {
+    this->set_pool(pool);
+  }
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  BasicPlainClient(boost::asio::io_context& ioc,
+                   const local::Endpoint& endpoint) noexcept
+      : Base(ioc, endpoint), stream_(ioc) {}
+#endif
 
  private:
-  void DoConnect(const boost::asio::ip::tcp::resolver::results_type& results) {
-    stream_.connect(results);
+  void DoHandshake() noexcept {}
+
+  // Nothing to do, completes right away
+  template <class Handler>
+  void DoAsyncHandshake(Handler&& handler) {
+    boost::asio::post(stream_.get_executor(),
+                      boost::beast::bind_front_handler(
+                          std::forward<Handler>(handler),
+                          boost::system::error_code()));
   }
 
   void DoClose() noexcept {
     boost::system::error_code ec;
-    stream_.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    stream_.socket().shutdown(boost::asio::socket_base::shutdown_both, ec);
   }
 
+  void DoAbort() noexcept { DoClose(); }
+
+  void DoConnected() noexcept {}
+
  private:
-  friend class BasicClient;
-  boost::beast::tcp_stream& stream() noexcept { return stream_; }
+  friend Base;
+  boost::beast::basic_stream<Protocol>& stream() noexcept { return stream_; }
 
  private:
-  boost::beast::tcp_stream stream_;
+  boost::beast::basic_stream<Protocol> stream_;
 };
 
+using PlainClient = BasicPlainClient<boost::asio::ip::tcp>;
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+using LocalClient = BasicPlainClient<boost::asio::local::stream_protocol>;
+#endif
+
 class SslClient : public BasicClient<SslClient> {
  public:
   SslClient(boost::asio::io_context& ioc, boost::asio::ssl::context& ssl_ctx,
@@ -111,12 +714,63 @@ class SslClient : public BasicClient<SslClient> {
         ssl_ctx_(ssl_ctx),
         stream_(ioc, ssl_ctx) {}
 
+  // Runs on the context picked by the policy of the pool
+  SslClient(IoContextPool& pool, boost::asio::ssl::context& ssl_ctx,
+            const std::string& host, std::uint16_t port) noexcept
+      : SslClient(pool.Get(), ssl_ctx, host, port) {
+    set_pool(pool);
+  }
+
  private:
-  void DoConnect(const boost::asio::ip::tcp::resolver::results_type& results) {
-    stream_.next_layer().connect(results);
+  void DoHandshake() {
+    PrepareSession();
     stream_.handshake(boost::asio::ssl::stream_base::client);
   }
 
+  template <class Handler>
+  void DoAsyncHandshake(Handler&& handler) {
+    PrepareSession();
+    stream_.async_handshake(boost::asio::ssl::stream_base::client,
+                            std::forward<Handler>(handler));
+  }
+
+  void DoAbort() noexcept {
+    // SSL_free() marks the session of a connection which didn't send its
+    // close_notify as not resumable, dropping it after the handshake
+    // doesn't make the session any worse
+    auto ssl = stream_.native_handle();
+    if (SSL_is_init_finished(ssl)) {
+      SSL_set_shutdown(ssl, SSL_get_shutdown(ssl) | SSL_SENT_SHUTDOWN);
+    }
+    boost::system::error_code ec;
+    stream_.next_layer().socket().close(ec);
+    stream_ =
+        boost::beast::ssl_stream<boost::beast::tcp_stream>(ioc_, ssl_ctx_);
+  }
+
+  void DoConnected() noexcept {
+    if (auto cache = SessionCache()) {
+      cache->OnHandshake(stream_.native_handle());
+    }
+  }
+
+  // Offers the session of the previous connection to the host when the
+  // context has a ssl::ClientSessionCache
+  void PrepareSession() {
+    auto cache = SessionCache();
+    if (!cache) {
+      return;
+    }
+    if (session_key_.empty()) {
+      session_key_ = host() + ":" + port();
+    }
+    cache->Prepare(stream_.native_handle(), session_key_);
+  }
+
+  ssl::ClientSessionCache* SessionCache() noexcept {
+    return ssl::ClientSessionCache::Get(ssl_ctx_.native_handle());
+  }
+
   void DoClose() noexcept {
     boost::system::error_code ec;
     stream_.shutdown(ec);
@@ -135,6 +789,8 @@ class SslClient : public BasicClient<SslClient> {
   friend class BasicClient;
   boost::asio::io_context& ioc_;
   boost::asio::ssl::context& ssl_ctx_;
+  // host:port, outlives the SSL of stream_ which refers to it
+  std::string session_key_;
   boost::beast::ssl_stream<boost::beast::tcp_stream> stream_;
 };
 
@@ -0,0 +1,245 @@
+#include <netkit/http/client_pool.h>
+
+#include <future>
+#include <stdexcept>
+
+namespace netkit::http {
+
+struct ClientPool::Host {
+  HostStats stats;
+  std::string scheme;
+  std::string host;
+  std::uint16_t port = 0;
+  // Most recently released at the back
+  std::deque<std::unique_ptr<Entry>> idle;
+  std::deque<Waiter> waiters;
+  std::shared_ptr<RetryState> retry;
+};
+
+struct ClientPool::Entry {
+  Host* host = nullptr;
+  std::variant<std::unique_ptr<PlainClient>, std::unique_ptr<SslClient>>
+      client;
+  std::chrono::steady_clock::time_point idle_since;
+
+  bool connected() const noexcept {
+    return std::visit([](const auto& client) { return client->connected(); },
+                      client);
+  }
+};
+
+ClientPool::Connection::Connection() noexcept {}
+
+ClientPool::Connection::Connection(ClientPool* pool,
+                                   std::unique_ptr<Entry>&& entry) noexcept
+    : pool_(pool), entry_(std::move(entry)) {}
+
+ClientPool::Connection::Connection(Connection&& other) noexcept
+    : pool_(other.pool_), entry_(std::move(other.entry_)) {}
+
+ClientPool::Connection& ClientPool::Connection::operator=(
+    Connection&& other) noexcept {
+  if (this != &other) {
+    Release();
+    pool_ = other.pool_;
+    entry_ = std::move(other.entry_);
+  }
+  return *this;
+}
+
+ClientPool::Connection::~Connection() noexcept { Release(); }
+
+boost::asio::any_io_executor ClientPool::Connection::get_executor() noexcept {
+  return std::visit([](auto& client) { return client->get_executor(); },
+                    entry_->client);
+}
+
+void ClientPool::Connection::Release() noexcept {
+  if (entry_) {
+    pool_->Release(std::move(entry_));
+  }
+}
+
+std::variant<std::unique_ptr<PlainClient>, std::unique_ptr<SslClient>>&
+ClientPool::Connection::client() noexcept {
+  return entry_->client;
+}
+
+ClientPool::ClientPool(IoContextPool& pool) noexcept : pool_(pool) {}
+
+ClientPool::ClientPool(IoContextPool& pool,
+                       boost::asio::ssl::context& ssl_ctx) noexcept
+    : pool_(pool), ssl_ctx_(&ssl_ctx) {}
+
+ClientPool::~ClientPool() noexcept { CloseIdle(); }
+
+ClientPool::Connection ClientPool::Acquire(const std::string& scheme,
+                                           const std::string& host,
+                                           std::uint16_t port) {
+  std::promise<Connection> promise;
+  auto future = promise.get_future();
+  DoAcquire(scheme, host, port, [&promise](Connection&& conn) {
+    promise.set_value(std::move(conn));
+  });
+  return future.get();
+}
+
+std::vector<HostStats> ClientPool::stats() const {
+  std::vector<HostStats> result;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& pair : hosts_) {
+    result.emplace_back(pair.second->stats);
+    result.back().idle = pair.second->idle.size();
+    result.back().waiting = pair.second->waiters.size();
+    result.back().retries = pair.second->retry->retries;
+    result.back().hedges = pair.second->retry->hedges;
+    result.back().throttled = pair.second->retry->throttled;
+  }
+  return result;
+}
+
+void ClientPool::CloseIdle() noexcept {
+  std::vector<std::unique_ptr<Entry>> closed;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& pair : hosts_) {
+    for (auto& entry : pair.second->idle) {
+      closed.emplace_back(std::move(entry));
+    }
+    pair.second->idle.clear();
+  }
+}
+
+void ClientPool::DoAcquire(const std::string& scheme, const std::string& host,
+                           std::uint16_t port, Waiter&& waiter) {
+  CheckScheme(scheme);
+  // Closed once unlocked, the sockets may take a while
+  std::vector<std::unique_ptr<Entry>> expired;
+  std::unique_ptr<Entry> entry;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_sweep_ >= idle_timeout_) {
+      for (auto& pair : hosts_) {
+        Expire(*pair.second, now, expired);
+      }
+      last_sweep_ = now;
+    }
+    auto& item = FindHost(scheme, host, port);
+    Expire(item, now, expired);
+    if (!item.idle.empty()) {
+      entry = std::move(item.idle.back());
+      item.idle.pop_back();
+      ++item.stats.reused;
+    } else if (item.stats.active < max_per_host_) {
+      entry = Create(item);
+    } else {
+      item.waiters.emplace_back(std::move(waiter));
+      ++item.stats.waited;
+      return;
+    }
+    ++item.stats.active;
+  }
+  waiter(Connection(this, std::move(entry)));
+}
+
+void ClientPool::Release(std::unique_ptr<Entry>&& entry) noexcept {
+  std::unique_ptr<Entry> closed;
+  Waiter waiter;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& host = *entry->host;
+    --host.stats.active;
+    if (!entry->connected()) {
+      // Failed or closed by the server
+      closed = std::move(entry);
+    }
+    if (host.waiters.empty()) {
+      if (entry) {
+        entry->idle_since = std::chrono::steady_clock::now();
+        host.idle.emplace_back(std::move(entry));
+      }
+    } else {
+      waiter = std::move(host.waiters.front());
+      host.waiters.pop_front();
+      if (entry) {
+        ++host.stats.reused;
+      } else {
+        try {
+          entry = Create(host);
+        } catch (const std::exception&) {
+          // Out of memory, the waiter gets the next release
+          host.waiters.emplace_front(std::move(waiter));
+          return;
+        }
+      }
+      ++host.stats.active;
+    }
+  }
+  if (waiter) {
+    waiter(Connection(this, std::move(entry)));
+  }
+}
+
+std::shared_ptr<ClientPool::RetryState> ClientPool::GetRetryState(
+    const std::string& scheme, const std::string& host, std::uint16_t port) {
+  CheckScheme(scheme);
+  std::lock_guard<std::mutex> lock(mutex_);
+  return FindHost(scheme, host, port).retry;
+}
+
+void ClientPool::CheckScheme(const std::string& scheme) const {
+  if (scheme != "http" && scheme != "https") {
+    throw std::runtime_error("Unsupported scheme: " + scheme);
+  }
+  if (scheme == "https" && !ssl_ctx_) {
+    throw std::runtime_error("https requires an ssl context");
+  }
+}
+
+ClientPool::Host& ClientPool::FindHost(const std::string& scheme,
+                                       const std::string& host,
+                                       std::uint16_t port) {
+  auto key = scheme + "://" + host + ":" + std::to_string(port);
+  auto& item = hosts_[key];
+  if (!item) {
+    item = std::make_unique<Host>();
+    item->stats.host = key;
+    item->scheme = scheme;
+    item->host = host;
+    item->port = port;
+    item->retry = std::make_shared<RetryState>(retry_policy_);
+  }
+  return *item;
+}
+
+std::unique_ptr<ClientPool::Entry> ClientPool::Create(Host& host) {
+  auto entry = std::make_unique<Entry>();
+  entry->host = &host;
+  if (host.scheme == "https") {
+    entry->client = std::make_unique<SslClient>(pool_, *ssl_ctx_, host.host,
+                                                host.port);
+  } else {
+    entry->client = std::make_unique<PlainClient>(pool_, host.host, host.port);
+  }
+  std::visit(
+      [this](auto& client) {
+        client->set_dns_cache(dns_cache_);
+        client->set_timeouts(timeouts_);
+      },
+      entry->client);
+  ++host.stats.created;
+  return entry;
+}
+
+void ClientPool::Expire(Host& host, std::chrono::steady_clock::time_point now,
+                        std::vector<std::unique_ptr<Entry>>& expired) noexcept {
+  // Oldest at the front
+  while (!host.idle.empty() &&
+         now - host.idle.front()->idle_since >= idle_timeout_) {
+    expired.emplace_back(std::move(host.idle.front()));
+    host.idle.pop_front();
+    ++host.stats.expired;
+  }
+}
+
+}  // namespace netkit::http
@@ -0,0 +1,541 @@
+#pragma once
+#include <netkit/http/client.h>
+#include <netkit/http/retry_policy.h>
+#include <netkit/io_context_pool.h>
+
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/coroutine.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace netkit::http {
+
+// Counters of one scheme://host:port
+struct HostStats {
+  std::string host;
+  // Connections handed out, idle ones and requests waiting for one
+  std::size_t active = 0;
+  std::size_t idle = 0;
+  std::size_t waiting = 0;
+  // Connections opened, requests served by an idle one, idle ones closed
+  // by the timeout and requests which had to wait
+  std::uint64_t created = 0;
+  std::uint64_t reused = 0;
+  std::uint64_t expired = 0;
+  std::uint64_t waited = 0;
+  // Attempts sent after a failure or as a hedge, and those the retry budget
+  // refused, see RetryPolicy
+  std::uint64_t retries = 0;
+  std::uint64_t hedges = 0;
+  std::uint64_t throttled = 0;
+};
+
+// Keep-alive connections shared by every thread, keyed by scheme ("http" or
+// "https"), host and port. The most recently used idle connection is reused
+// first so that the others expire, and each host gets at most
+// max_per_host() connections, further requests wait for one to be released.
+class ClientPool {
+  using Self = ClientPool;
+  struct Host;
+  struct Entry;
+
+ public:
+  // Leased client, back to the pool when destroyed. Requests on it behave
+  // as on a PlainClient or SslClient.
+  class Connection {
+   public:
+    Connection() noexcept;
+
+    Connection(Connection&& other) noexcept;
+
+    Connection& operator=(Connection&& other) noexcept;
+
+    ~Connection() noexcept;
+
+    explicit operator bool() const noexcept { return entry_ != nullptr; }
+
+    template <class ReqBody, class RespBody>
+    void SendRequest(boost::beast::http::request<ReqBody>& req,
+                     boost::beast::http::response<RespBody>& resp) {
+      std::visit([&](auto& client) { client->SendRequest(req, resp); },
+                 client());
+    }
+
+    template <class ReqBody, class RespBody, class CompletionToken>
+    auto AsyncSendRequest(boost::beast::http::request<ReqBody>& req,
+                          boost::beast::http::response<RespBody>& resp,
+                          CompletionToken&& token) {
+      return std::visit(
+          [&](auto& client) {
+            return client->AsyncSendRequest(
+                req, resp, std::forward<CompletionToken>(token));
+          },
+          client());
+    }
+
+    // See BasicClient::Cancel()
+    void Cancel() noexcept {
+      std::visit([](auto& client) { client->Cancel(); }, client());
+    }
+
+    boost::asio::any_io_executor get_executor() noexcept;
+
+    // Back to the pool before the end of the scope
+    void Release() noexcept;
+
+   private:
+    friend class ClientPool;
+    Connection(ClientPool* pool, std::unique_ptr<Entry>&& entry) noexcept;
+
+    std::variant<std::unique_ptr<PlainClient>, std::unique_ptr<SslClient>>&
+    client() noexcept;
+
+    ClientPool* pool_ = nullptr;
+    std::unique_ptr<Entry> entry_;
+  };
+
+  // https requires the ssl context, the pool must outlive the connections
+  explicit ClientPool(IoContextPool& pool) noexcept;
+
+  ClientPool(IoContextPool& pool, boost::asio::ssl::context& ssl_ctx) noexcept;
+
+  ~ClientPool() noexcept;
+
+  ClientPool(const ClientPool&) = delete;
+  ClientPool& operator=(const ClientPool&) = delete;
+
+  std::size_t max_per_host() const noexcept { return max_per_host_; }
+
+  // Active and idle connections of a host
+  Self& set_max_per_host(std::size_t val) noexcept {
+    max_per_host_ = val > 0 ? val : 1;
+    return *this;
+  }
+
+  std::chrono::milliseconds idle_timeout() const noexcept {
+    return idle_timeout_;
+  }
+
+  // Idle connections are closed after it, at the next use of the pool
+  Self& set_idle_timeout(const std::chrono::milliseconds& val) noexcept {
+    idle_timeout_ = val;
+    return *this;
+  }
+
+  // Shared by the connections, it must outlive the pool
+  Self& set_dns_cache(DnsCache* cache) noexcept {
+    dns_cache_ = cache;
+    return *this;
+  }
+
+  const ClientTimeouts& timeouts() const noexcept { return timeouts_; }
+
+  // Of the connections opened afterwards
+  Self& set_timeouts(const ClientTimeouts& timeouts) noexcept {
+    timeouts_ = timeouts;
+    return *this;
+  }
+
+  const RetryPolicy& retry_policy() const noexcept { return retry_policy_; }
+
+  // Used by AsyncSendRequest() without a policy. Its budget settings apply
+  // to the hosts seen afterwards.
+  Self& set_retry_policy(const RetryPolicy& policy) {
+    retry_policy_ = policy;
+    return *this;
+  }
+
+  // Completes with void(boost::system::error_code, Connection) on the
+  // executor of the handler, or else on the context of the connection
+  template <class CompletionToken>
+  auto AsyncAcquire(const std::string& scheme, const std::string& host,
+                    std::uint16_t port, CompletionToken&& token) {
+    return boost::asio::async_initiate<
+        CompletionToken, void(boost::system::error_code, Connection)>(
+        [this](auto handler, const std::string& scheme,
+               const std::string& host, std::uint16_t port) {
+          auto shared =
+              std::make_shared<decltype(handler)>(std::move(handler));
+          DoAcquire(scheme, host, port, [shared](Connection&& conn) {
+            auto ex = boost::asio::get_associated_executor(
+                *shared, conn.get_executor());
+            boost::asio::post(
+                ex, [shared, conn = std::move(conn)]() mutable {
+                  (*shared)(boost::system::error_code(), std::move(conn));
+                });
+          });
+        },
+        // Copies, the strings may belong to the handler moved from token
+        token, std::string(scheme), std::string(host), port);
+  }
+
+  // Blocks while the host is at its limit, the threads of the pool should
+  // prefer AsyncAcquire() not to wait for a release they would run
+  Connection Acquire(const std::string& scheme, const std::string& host,
+                     std::uint16_t port);
+
+  template <class ReqBody, class RespBody>
+  void SendRequest(const std::string& scheme, const std::string& host,
+                   std::uint16_t port,
+                   boost::beast::http::request<ReqBody>& req,
+                   boost::beast::http::response<RespBody>& resp) {
+    Acquire(scheme, host, port).SendRequest(req, resp);
+  }
+
+  // AsyncAcquire() then Connection::AsyncSendRequest(), the connection is
+  // released before the completion. Completes with
+  // void(boost::system::error_code).
+  template <class ReqBody, class RespBody, class CompletionToken>
+  auto AsyncSendRequest(const std::string& scheme, const std::string& host,
+                        std::uint16_t port,
+                        boost::beast::http::request<ReqBody>& req,
+                        boost::beast::http::response<RespBody>& resp,
+                        CompletionToken&& token) {
+    return AsyncSendRequest(scheme, host, port, req, resp, retry_policy_,
+                            std::forward<CompletionToken>(token));
+  }
+
+  // With retries, hedging and a deadline as the policy says. The attempts
+  // send copies of req, bodies which can't be copied and streamed ones are
+  // sent once.
+  template <class ReqBody, class RespBody, class CompletionToken>
+  auto AsyncSendRequest(const std::string& scheme, const std::string& host,
+                        std::uint16_t port,
+                        boost::beast::http::request<ReqBody>& req,
+                        boost::beast::http::response<RespBody>& resp,
+                        const RetryPolicy& policy, CompletionToken&& token) {
+    using Request = boost::beast::http::request<ReqBody>;
+    using Response = boost::beast::http::response<RespBody>;
+    if constexpr (std::is_copy_constructible_v<Request> &&
+                  !kIsStreamBody<ReqBody> && !kIsStreamBody<RespBody>) {
+      if (policy.max_attempts() > 1 || policy.deadline().count() > 0) {
+        return boost::asio::async_initiate<CompletionToken,
+                                           void(boost::system::error_code)>(
+            [this](auto handler, const std::string& scheme,
+                   const std::string& host, std::uint16_t port,
+                   const Request& req, Response& resp,
+                   const RetryPolicy& policy) {
+              std::make_shared<
+                  RetryOp<ReqBody, RespBody, decltype(handler)>>(
+                  *this, scheme, host, port, req, resp, policy,
+                  std::move(handler))
+                  ->Start();
+            },
+            token, scheme, host, port, req, resp, policy);
+      }
+    }
+    return boost::asio::async_compose<CompletionToken,
+                                      void(boost::system::error_code)>(
+        SendOp<ReqBody, RespBody>(*this, scheme, host, port, req, resp),
+        token, pool_.Get());
+  }
+
+  // Every host seen so far
+  std::vector<HostStats> stats() const;
+
+  // Closes the idle connections, the active ones are not affected
+  void CloseIdle() noexcept;
+
+ private:
+  using Waiter = std::function<void(Connection&&)>;
+
+  template <class ReqBody, class RespBody>
+  class SendOp : public boost::asio::coroutine {
+   public:
+    SendOp(ClientPool& pool, const std::string& scheme,
+           const std::string& host, std::uint16_t port,
+           boost::beast::http::request<ReqBody>& req,
+           boost::beast::http::response<RespBody>& resp)
+        : pool_(pool),
+          scheme_(scheme),
+          host_(host),
+          port_(port),
+          req_(req),
+          resp_(resp) {}
+
+    template <class Self>
+    void operator()(Self& self, boost::system::error_code ec,
+                    Connection&& conn) {
+      conn_ = std::move(conn);
+      (*this)(self, ec);
+    }
+
+    template <class Self>
+    void operator()(Self& self, boost::system::error_code ec = {}) {
+      BOOST_ASIO_CORO_REENTER(*this) {
+        BOOST_ASIO_CORO_YIELD pool_.AsyncAcquire(scheme_, host_, port_,
+                                                 std::move(self));
+        BOOST_ASIO_CORO_YIELD conn_.AsyncSendRequest(req_, resp_,
+                                                     std::move(self));
+        conn_.Release();
+        self.complete(ec);
+      }
+    }
+
+   private:
+    ClientPool& pool_;
+    std::string scheme_;
+    std::string host_;
+    std::uint16_t port_;
+    boost::beast::http::request<ReqBody>& req_;
+    boost::beast::http::response<RespBody>& resp_;
+    Connection conn_;
+  };
+
+  // Shared by the requests of a host
+  struct RetryState {
+    explicit RetryState(const RetryPolicy& policy) noexcept
+        : budget(policy.budget_tokens(), policy.budget_ratio()) {}
+
+    RetryBudget budget;
+    LatencyTracker latency;
+    std::atomic<std::uint64_t> retries = 0;
+    std::atomic<std::uint64_t> hedges = 0;
+    std::atomic<std::uint64_t> throttled = 0;
+  };
+
+  // The attempts of a request, run on a strand. The first successful
+  // response wins, the other attempts are cancelled.
+  template <class ReqBody, class RespBody, class Handler>
+  class RetryOp : public std::enable_shared_from_this<
+                      RetryOp<ReqBody, RespBody, Handler>> {
+    using Request = boost::beast::http::request<ReqBody>;
+    using Response = boost::beast::http::response<RespBody>;
+
+    struct Attempt {
+      Request req;
+      Response resp;
+      Connection conn;
+      std::chrono::steady_clock::time_point start;
+    };
+
+   public:
+    RetryOp(ClientPool& pool, const std::string& scheme,
+            const std::string& host, std::uint16_t port, const Request& req,
+            Response& resp, const RetryPolicy& policy, Handler&& handler)
+        : pool_(pool),
+          scheme_(scheme),
+          host_(host),
+          port_(port),
+          req_(req),
+          resp_(resp),
+          policy_(policy),
+          handler_(std::move(handler)),
+          strand_(boost::asio::make_strand(pool.pool_.Get())),
+          deadline_timer_(strand_),
+          hedge_timer_(strand_),
+          backoff_timer_(strand_),
+          state_(pool.GetRetryState(scheme, host, port)),
+          idempotent_(RetryPolicy::IsIdempotent(req.method())) {}
+
+    void Start() {
+      boost::asio::post(strand_, [self = this->shared_from_this()]() {
+        if (self->policy_.deadline().count() > 0) {
+          self->deadline_timer_.expires_after(self->policy_.deadline());
+          self->deadline_timer_.async_wait(
+              [self](const boost::system::error_code& ec) {
+                if (!ec && !self->done_) {
+                  self->Finish(nullptr, boost::beast::error::timeout);
+                }
+              });
+        }
+        self->Launch();
+        self->ArmHedge();
+      });
+    }
+
+   private:
+    void Launch() {
+      auto attempt = std::make_shared<Attempt>();
+      attempt->req = req_;
+      attempt->start = std::chrono::steady_clock::now();
+      attempts_.emplace_back(attempt);
+      ++launched_;
+      ++in_flight_;
+      pool_.AsyncAcquire(
+          scheme_, host_, port_,
+          boost::asio::bind_executor(
+              strand_, [self = this->shared_from_this(), attempt](
+                           const boost::system::error_code&, Connection conn) {
+                if (self->done_) {
+                  --self->in_flight_;
+                  return;
+                }
+                attempt->conn = std::move(conn);
+                attempt->conn.AsyncSendRequest(
+                    attempt->req, attempt->resp,
+                    boost::asio::bind_executor(
+                        self->strand_,
+                        [self, attempt](const boost::system::error_code& ec) {
+                          self->OnAttempt(*attempt, ec);
+                        }));
+              }));
+    }
+
+    // One hedge per attempt sent after a failure, once enough latencies of
+    // the host are known
+    void ArmHedge() {
+      if (!idempotent_ || policy_.hedge_percentile() <= 0 ||
+          launched_ >= policy_.max_attempts()) {
+        return;
+      }
+      auto latency = state_->latency.Percentile(policy_.hedge_percentile());
+      if (!latency) {
+        return;
+      }
+      hedge_timer_.expires_after(
+          std::max<std::chrono::steady_clock::duration>(
+              *latency, policy_.hedge_min_delay()));
+      hedge_timer_.async_wait([self = this->shared_from_this()](
+                                  const boost::system::error_code& ec) {
+        if (ec || self->done_ || self->in_flight_ == 0 ||
+            self->launched_ >= self->policy_.max_attempts()) {
+          return;
+        }
+        if (!self->state_->budget.AllowRetry()) {
+          ++self->state_->throttled;
+          return;
+        }
+        ++self->state_->hedges;
+        self->Launch();
+      });
+    }
+
+    void OnAttempt(Attempt& attempt, const boost::system::error_code& ec) {
+      --in_flight_;
+      attempt.conn.Release();
+      if (done_) {
+        return;
+      }
+      if (!ec && !policy_.IsRetryStatus(attempt.resp.result_int())) {
+        state_->latency.Record(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - attempt.start));
+        state_->budget.OnSuccess();
+        return Finish(&attempt, {});
+      }
+      state_->budget.OnFailure();
+      if (!ec) {
+        // Returned if no attempt does better
+        last_ = &attempt;
+      }
+      if (in_flight_ > 0) {
+        // The hedge may still succeed
+        return;
+      }
+      if (CanRetry()) {
+        ++state_->retries;
+        hedge_timer_.cancel();
+        backoff_timer_.expires_after(policy_.Backoff(launched_));
+        backoff_timer_.async_wait([self = this->shared_from_this()](
+                                      const boost::system::error_code& ec) {
+          if (!ec && !self->done_) {
+            self->Launch();
+            self->ArmHedge();
+          }
+        });
+        return;
+      }
+      Finish(last_, last_ ? boost::system::error_code() : ec);
+    }
+
+    bool CanRetry() {
+      if (!idempotent_ || launched_ >= policy_.max_attempts()) {
+        return false;
+      }
+      if (!state_->budget.AllowRetry()) {
+        ++state_->throttled;
+        return false;
+      }
+      return true;
+    }
+
+    void Finish(Attempt* winner, boost::system::error_code ec) {
+      done_ = true;
+      deadline_timer_.cancel();
+      hedge_timer_.cancel();
+      backoff_timer_.cancel();
+      for (auto& attempt : attempts_) {
+        if (attempt.get() != winner && attempt->conn) {
+          attempt->conn.Cancel();
+        }
+      }
+      if (winner) {
+        resp_ = std::move(winner->resp);
+      }
+      auto ex = boost::asio::get_associated_executor(handler_, strand_);
+      boost::asio::post(
+          ex, boost::beast::bind_front_handler(std::move(handler_), ec));
+    }
+
+   private:
+    ClientPool& pool_;
+    std::string scheme_;
+    std::string host_;
+    std::uint16_t port_;
+    Request req_;
+    Response& resp_;
+    RetryPolicy policy_;
+    Handler handler_;
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    boost::asio::steady_timer deadline_timer_;
+    boost::asio::steady_timer hedge_timer_;
+    boost::asio::steady_timer backoff_timer_;
+    std::shared_ptr<RetryState> state_;
+    bool idempotent_;
+    std::vector<std::shared_ptr<Attempt>> attempts_;
+    std::size_t launched_ = 0;
+    std::size_t in_flight_ = 0;
+    Attempt* last_ = nullptr;
+    bool done_ = false;
+  };
+
+  // waiter runs on this thread when a connection is available, or else on
+  // the thread releasing one
+  void DoAcquire(const std::string& scheme, const std::string& host,
+                 std::uint16_t port, Waiter&& waiter);
+
+  void Release(std::unique_ptr<Entry>&& entry) noexcept;
+
+  std::shared_ptr<RetryState> GetRetryState(const std::string& scheme,
+                                            const std::string& host,
+                                            std::uint16_t port);
+
+  void CheckScheme(const std::string& scheme) const;
+
+  // Called locked
+  Host& FindHost(const std::string& scheme, const std::string& host,
+                 std::uint16_t port);
+
+  std::unique_ptr<Entry> Create(Host& host);
+
+  // Moves the idle connections past the timeout to expired, called locked
+  void Expire(Host& host, std::chrono::steady_clock::time_point now,
+              std::vector<std::unique_ptr<Entry>>& expired) noexcept;
+
+ private:
+  IoContextPool& pool_;
+  boost::asio::ssl::context* ssl_ctx_ = nullptr;
+  std::size_t max_per_host_ = 32;
+  std::chrono::milliseconds idle_timeout_{30000};
+  DnsCache* dns_cache_ = nullptr;
+  ClientTimeouts timeouts_;
+  RetryPolicy retry_policy_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::unique_ptr<Host>> hosts_;
+  std::chrono::steady_clock::time_point last_sweep_;
+};
+
+}  // namespace netkit::http
@@ -1,11 +1,17 @@
 #pragma once
 #include <netkit/http/context.h>
+#include <netkit/http/dispatch.h>
 #include <netkit/http/filter.h>
+#include <netkit/http/http2_connection.h>
 #include <netkit/http/router.h>
 #include <netkit/http/settings.h>
+#include <netkit/io_context_pool.h>
+#include <netkit/ssl/ktls.h>
 
+#include <algorithm>
 #include <any>
 #include <boost/beast/ssl.hpp>
+#include <cstring>
 #include <memory>
 
 namespace netkit::http {
@@ -19,8 +25,11 @@ class BasicConnection {
 
  public:
   BasicConnection(boost::beast::flat_buffer&& buffer, Settings& settings,
-                  Router& router) noexcept
-      : buffer_(std::move(buffer)), settings_(settings), router_(router) {}
+                  Router& router, IoContextPool::Lease&& lease) noexcept
+      : buffer_(std::move(buffer)),
+        settings_(settings),
+        router_(router),
+        lease_(std::move(lease)) {}
 
   ~BasicConnection() noexcept {}
 
@@ -29,6 +38,16 @@ class BasicConnection {
 
   void set_user_data(std::any&& data) noexcept { user_data_ = std::move(data); }
 
+  boost::asio::any_io_executor executor() noexcept {
+    return Derived().stream().get_executor();
+  }
+
+  auto native_handle() noexcept {
+    return boost::beast::get_lowest_layer(Derived().stream())
+        .socket()
+        .native_handle();
+  }
+
   template <class T>
   T* try_get_user_data() noexcept {
     if (user_data_.has_value()) {
@@ -41,6 +60,8 @@ class BasicConnection {
   }
 
   void ReadRequest() {
+    settings_.socket_options().BeforeRead(
+        boost::beast::get_lowest_layer(Derived().stream()).socket());
     parser_.emplace();
     parser_->header_limit(settings_.header_limit());
     if (settings_.body_limit()) {
@@ -62,25 +83,17 @@ class BasicConnection {
     if (ec) {
       if (ec == boost::beast::http::error::end_of_stream) {
         Derived().DoEof();
+      } else if (ec == boost::beast::http::error::bad_version &&
+                 settings_.http2() && IsHttp2Preface()) {
+        Derived().ExpiresNever();
+        UpgradeHttp2();
       }
     } else {
       Derived().ExpiresNever();
       auto ctx = std::make_shared<Context>(
           std::static_pointer_cast<Self>(Derived().shared_from_this()),
           parser_->release());
-      for (const auto& filter : settings_.filters()) {
-        if (filter->OnIncomingRequest(ctx) == Filter::Result::kResponded) {
-          return;
-        }
-      }
-      try {
-        auto method = ctx->GetRequest().method_string();
-        auto target = ctx->GetRequest().target();
-        router_.Routing(ctx, method.to_string(),
-                        std::string_view(target.data(), target.size()));
-      } catch (const std::exception& e) {
-        return ctx->BadRequest(e.what(), "text/plain", false);
-      }
+      DispatchRequest(ctx, settings_, router_);
     }
   }
 
@@ -104,6 +117,39 @@ class BasicConnection {
         });
   }
 
+  // The parser rejects the HTTP/2 preface without consuming it
+  bool IsHttp2Preface() const noexcept {
+    auto size = std::min(buffer_.size(), http2::kPreface.size());
+    return std::memcmp(buffer_.data().data(), http2::kPreface.data(),
+                       size) == 0;
+  }
+
+  void UpgradeHttp2() {
+    using Stream = std::decay_t<decltype(Derived().stream())>;
+    std::make_shared<Http2Connection<Stream>>(std::move(Derived().stream()),
+                                              std::move(buffer_), settings_,
+                                              router_, std::move(lease_))
+        ->Run();
+  }
+
+  // Moves the stream and the bytes read past the request into a WebSocket,
+  // the connection is done with once the context is released
+  WebSocket::Ptr UpgradeWebSocket(const Context::Ptr& ctx,
+                                  const WebSocketOptions& options) {
+    using Stream = std::decay_t<decltype(Derived().stream())>;
+    auto ws = std::make_shared<BasicWebSocket<Stream>>(
+        std::move(Derived().stream()), std::move(buffer_), options,
+        std::move(lease_));
+    ws->Accept(ctx->GetRequest(),
+               [ctx, &filters = settings_.filters()](
+                   boost::beast::websocket::response_type& resp) {
+                 for (const auto& filter : filters) {
+                   filter->OnOutgingResponse(ctx, resp);
+                 }
+               });
+    return ws;
+  }
+
   void OnWrite(bool close, const boost::beast::error_code& ec,
                std::size_t bytes_transferred) {
     boost::ignore_unused(bytes_transferred);
@@ -125,23 +171,31 @@ class BasicConnection {
   std::optional<Parser> parser_;
   std::shared_ptr<void> resp_;
   std::any user_data_;
+  // Counts the connection on its io_context, handed over on upgrades
+  IoContextPool::Lease lease_;
 };
 
-class PlainConnection : public BasicConnection<PlainConnection>,
-                        public std::enable_shared_from_this<PlainConnection> {
+// Cleartext HTTP over TCP (PlainConnection) or over a Unix domain socket
+// (LocalConnection)
+template <class Stream>
+class BasicPlainConnection
+    : public BasicConnection<BasicPlainConnection<Stream>>,
+      public std::enable_shared_from_this<BasicPlainConnection<Stream>> {
+  using Base = BasicConnection<BasicPlainConnection<Stream>>;
+
  public:
-  PlainConnection(boost::beast::tcp_stream&& stream,
-                  boost::asio::ssl::context& ssl_ctx,
-                  boost::beast::flat_buffer&& buffer, Settings& settings,
-                  Router& router) noexcept
-      : BasicConnection(std::move(buffer), settings, router),
+  BasicPlainConnection(Stream&& stream, boost::asio::ssl::context& ssl_ctx,
+                       boost::beast::flat_buffer&& buffer, Settings& settings,
+                       Router& router,
+                       IoContextPool::Lease&& lease = {}) noexcept
+      : Base(std::move(buffer), settings, router, std::move(lease)),
         stream_(std::move(stream)) {}
 
-  ~PlainConnection() noexcept {}
+  ~BasicPlainConnection() noexcept {}
 
-  void Run() { ReadRequest(); }
+  void Run() { this->ReadRequest(); }
 
-  boost::beast::tcp_stream& stream() noexcept { return stream_; }
+  Stream& stream() noexcept { return stream_; }
 
   void ExpiresAfter(const std::chrono::milliseconds& time) {
     stream_.expires_after(time);
@@ -151,11 +205,11 @@ class PlainConnection : public BasicConnection<PlainConnection>,
 
   void DoEof() {
     boost::beast::error_code ec;
-    stream_.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    stream_.socket().shutdown(boost::asio::socket_base::shutdown_both, ec);
   }
 
  private:
-  boost::beast::tcp_stream stream_;
+  Stream stream_;
 };
 
 class SslConnection : public BasicConnection<SslConnection>,
@@ -166,25 +220,32 @@ class SslConnection : public BasicConnection<SslConnection>,
   SslConnection(boost::beast::tcp_stream&& stream,
                 boost::asio::ssl::context& ssl_ctx,
                 boost::beast::flat_buffer&& buffer, Settings& settings,
-                Router& router) noexcept
-      : BasicConnection(std::move(buffer), settings, router),
-        stream_(std::move(stream), ssl_ctx) {}
+                Router& router, IoContextPool::Lease&& lease = {}) noexcept
+      : BasicConnection(std::move(buffer), settings, router, std::move(lease)),
+        stream_(std::move(stream), ssl_ctx, settings.ktls()) {}
 
   ~SslConnection() noexcept {}
 
   void Run() {
-    stream_.async_handshake(
-        boost::asio::ssl::stream_base::server, buffer_.data(),
-        [this, self = shared_from_this()](const boost::beast::error_code& ec,
-                                          std::size_t bytes_used) {
-          if (!ec) {
-            buffer_.consume(bytes_used);
-            ReadRequest();
-          }
+    auto started = settings_.handshake_stats().Begin(
+        settings_.handshake_limit(), settings_.handshake_queue_limit(),
+        [self = shared_from_this(), start = std::chrono::steady_clock::now()](
+            ssl::HandshakeStats::Slot&& slot) {
+          self->handshake_slot_ = std::move(slot);
+          // Started from the thread ending another handshake when queued
+          auto ex = self->settings_.handshake_pool()
+                        ? self->settings_.handshake_pool()->Get().get_executor()
+                        : self->stream_.get_executor();
+          boost::asio::post(
+              ex, [self, ex, start]() { self->DoHandshake(ex, start); });
         });
+    if (!started) {
+      boost::beast::error_code ec;
+      stream_.next_layer().socket().close(ec);
+    }
   }
 
-  boost::beast::ssl_stream<boost::beast::tcp_stream>& stream() noexcept {
+  ssl::KtlsStream<boost::beast::tcp_stream>& stream() noexcept {
     return stream_;
   }
 
@@ -195,11 +256,55 @@ class SslConnection : public BasicConnection<SslConnection>,
   void ExpiresNever() { stream_.next_layer().expires_never(); }
 
   void DoEof() {
-    stream_.async_shutdown([](const boost::beast::error_code& ec) {});
+    if (stream_.offloaded()) {
+      auto& socket = stream_.next_layer().socket();
+      ssl::SendKtlsCloseNotify(socket.native_handle());
+      boost::beast::error_code ec;
+      socket.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+    } else {
+      stream_.ssl_stream().async_shutdown(
+          [](const boost::beast::error_code& ec) {});
+    }
+  }
+
+ private:
+  // The completion handler and the intermediate ones, where OpenSSL does its
+  // work, run on the given executor
+  void DoHandshake(const boost::asio::any_io_executor& ex,
+                   const std::chrono::steady_clock::time_point& start) {
+    stream_.ssl_stream().async_handshake(
+        boost::asio::ssl::stream_base::server, buffer_.data(),
+        boost::asio::bind_executor(
+            ex, [this, self = shared_from_this(), start](
+                    const boost::beast::error_code& ec,
+                    std::size_t bytes_used) {
+              handshake_slot_.Release();
+              auto& stats = settings_.handshake_stats();
+              if (ec) {
+                stats.AddFailure();
+                return;
+              }
+              stats.AddHandshake(
+                  SSL_session_reused(stream_.native_handle()) == 1,
+                  std::chrono::steady_clock::now() - start);
+              if (settings_.ktls() && stream_.Offload()) {
+                stats.AddOffload();
+              }
+              buffer_.consume(bytes_used);
+              boost::asio::dispatch(stream_.get_executor(), [this, self]() {
+                if (settings_.http2() &&
+                    http2::IsNegotiated(stream_.native_handle())) {
+                  return UpgradeHttp2();
+                }
+                ReadRequest();
+              });
+            }));
   }
 
  private:
-  boost::beast::ssl_stream<boost::beast::tcp_stream> stream_;
+  ssl::KtlsStream<boost::beast::tcp_stream> stream_;
+  // Also released if the connection goes away before the handshake ends
+  ssl::HandshakeStats::Slot handshake_slot_;
 };
 
 class DetectConnection : public std::enable_shared_from_this<DetectConnection> {
@@ -209,11 +314,12 @@ class DetectConnection : public std::enable_shared_from_this<DetectConnection> {
   DetectConnection(boost::beast::tcp_stream&& stream,
                    boost::asio::ssl::context& ssl_ctx,
                    boost::beast::flat_buffer&& buffer, Settings& settings,
-                   Router& router) noexcept
+                   Router& router, IoContextPool::Lease&& lease = {}) noexcept
       : stream_(std::move(stream)),
         ssl_ctx_(ssl_ctx),
         settings_(settings),
-        router_(router) {}
+        router_(router),
+        lease_(std::move(lease)) {}
 
   ~DetectConnection() noexcept {}
 
@@ -226,12 +332,12 @@ class DetectConnection : public std::enable_shared_from_this<DetectConnection> {
             if (is_ssl) {
               std::make_shared<SslConnection>(std::move(stream_), ssl_ctx_,
                                               std::move(buffer_), settings_,
-                                              router_)
+                                              router_, std::move(lease_))
                   ->Run();
             } else {
               std::make_shared<PlainConnection>(std::move(stream_), ssl_ctx_,
                                                 std::move(buffer_), settings_,
-                                                router_)
+                                                router_, std::move(lease_))
                   ->Run();
             }
           }
@@ -244,6 +350,7 @@ class DetectConnection : public std::enable_shared_from_this<DetectConnection> {
   boost::asio::ssl::context& ssl_ctx_;
   Settings& settings_;
   Router& router_;
+  IoContextPool::Lease lease_;
 };
 
 }  // namespace netkit::http
@@ -10,6 +10,32 @@ void Context::set_user_data(std::any&& data) noexcept {
       conn_);
 }
 
+boost::asio::any_io_executor Context::executor() const noexcept {
+  return std::visit([](const auto& conn) { return conn->executor(); }, conn_);
+}
+
+std::optional<local::PeerCredentials> Context::peer_credentials()
+    const noexcept {
+  return std::visit(
+      [](const auto& conn) {
+        return local::GetPeerCredentials(conn->native_handle());
+      },
+      conn_);
+}
+
+WebSocket::Ptr Context::UpgradeWebSocket(const WebSocketOptions& options) {
+  // HTTP/2 streams can't be upgraded, their connection answers them
+  if (req_.version() != 20 && !boost::beast::websocket::is_upgrade(req_)) {
+    UpgradeRequired({{"Upgrade", "websocket"}});
+    return nullptr;
+  }
+  return std::visit(
+      [this, &options](const auto& conn) {
+        return conn->UpgradeWebSocket(shared_from_this(), options);
+      },
+      conn_);
+}
+
 void Context::Response(boost::beast::http::status status,
                        const HeaderList& headers) {
   Response(status, req_.keep_alive(), headers);
@@ -1,5 +1,7 @@
 #pragma once
 #include <netkit/http/settings.h>
+#include <netkit/http/websocket.h>
+#include <netkit/local/socket.h>
 
 #include <any>
 #include <boost/beast.hpp>
@@ -7,14 +9,32 @@
 #include <variant>
 #include <vector>
 
+namespace netkit::ssl {
+
+template <class NextLayer>
+class KtlsStream;
+
+}  // namespace netkit::ssl
+
 namespace netkit::http {
 
-class PlainConnection;
+template <class Stream>
+class BasicPlainConnection;
+
+using PlainConnection = BasicPlainConnection<boost::beast::tcp_stream>;
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+using LocalConnection = BasicPlainConnection<local::Stream>;
+#endif
+
 class SslConnection;
 
 template <class T>
 class BasicConnection;
 
+template <class Stream>
+class Http2Connection;
+
 using BodyType = boost::beast::http::string_body;
 
 using Request = boost::beast::http::request<BodyType>;
@@ -32,6 +52,11 @@ class Context : public std::enable_shared_from_this<Context> {
           Request&& req) noexcept
       : conn_(conn), req_(std::move(req)) {}
 
+  template <class T>
+  Context(const std::shared_ptr<Http2Connection<T>>& conn, Request&& req,
+          std::uint32_t stream_id) noexcept
+      : conn_(conn), req_(std::move(req)), stream_id_(stream_id) {}
+
   ~Context() noexcept {}
 
   void set_user_data(std::any&& data) noexcept;
@@ -45,6 +70,16 @@ class Context : public std::enable_shared_from_this<Context> {
 
   const Request& GetRequest() const noexcept { return req_; }
 
+  // HTTP/2 stream of the request, 0 for HTTP/1.x
+  std::uint32_t stream_id() const noexcept { return stream_id_; }
+
+  // Executor of the connection, responses must be sent from it. See
+  // TaskGroup to resume there after work on other threads.
+  boost::asio::any_io_executor executor() const noexcept;
+
+  // Process of the client on a Unix domain socket, nullopt for TCP
+  std::optional<local::PeerCredentials> peer_credentials() const noexcept;
+
   template <class Body>
   void Response(boost::beast::http::response<Body>&& resp) {
     std::visit(
@@ -57,6 +92,11 @@ class Context : public std::enable_shared_from_this<Context> {
   void Response(boost::beast::http::status status,
                 const HeaderList& headers = {});
 
+  // Accepts a WebSocket upgrade of the connection, the request must be a
+  // valid upgrade or 426 is answered and nullptr returned. The connection
+  // reads no further requests.
+  WebSocket::Ptr UpgradeWebSocket(const WebSocketOptions& options = {});
+
   void Response(boost::beast::http::status status, bool keep_alive,
                 const HeaderList& headers = {});
 
@@ -214,10 +254,21 @@ class Context : public std::enable_shared_from_this<Context> {
  private:
   friend class CorsFilter;
   std::string origin_;
-  std::variant<std::shared_ptr<BasicConnection<PlainConnection>>,
-               std::shared_ptr<BasicConnection<SslConnection>>>
+  std::variant<
+      std::shared_ptr<BasicConnection<PlainConnection>>,
+      std::shared_ptr<BasicConnection<SslConnection>>,
+      std::shared_ptr<Http2Connection<boost::beast::tcp_stream>>,
+      std::shared_ptr<
+          Http2Connection<ssl::KtlsStream<boost::beast::tcp_stream>>>
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+      ,
+      std::shared_ptr<BasicConnection<LocalConnection>>,
+      std::shared_ptr<Http2Connection<local::Stream>>
+#endif
+      >
       conn_;
   Request req_;
+  std::uint32_t stream_id_ = 0;
 };
 
 }  // namespace netkit::http
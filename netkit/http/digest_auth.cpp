@@ -1,5 +1,6 @@
 #include "digest_auth.h"
 
+#include <random>
 #include <sstream>
 
 #include "netkit/utility.h"
@@ -321,4 +322,102 @@ std::string WwwAuthenticateDigest::MakeResponse(
                        ":auth-int:" + ha2);
 }
 
+namespace {
+
+std::string MakeCnonce() {
+  thread_local std::mt19937_64 engine(std::random_device{}());
+  char cnonce[17] = {0};
+  snprintf(cnonce, sizeof(cnonce), "%016llx",
+           static_cast<unsigned long long>(engine()));
+  return cnonce;
+}
+
+}  // namespace
+
+std::optional<std::string> DigestCredentials::Authorize(
+    const std::string& method, const std::string& uri,
+    std::optional<std::string_view> body) {
+  if (!challenge_) {
+    return std::nullopt;
+  }
+  std::string ha2;
+  if (qop_ == "auth-int") {
+    if (!body) {
+      return std::nullopt;
+    }
+    ha2 = util::MakeMd5(method + ":" + uri + ":" + util::MakeMd5(*body));
+  } else {
+    ha2 = util::MakeMd5(method + ":" + uri);
+  }
+  AuthorizationDigest auth;
+  auth.username = username_;
+  auth.realm = challenge_->realm;
+  auth.nonce = challenge_->nonce;
+  auth.uri = uri;
+  auth.algorithm = challenge_->algorithm;
+  auth.opaque = challenge_->opaque;
+  if (qop_.empty()) {
+    auth.response = util::MakeMd5(nonce_ha1_ + ":" + auth.nonce + ":" + ha2);
+  } else {
+    auth.nc = ++nc_;
+    auth.cnonce = cnonce_;
+    auth.qop = qop_;
+    char nc_hex[10] = {0};
+    snprintf(nc_hex, sizeof(nc_hex), "%08x", auth.nc);
+    auth.response = util::MakeMd5(nonce_ha1_ + ":" + auth.nonce + ":" +
+                                  nc_hex + ":" + cnonce_ + ":" + qop_ + ":" +
+                                  ha2);
+  }
+  return auth.ToString();
+}
+
+bool DigestCredentials::OnChallenge(std::string_view www_authenticate) {
+  WwwAuthenticateDigest challenge;
+  if (!challenge.ParseFromString(www_authenticate)) {
+    return false;
+  }
+  auto algorithm = challenge.algorithm;
+  util::ToUpper(algorithm);
+  if (algorithm != "MD5" && algorithm != "MD5-SESS") {
+    return false;
+  }
+  std::string qop;
+  for (auto value : challenge.qop_set) {
+    util::TrimAllSpace(value);
+    if (value == "auth") {
+      qop = value;
+      break;
+    }
+    if (value == "auth-int") {
+      qop = value;
+    }
+  }
+  // MD5-sess needs the cnonce of a qop
+  if ((!challenge.qop_set.empty() || algorithm == "MD5-SESS") &&
+      qop.empty()) {
+    return false;
+  }
+  // Same nonce, not stale: the credentials were wrong
+  bool retry = !challenge_ || challenge.stale ||
+               challenge.nonce != challenge_->nonce;
+  if (!retry) {
+    return false;
+  }
+  if (challenge.realm != ha1_realm_ || ha1_.empty()) {
+    ha1_ = util::MakeMd5(username_ + ":" + challenge.realm + ":" + password_);
+    ha1_realm_ = challenge.realm;
+  }
+  cnonce_ = MakeCnonce();
+  nc_ = 0;
+  if (algorithm == "MD5-SESS") {
+    nonce_ha1_ =
+        util::MakeMd5(ha1_ + ":" + challenge.nonce + ":" + cnonce_);
+  } else {
+    nonce_ha1_ = ha1_;
+  }
+  qop_ = std::move(qop);
+  challenge_ = std::move(challenge);
+  return true;
+}
+
 }  // namespace netkit::http
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -86,4 +87,45 @@ class WwwAuthenticateDigest {
                            const std::string& cnonce) const noexcept;
 };
 
+// Client side of digest authentication. Keeps the last challenge of the
+// server, so requests are authorized up front with the next nc instead of
+// after a 401 each. HA1 is computed once per realm (per nonce for
+// MD5-sess).
+class DigestCredentials {
+ public:
+  DigestCredentials(const std::string& username,
+                    const std::string& password) noexcept
+      : username_(username), password_(password) {}
+
+  // Authorization header of a request, none before the first challenge or
+  // when the challenge asks for auth-int and the body is unknown
+  std::optional<std::string> Authorize(
+      const std::string& method, const std::string& uri,
+      std::optional<std::string_view> body = std::nullopt);
+
+  // Takes a WWW-Authenticate digest challenge of a 401. True when a request
+  // is worth sending again: a first or stale nonce, or a new one. False when
+  // it can't be answered, or rejects the credentials sent with its nonce.
+  bool OnChallenge(std::string_view www_authenticate);
+
+  // Forgets the challenge, the next request waits for a new one
+  void Reset() noexcept { challenge_.reset(); }
+
+  bool challenged() const noexcept { return challenge_.has_value(); }
+
+ private:
+  std::string username_;
+  std::string password_;
+  std::optional<WwwAuthenticateDigest> challenge_;
+  // auth, auth-int, or empty without qop (RFC 2069)
+  std::string qop_;
+  // MD5(username:realm:password) of ha1_realm_
+  std::string ha1_;
+  std::string ha1_realm_;
+  // HA1 of the nonce, MD5(ha1_:nonce:cnonce_) for MD5-sess
+  std::string nonce_ha1_;
+  std::string cnonce_;
+  std::uint32_t nc_ = 0;
+};
+
 }  // namespace netkit::http
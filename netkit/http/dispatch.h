@@ -0,0 +1,35 @@
+#pragma once
+#include <netkit/http/context.h>
+#include <netkit/http/filter.h>
+#include <netkit/http/router.h>
+#include <netkit/http/settings.h>
+#include <netkit/io_context_pool.h>
+
+#include <string>
+
+namespace netkit::http {
+
+// Runs the incoming filters, then the route of the request
+inline void DispatchRequest(const Context::Ptr& ctx, const Settings& settings,
+                            Router& router) {
+  for (const auto& filter : settings.filters()) {
+    if (filter->OnIncomingRequest(ctx) == Filter::Result::kResponded) {
+      return;
+    }
+  }
+  try {
+    auto method = ctx->GetRequest().method_string();
+    auto target = ctx->GetRequest().target();
+    IoContextPool::RouteScope scope(
+        boost::beast::http::to_string(ctx->GetRequest().method()).data());
+    router.Routing(ctx, method.to_string(),
+                   std::string_view(target.data(), target.size()),
+                   [&scope](const std::string& pattern) {
+                     scope.set_pattern(&pattern);
+                   });
+  } catch (const std::exception& e) {
+    return ctx->BadRequest(e.what(), "text/plain", false);
+  }
+}
+
+}  // namespace netkit::http
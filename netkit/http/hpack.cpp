@@ -0,0 +1,484 @@
+#include "hpack.h"
+
+#include <array>
+#include <limits>
+
+namespace netkit::http {
+
+namespace {
+
+struct HuffmanSymbol {
+  std::uint32_t code;
+  std::uint8_t bits;
+};
+
+constexpr HuffmanSymbol kHuffmanCodes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+    {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6},
+    {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7},
+    {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7},
+    {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8},
+    {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6},
+    {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6},
+    {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5},
+    {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22},
+    {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22},
+    {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24},
+    {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24},
+    {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22},
+    {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22},
+    {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23},
+    {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21},
+    {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23},
+    {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20},
+    {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26},
+    {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22},
+    {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27},
+    {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19},
+    {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27},
+    {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21},
+    {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22},
+    {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24},
+    {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26},
+    {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27},
+    {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27},
+    {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+constexpr std::uint32_t kHuffmanEos = 256;
+constexpr std::size_t kHuffmanMaxBits = 30;
+
+// The code is canonical, codes of the same length are consecutive numbers
+// in symbol order, so a code is identified by its length and its offset from
+// the first code of that length
+struct HuffmanDecodeTable {
+  std::array<std::uint32_t, kHuffmanMaxBits + 1> first_code = {};
+  std::array<std::uint16_t, kHuffmanMaxBits + 1> first_index = {};
+  std::array<std::uint16_t, kHuffmanMaxBits + 1> count = {};
+  std::array<std::uint16_t, 257> symbols = {};
+
+  HuffmanDecodeTable() noexcept {
+    std::uint16_t index = 0;
+    for (std::size_t bits = 1; bits <= kHuffmanMaxBits; ++bits) {
+      first_index[bits] = index;
+      for (std::uint16_t sym = 0; sym < 257; ++sym) {
+        if (kHuffmanCodes[sym].bits == bits) {
+          if (count[bits] == 0) {
+            first_code[bits] = kHuffmanCodes[sym].code;
+          }
+          ++count[bits];
+          symbols[index++] = sym;
+        }
+      }
+    }
+  }
+};
+
+const HuffmanDecodeTable& GetHuffmanDecodeTable() noexcept {
+  static const HuffmanDecodeTable table;
+  return table;
+}
+
+constexpr std::pair<std::string_view, std::string_view>
+    kStaticTable[HpackTable::kStaticSize] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+constexpr std::size_t kEntryOverhead = 32;
+
+void EncodeInteger(std::uint64_t value, std::uint8_t prefix_bits,
+                   std::uint8_t flags, std::string& out) {
+  std::uint64_t max_prefix = (1u << prefix_bits) - 1;
+  if (value < max_prefix) {
+    out.push_back(static_cast<char>(flags | value));
+    return;
+  }
+  out.push_back(static_cast<char>(flags | max_prefix));
+  value -= max_prefix;
+  while (value >= 128) {
+    out.push_back(static_cast<char>(0x80 | (value & 0x7f)));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+bool DecodeInteger(const std::uint8_t*& p, const std::uint8_t* end,
+                   std::uint8_t prefix_bits, std::uint64_t& value) noexcept {
+  if (p == end) {
+    return false;
+  }
+  std::uint64_t max_prefix = (1u << prefix_bits) - 1;
+  value = *p++ & max_prefix;
+  if (value < max_prefix) {
+    return true;
+  }
+  for (std::uint32_t shift = 0; p != end; shift += 7) {
+    if (shift > 28) {
+      return false;
+    }
+    auto byte = *p++;
+    value += static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value <= std::numeric_limits<std::uint32_t>::max();
+    }
+  }
+  return false;
+}
+
+void EncodeString(std::string_view str, std::string& out) {
+  auto huffman_size = HuffmanEncodedSize(str);
+  if (huffman_size < str.size()) {
+    EncodeInteger(huffman_size, 7, 0x80, out);
+    HuffmanEncode(str, out);
+  } else {
+    EncodeInteger(str.size(), 7, 0, out);
+    out.append(str);
+  }
+}
+
+bool DecodeString(const std::uint8_t*& p, const std::uint8_t* end,
+                  std::string& out) {
+  if (p == end) {
+    return false;
+  }
+  bool huffman = (*p & 0x80) != 0;
+  std::uint64_t size = 0;
+  if (!DecodeInteger(p, end, 7, size) ||
+      size > static_cast<std::size_t>(end - p)) {
+    return false;
+  }
+  out.clear();
+  if (huffman) {
+    if (!HuffmanDecode(p, size, out)) {
+      return false;
+    }
+  } else {
+    out.assign(reinterpret_cast<const char*>(p), size);
+  }
+  p += size;
+  return true;
+}
+
+}  // namespace
+
+void HpackTable::set_max_size(std::size_t val) noexcept {
+  max_size_ = val;
+  Evict(max_size_);
+}
+
+bool HpackTable::Get(std::size_t index, std::string_view& name,
+                     std::string_view& value) const noexcept {
+  if (index == 0) {
+    return false;
+  }
+  if (index <= kStaticSize) {
+    name = kStaticTable[index - 1].first;
+    value = kStaticTable[index - 1].second;
+    return true;
+  }
+  index -= kStaticSize + 1;
+  if (index >= entries_.size()) {
+    return false;
+  }
+  name = entries_[index].first;
+  value = entries_[index].second;
+  return true;
+}
+
+void HpackTable::Add(std::string_view name, std::string_view value) {
+  auto entry_size = name.size() + value.size() + kEntryOverhead;
+  if (entry_size > max_size_) {
+    // An entry larger than the table empties it
+    Evict(0);
+    return;
+  }
+  Evict(max_size_ - entry_size);
+  entries_.emplace_front(name, value);
+  size_ += entry_size;
+}
+
+std::size_t HpackTable::Find(std::string_view name, std::string_view value,
+                             bool& value_matched) const noexcept {
+  std::size_t name_index = 0;
+  for (std::size_t i = 0; i < kStaticSize; ++i) {
+    if (kStaticTable[i].first == name) {
+      if (kStaticTable[i].second == value) {
+        value_matched = true;
+        return i + 1;
+      }
+      if (name_index == 0) {
+        name_index = i + 1;
+      }
+    }
+  }
+  for (std::size_t i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].first == name) {
+      if (entries_[i].second == value) {
+        value_matched = true;
+        return kStaticSize + i + 1;
+      }
+      if (name_index == 0) {
+        name_index = kStaticSize + i + 1;
+      }
+    }
+  }
+  value_matched = false;
+  return name_index;
+}
+
+void HpackTable::Evict(std::size_t max_size) noexcept {
+  while (size_ > max_size && !entries_.empty()) {
+    const auto& entry = entries_.back();
+    size_ -= entry.first.size() + entry.second.size() + kEntryOverhead;
+    entries_.pop_back();
+  }
+}
+
+HpackDecoder::Result HpackDecoder::Decode(const std::uint8_t* data,
+                                          std::size_t size,
+                                          std::size_t max_list_size,
+                                          HpackHeaderList& headers) {
+  const auto* p = data;
+  const auto* end = data + size;
+  bool size_update_allowed = true;
+  std::size_t list_size = 0;
+  while (p != end) {
+    auto byte = *p;
+    std::uint64_t index = 0;
+    std::string_view name, value;
+    if (byte & 0x80) {
+      // Indexed field, checked before it is copied since a single byte may
+      // stand for a whole table entry
+      if (!DecodeInteger(p, end, 7, index) || !table_.Get(index, name, value)) {
+        return Result::kCompressionError;
+      }
+      list_size += name.size() + value.size() + kEntryOverhead;
+      if (list_size > max_list_size) {
+        return Result::kHeaderListTooLarge;
+      }
+      headers.emplace_back(name, value);
+    } else if ((byte & 0xe0) == 0x20) {
+      // Dynamic table size update, only at the start of a block
+      if (!size_update_allowed || !DecodeInteger(p, end, 5, index) ||
+          index > max_table_size_) {
+        return Result::kCompressionError;
+      }
+      table_.set_max_size(index);
+      continue;
+    } else {
+      // Literal field, with incremental indexing (01), without indexing
+      // (0000) or never indexed (0001)
+      bool indexing = (byte & 0xc0) == 0x40;
+      if (!DecodeInteger(p, end, indexing ? 6 : 4, index)) {
+        return Result::kCompressionError;
+      }
+      auto& field = headers.emplace_back();
+      if (index > 0) {
+        if (!table_.Get(index, name, value)) {
+          return Result::kCompressionError;
+        }
+        field.first = name;
+      } else if (!DecodeString(p, end, field.first)) {
+        return Result::kCompressionError;
+      }
+      if (!DecodeString(p, end, field.second)) {
+        return Result::kCompressionError;
+      }
+      list_size += field.first.size() + field.second.size() + kEntryOverhead;
+      if (list_size > max_list_size) {
+        return Result::kHeaderListTooLarge;
+      }
+      if (indexing) {
+        table_.Add(field.first, field.second);
+      }
+    }
+    size_update_allowed = false;
+  }
+  return Result::kOk;
+}
+
+void HpackEncoder::set_max_table_size(std::size_t val) noexcept {
+  min_table_size_ = std::min(min_table_size_, val);
+  table_.set_max_size(val);
+  table_size_changed_ = true;
+}
+
+void HpackEncoder::Begin(std::string& out) {
+  if (table_size_changed_) {
+    // The smallest size since the last block must be announced first, so
+    // that the peer evicts the same entries
+    if (min_table_size_ < table_.max_size()) {
+      EncodeInteger(min_table_size_, 5, 0x20, out);
+    }
+    EncodeInteger(table_.max_size(), 5, 0x20, out);
+    min_table_size_ = SIZE_MAX;
+    table_size_changed_ = false;
+  }
+}
+
+void HpackEncoder::Encode(std::string_view name, std::string_view value,
+                          std::string& out, bool sensitive) {
+  bool value_matched = false;
+  auto index = table_.Find(name, value, value_matched);
+  if (value_matched && !sensitive) {
+    EncodeInteger(index, 7, 0x80, out);
+    return;
+  }
+  // Values unlikely to repeat are not worth a table slot
+  bool indexing = !sensitive && name != "content-length" && name != "date" &&
+                  name.size() + value.size() + kEntryOverhead <=
+                      table_.max_size() / 2;
+  if (indexing) {
+    EncodeInteger(index, 6, 0x40, out);
+  } else {
+    EncodeInteger(index, 4, sensitive ? 0x10 : 0, out);
+  }
+  if (index == 0) {
+    EncodeString(name, out);
+  }
+  EncodeString(value, out);
+  if (indexing) {
+    table_.Add(name, value);
+  }
+}
+
+std::size_t HuffmanEncodedSize(std::string_view str) noexcept {
+  std::size_t bits = 0;
+  for (auto c : str) {
+    bits += kHuffmanCodes[static_cast<std::uint8_t>(c)].bits;
+  }
+  return (bits + 7) / 8;
+}
+
+void HuffmanEncode(std::string_view str, std::string& out) {
+  std::uint64_t acc = 0;
+  std::size_t acc_bits = 0;
+  for (auto c : str) {
+    const auto& sym = kHuffmanCodes[static_cast<std::uint8_t>(c)];
+    acc = (acc << sym.bits) | sym.code;
+    acc_bits += sym.bits;
+    while (acc_bits >= 8) {
+      acc_bits -= 8;
+      out.push_back(static_cast<char>(acc >> acc_bits));
+    }
+  }
+  if (acc_bits > 0) {
+    // Padded with the most significant bits of EOS
+    acc = (acc << (8 - acc_bits)) | (0xff >> acc_bits);
+    out.push_back(static_cast<char>(acc));
+  }
+}
+
+bool HuffmanDecode(const std::uint8_t* data, std::size_t size,
+                   std::string& out) {
+  const auto& table = GetHuffmanDecodeTable();
+  std::uint32_t code = 0;
+  std::size_t bits = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    for (int shift = 7; shift >= 0; --shift) {
+      code = (code << 1) | ((data[i] >> shift) & 1);
+      ++bits;
+      auto offset = code - table.first_code[bits];
+      if (code >= table.first_code[bits] && offset < table.count[bits]) {
+        auto sym = table.symbols[table.first_index[bits] + offset];
+        if (sym == kHuffmanEos) {
+          return false;
+        }
+        out.push_back(static_cast<char>(sym));
+        code = 0;
+        bits = 0;
+      } else if (bits == kHuffmanMaxBits) {
+        return false;
+      }
+    }
+  }
+  // At most 7 bits of padding, all ones
+  return bits < 8 && code == (1u << bits) - 1;
+}
+
+}  // namespace netkit::http
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace netkit::http {
+
+using HpackHeaderList = std::vector<std::pair<std::string, std::string>>;
+
+// Static table (RFC 7541 Appendix A) followed by the dynamic table, indexes
+// start at 1
+class HpackTable {
+ public:
+  static constexpr std::size_t kStaticSize = 61;
+
+  explicit HpackTable(std::size_t max_size) noexcept : max_size_(max_size) {}
+
+  std::size_t size() const noexcept { return size_; }
+
+  std::size_t max_size() const noexcept { return max_size_; }
+
+  // Evicts entries until the table fits
+  void set_max_size(std::size_t val) noexcept;
+
+  bool Get(std::size_t index, std::string_view& name,
+           std::string_view& value) const noexcept;
+
+  void Add(std::string_view name, std::string_view value);
+
+  // Returns the index of the entry matching name and value, or of the first
+  // one matching the name with value_matched false, 0 if none
+  std::size_t Find(std::string_view name, std::string_view value,
+                   bool& value_matched) const noexcept;
+
+ private:
+  void Evict(std::size_t max_size) noexcept;
+
+ private:
+  std::deque<std::pair<std::string, std::string>> entries_;
+  std::size_t size_ = 0;
+  std::size_t max_size_;
+};
+
+class HpackDecoder {
+ public:
+  // max_table_size is the SETTINGS_HEADER_TABLE_SIZE we announce
+  explicit HpackDecoder(std::size_t max_table_size = 4096) noexcept
+      : table_(max_table_size), max_table_size_(max_table_size) {}
+
+  enum class Result { kOk, kCompressionError, kHeaderListTooLarge };
+
+  // Decodes a complete header block. Decoding stops as soon as the fields
+  // take more than max_list_size, counted as SETTINGS_MAX_HEADER_LIST_SIZE
+  // does. An error leaves the decoder unusable.
+  Result Decode(const std::uint8_t* data, std::size_t size,
+                std::size_t max_list_size, HpackHeaderList& headers);
+
+ private:
+  HpackTable table_;
+  std::size_t max_table_size_;
+};
+
+class HpackEncoder {
+ public:
+  // SETTINGS_HEADER_TABLE_SIZE of the peer
+  void set_max_table_size(std::size_t val) noexcept;
+
+  // Starts a header block, announces a pending table size change
+  void Begin(std::string& out);
+
+  // Fields that should not be kept by intermediaries, such as cookies, are
+  // never indexed
+  void Encode(std::string_view name, std::string_view value, std::string& out,
+              bool sensitive = false);
+
+ private:
+  HpackTable table_{4096};
+  std::size_t min_table_size_ = SIZE_MAX;
+  bool table_size_changed_ = false;
+};
+
+// Huffman code of RFC 7541 Appendix B
+std::size_t HuffmanEncodedSize(std::string_view str) noexcept;
+
+void HuffmanEncode(std::string_view str, std::string& out);
+
+bool HuffmanDecode(const std::uint8_t* data, std::size_t size,
+                   std::string& out);
+
+}  // namespace netkit::http
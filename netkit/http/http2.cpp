@@ -0,0 +1,33 @@
+#include "http2.h"
+
+#include <cstring>
+
+namespace netkit::http::http2 {
+
+static const unsigned char kAlpnProtocols[] = "\x02h2\x08http/1.1";
+
+static int SelectAlpn(SSL* ssl, const unsigned char** out,
+                      unsigned char* outlen, const unsigned char* in,
+                      unsigned int inlen, void* arg) {
+  unsigned char* selected = nullptr;
+  if (SSL_select_next_proto(&selected, outlen, kAlpnProtocols,
+                            sizeof(kAlpnProtocols) - 1, in,
+                            inlen) != OPENSSL_NPN_NEGOTIATED) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+  *out = selected;
+  return SSL_TLSEXT_ERR_OK;
+}
+
+void EnableAlpn(SSL_CTX* ctx) {
+  SSL_CTX_set_alpn_select_cb(ctx, &SelectAlpn, nullptr);
+}
+
+bool IsNegotiated(SSL* ssl) noexcept {
+  const unsigned char* data = nullptr;
+  unsigned int size = 0;
+  SSL_get0_alpn_selected(ssl, &data, &size);
+  return size == 2 && std::memcmp(data, "h2", 2) == 0;
+}
+
+}  // namespace netkit::http::http2
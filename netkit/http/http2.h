@@ -0,0 +1,107 @@
+#pragma once
+#include <boost/asio/ssl.hpp>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace netkit::http::http2 {
+
+constexpr std::string_view kPreface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+constexpr std::size_t kFrameHeaderSize = 9;
+
+constexpr std::uint32_t kDefaultWindowSize = 65535;
+
+constexpr std::uint32_t kMaxWindowSize = 0x7fffffff;
+
+constexpr std::uint32_t kMinFrameSize = 16384;
+
+constexpr std::uint32_t kMaxFrameSize = 16777215;
+
+// Frame types
+constexpr std::uint8_t kData = 0x0;
+constexpr std::uint8_t kHeaders = 0x1;
+constexpr std::uint8_t kPriority = 0x2;
+constexpr std::uint8_t kRstStream = 0x3;
+constexpr std::uint8_t kSettings = 0x4;
+constexpr std::uint8_t kPushPromise = 0x5;
+constexpr std::uint8_t kPing = 0x6;
+constexpr std::uint8_t kGoaway = 0x7;
+constexpr std::uint8_t kWindowUpdate = 0x8;
+constexpr std::uint8_t kContinuation = 0x9;
+
+// Frame flags
+constexpr std::uint8_t kEndStream = 0x1;
+constexpr std::uint8_t kAck = 0x1;
+constexpr std::uint8_t kEndHeaders = 0x4;
+constexpr std::uint8_t kPadded = 0x8;
+constexpr std::uint8_t kPriorityFlag = 0x20;
+
+// SETTINGS parameters
+constexpr std::uint16_t kHeaderTableSize = 0x1;
+constexpr std::uint16_t kEnablePush = 0x2;
+constexpr std::uint16_t kMaxConcurrentStreams = 0x3;
+constexpr std::uint16_t kInitialWindowSize = 0x4;
+constexpr std::uint16_t kMaxFrameSizeSetting = 0x5;
+constexpr std::uint16_t kMaxHeaderListSize = 0x6;
+
+enum class Error : std::uint32_t {
+  kNoError = 0x0,
+  kProtocolError = 0x1,
+  kInternalError = 0x2,
+  kFlowControlError = 0x3,
+  kSettingsTimeout = 0x4,
+  kStreamClosed = 0x5,
+  kFrameSizeError = 0x6,
+  kRefusedStream = 0x7,
+  kCancel = 0x8,
+  kCompressionError = 0x9,
+  kConnectError = 0xa,
+  kEnhanceYourCalm = 0xb,
+  kInadequateSecurity = 0xc,
+  kHttp11Required = 0xd,
+};
+
+struct FrameHeader {
+  std::uint32_t length = 0;
+  std::uint8_t type = 0;
+  std::uint8_t flags = 0;
+  std::uint32_t stream_id = 0;
+
+  static FrameHeader Parse(const std::uint8_t* p) noexcept {
+    FrameHeader hdr;
+    hdr.length = (p[0] << 16) | (p[1] << 8) | p[2];
+    hdr.type = p[3];
+    hdr.flags = p[4];
+    hdr.stream_id = ReadUint32(p + 5) & 0x7fffffff;
+    return hdr;
+  }
+
+  void AppendTo(std::string& out) const {
+    char buf[kFrameHeaderSize] = {
+        static_cast<char>(length >> 16), static_cast<char>(length >> 8),
+        static_cast<char>(length),       static_cast<char>(type),
+        static_cast<char>(flags),        static_cast<char>(stream_id >> 24),
+        static_cast<char>(stream_id >> 16), static_cast<char>(stream_id >> 8),
+        static_cast<char>(stream_id)};
+    out.append(buf, sizeof(buf));
+  }
+
+  static std::uint32_t ReadUint32(const std::uint8_t* p) noexcept {
+    return (std::uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  }
+};
+
+inline void AppendUint32(std::uint32_t val, std::string& out) {
+  char buf[4] = {static_cast<char>(val >> 24), static_cast<char>(val >> 16),
+                 static_cast<char>(val >> 8), static_cast<char>(val)};
+  out.append(buf, sizeof(buf));
+}
+
+// Makes the context pick "h2" when the client offers it, "http/1.1"
+// otherwise
+void EnableAlpn(SSL_CTX* ctx);
+
+bool IsNegotiated(SSL* ssl) noexcept;
+
+}  // namespace netkit::http::http2
@@ -0,0 +1,930 @@
+#pragma once
+#include <netkit/http/context.h>
+#include <netkit/http/dispatch.h>
+#include <netkit/http/hpack.h>
+#include <netkit/http/http2.h>
+#include <netkit/http/router.h>
+#include <netkit/http/settings.h>
+#include <netkit/io_context_pool.h>
+#include <netkit/utility.h>
+
+#include <algorithm>
+#include <any>
+#include <boost/asio/dispatch.hpp>
+#include <boost/beast/core.hpp>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+
+namespace netkit::http {
+
+// Server side of an HTTP/2 connection (RFC 7540). Every stream becomes a
+// Context dispatched through the filters and the router like an HTTP/1.x
+// request, once its request is complete. Responses are buffered and sent
+// as DATA frames within the flow control windows, ready streams are served
+// in priority order.
+template <class Stream>
+class Http2Connection
+    : public std::enable_shared_from_this<Http2Connection<Stream>> {
+  friend class Context;
+  using Self = Http2Connection;
+
+ public:
+  // buffer holds the bytes read so far, starting with the client preface
+  Http2Connection(Stream&& stream, boost::beast::flat_buffer&& buffer,
+                  Settings& settings, Router& router,
+                  IoContextPool::Lease&& lease = {}) noexcept
+      : stream_(std::move(stream)),
+        buffer_(std::move(buffer)),
+        settings_(settings),
+        options_(settings.http2().value_or(Http2Settings())),
+        router_(router),
+        decoder_(options_.header_table_size()),
+        recv_window_(options_.connection_window_size()),
+        lease_(std::move(lease)) {}
+
+  ~Http2Connection() noexcept {}
+
+  void Run() {
+    // Frames are coalesced already, small ones must not wait for an ACK
+    auto& socket = boost::beast::get_lowest_layer(stream_).socket();
+    if constexpr (std::is_same_v<std::decay_t<decltype(socket)>,
+                                 boost::asio::ip::tcp::socket>) {
+      boost::beast::error_code ec;
+      socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+    }
+    WriteSettings();
+    if (!Process()) {
+      return Flush();
+    }
+    Flush();
+    Read();
+  }
+
+ private:
+  static constexpr std::size_t kReadSize = 16 * 1024;
+  static constexpr std::size_t kWriteBatchSize = 64 * 1024;
+  static constexpr std::uint32_t kDefaultWeight = 16;
+  static constexpr std::uint64_t kStride = 256;
+  static constexpr std::size_t kMaxPriorityDepth = 16;
+  static constexpr std::uint32_t kMaxEncoderTableSize = 4096;
+
+  struct StreamState {
+    Request req;
+    std::int64_t send_window = 0;
+    std::int64_t recv_window = 0;
+    std::uint32_t recv_unacked = 0;
+    bool end_stream = false;
+    bool responded = false;
+    std::string data;
+    std::size_t data_offset = 0;
+    std::uint32_t parent = 0;
+    std::uint32_t weight = kDefaultWeight;
+    std::uint64_t pass = 0;
+  };
+
+  void set_user_data(std::any&& data) noexcept { user_data_ = std::move(data); }
+
+  boost::asio::any_io_executor executor() noexcept {
+    return stream_.get_executor();
+  }
+
+  auto native_handle() noexcept {
+    return boost::beast::get_lowest_layer(stream_).socket().native_handle();
+  }
+
+  template <class T>
+  T* try_get_user_data() noexcept {
+    if (user_data_.has_value()) {
+      try {
+        return std::any_cast<T>(&user_data_);
+      } catch (const std::exception&) {
+      }
+    }
+    return nullptr;
+  }
+
+  // WebSockets over HTTP/2 (RFC 8441) aren't supported, the stream is
+  // answered instead of being left open
+  WebSocket::Ptr UpgradeWebSocket(const Context::Ptr& ctx,
+                                  const WebSocketOptions& options) {
+    ctx->Response(boost::beast::http::status::not_implemented, false);
+    return nullptr;
+  }
+
+  template <class Body>
+  void Response(const Context::Ptr& ctx,
+                boost::beast::http::response<Body>&& resp) {
+    for (const auto& filter : settings_.filters()) {
+      filter->OnOutgingResponse(ctx, resp);
+    }
+    boost::asio::dispatch(
+        stream_.get_executor(),
+        [this, self = this->shared_from_this(), id = ctx->stream_id(),
+         resp = std::move(resp)]() mutable { SendResponse(id, resp); });
+  }
+
+  template <class Body>
+  void SendResponse(std::uint32_t id,
+                    boost::beast::http::response<Body>& resp) {
+    auto it = streams_.find(id);
+    if (it == streams_.end() || it->second.responded) {
+      return;
+    }
+    auto& st = it->second;
+    std::string block;
+    encoder_.Begin(block);
+    encoder_.Encode(":status", std::to_string(resp.result_int()), block);
+    std::string name;
+    for (const auto& field : resp) {
+      auto name_view = field.name_string();
+      name.assign(name_view.data(), name_view.size());
+      util::ToLower(name);
+      if (IsConnectionHeader(name)) {
+        continue;
+      }
+      auto value = field.value();
+      encoder_.Encode(name, std::string_view(value.data(), value.size()),
+                      block, name == "set-cookie");
+    }
+    boost::beast::error_code ec;
+    typename Body::writer writer(resp.base(), resp.body());
+    writer.init(ec);
+    while (!ec) {
+      auto result = writer.get(ec);
+      if (ec || !result) {
+        break;
+      }
+      for (auto buffer : boost::beast::buffers_range_ref(result->first)) {
+        st.data.append(static_cast<const char*>(buffer.data()),
+                       buffer.size());
+      }
+      if (!result->second) {
+        break;
+      }
+    }
+    if (ec) {
+      return ResetStream(id, http2::Error::kInternalError);
+    }
+    st.responded = true;
+    bool end_stream = st.data.empty();
+    AppendHeaders(id, block, end_stream);
+    if (end_stream) {
+      CloseStream(id);
+    } else {
+      st.pass = std::max(st.pass, virtual_time_);
+    }
+    Flush();
+  }
+
+  static bool IsConnectionHeader(std::string_view name) noexcept {
+    return name == "connection" || name == "keep-alive" ||
+           name == "proxy-connection" || name == "transfer-encoding" ||
+           name == "upgrade";
+  }
+
+  void Read() {
+    auto& lowest = boost::beast::get_lowest_layer(stream_);
+    if (streams_.empty()) {
+      lowest.expires_after(settings_.read_timeout());
+    } else {
+      lowest.expires_never();
+    }
+    settings_.socket_options().BeforeRead(lowest.socket());
+    stream_.async_read_some(
+        buffer_.prepare(kReadSize),
+        [self = this->shared_from_this()](const boost::beast::error_code& ec,
+                                          std::size_t bytes_transferred) {
+          self->OnRead(ec, bytes_transferred);
+        });
+  }
+
+  void OnRead(const boost::beast::error_code& ec,
+              std::size_t bytes_transferred) {
+    if (ec) {
+      return Close();
+    }
+    buffer_.commit(bytes_transferred);
+    bool ok = Process();
+    Flush();
+    if (ok && !closing_) {
+      Read();
+    }
+  }
+
+  // Handles the complete frames in buffer_, returns false after a
+  // connection error
+  bool Process() {
+    if (preface_offset_ < http2::kPreface.size()) {
+      auto size = std::min(http2::kPreface.size() - preface_offset_,
+                           buffer_.size());
+      if (std::memcmp(buffer_.data().data(),
+                      http2::kPreface.data() + preface_offset_, size) != 0) {
+        return ConnectionError(http2::Error::kProtocolError);
+      }
+      preface_offset_ += size;
+      buffer_.consume(size);
+    }
+    while (preface_offset_ == http2::kPreface.size() &&
+           buffer_.size() >= http2::kFrameHeaderSize) {
+      auto p = static_cast<const std::uint8_t*>(buffer_.data().data());
+      auto hdr = http2::FrameHeader::Parse(p);
+      if (hdr.length > options_.max_frame_size()) {
+        return ConnectionError(http2::Error::kFrameSizeError);
+      }
+      if (buffer_.size() < http2::kFrameHeaderSize + hdr.length) {
+        break;
+      }
+      if (continuation_stream_ != 0 &&
+          (hdr.type != http2::kContinuation ||
+           hdr.stream_id != continuation_stream_)) {
+        return ConnectionError(http2::Error::kProtocolError);
+      }
+      if (!OnFrame(hdr, p + http2::kFrameHeaderSize)) {
+        return false;
+      }
+      buffer_.consume(http2::kFrameHeaderSize + hdr.length);
+    }
+    return true;
+  }
+
+  bool OnFrame(const http2::FrameHeader& hdr, const std::uint8_t* p) {
+    switch (hdr.type) {
+      case http2::kData:
+        return OnData(hdr, p);
+      case http2::kHeaders:
+        return OnHeaders(hdr, p);
+      case http2::kPriority:
+        return OnPriority(hdr, p);
+      case http2::kRstStream:
+        return OnRstStream(hdr, p);
+      case http2::kSettings:
+        return OnSettings(hdr, p);
+      case http2::kPing:
+        return OnPing(hdr, p);
+      case http2::kGoaway:
+        return OnGoaway(hdr, p);
+      case http2::kWindowUpdate:
+        return OnWindowUpdate(hdr, p);
+      case http2::kContinuation:
+        return OnContinuation(hdr, p);
+      case http2::kPushPromise:
+        return ConnectionError(http2::Error::kProtocolError);
+      default:
+        // Unknown frames are ignored
+        return true;
+    }
+  }
+
+  // Removes the padding of DATA and HEADERS frames
+  static bool Unpad(const http2::FrameHeader& hdr, const std::uint8_t*& p,
+                    std::size_t& size) noexcept {
+    size = hdr.length;
+    if (hdr.flags & http2::kPadded) {
+      if (size < 1 || p[0] >= size) {
+        return false;
+      }
+      size -= p[0] + 1;
+      ++p;
+    }
+    return true;
+  }
+
+  bool OnData(const http2::FrameHeader& hdr, const std::uint8_t* p) {
+    if (hdr.stream_id == 0) {
+      return ConnectionError(http2::Error::kProtocolError);
+    }
+    // Flow control counts the whole payload, padding included
+    if (hdr.length > recv_window_) {
+      return ConnectionError(http2::Error::kFlowControlError);
+    }
+    recv_window_ -= hdr.length;
+    recv_unacked_ += hdr.length;
+    if (recv_unacked_ >= options_.connection_window_size() / 2) {
+      AppendWindowUpdate(0, recv_unacked_);
+      recv_window_ += recv_unacked_;
+      recv_unacked_ = 0;
+    }
+    std::size_t size = 0;
+    if (!Unpad(hdr, p, size)) {
+      return ConnectionError(http2::Error::kProtocolError);
+    }
+    auto it = streams_.find(hdr.stream_id);
+    if (it == streams_.end() || it->second.end_stream) {
+      if (hdr.stream_id > last_stream_id_) {
+        return ConnectionError(http2::Error::kProtocolError);
+      }
+      AppendRstStream(hdr.stream_id, http2::Error::kStreamClosed);
+      return true;
+    }
+    auto& st = it->second;
+    if (hdr.length > st.recv_window) {
+      ResetStream(hdr.stream_id, http2::Error::kFlowControlError);
+      return true;
+    }
+    st.recv_window -= hdr.length;
+    auto& body = st.req.body();
+    auto& limit = settings_.body_limit();
+    if (limit && body.size() + size > *limit) {
+      RejectStream(hdr.stream_id,
+                   boost::beast::http::status::payload_too_large);
+      return true;
+    }
+    body.append(reinterpret_cast<const char*>(p), size);
+    if (hdr.flags & http2::kEndStream) {
+      EndRequest(hdr.stream_id, st);
+      return true;
+    }
+    st.recv_unacked += hdr.length;
+    if (st.recv_unacked >= options_.stream_window_size() / 2) {
+      AppendWindowUpdate(hdr.stream_id, st.recv_unacked);
+      st.recv_window += st.recv_unacked;
+      st.recv_unacked = 0;
+    }
+    return true;
+  }
+
+  bool OnHeaders(const http2::FrameHeader& hdr, const std::uint8_t* p) {
+    if (hdr.stream_id == 0 || hdr.stream_id % 2 == 0) {
+      return ConnectionError(http2::Error::kProtocolError);
+    }
+    std::size_t size = 0;
+    if (!Unpad(hdr, p, size)) {
+      return ConnectionError(http2::Error::kProtocolError);
+    }
+    header_priority_ = false;
+    if (hdr.flags & http2::kPriorityFlag) {
+      if (size < 5) {
+        return ConnectionError(http2::Error::kProtocolError);
+      }
+      header_priority_ = true;
+      ParsePriority(p, header_parent_, header_exclusive_, header_weight_);
+      p += 5;
+      size -= 5;
+    }
+    header_block_.assign(reinterpret_cast<const char*>(p), size);
+    header_end_stream_ = (hdr.flags & http2::kEndStream) != 0;
+    if (hdr.flags & http2::kEndHeaders) {
+      return OnHeaderBlock(hdr.stream_id);
+    }
+    continuation_stream_ = hdr.stream_id;
+    return true;
+  }
+
+  bool OnContinuation(const http2::FrameHeader& hdr, const std::uint8_t* p) {
+    if (continuation_stream_ == 0) {
+      return ConnectionError(http2::Error::kProtocolError);
+    }
+    header_block_.append(reinterpret_cast<const char*>(p), hdr.length);
+    // Compressed fields never take much more room than decoded ones
+    if (header_block_.size() > 2 * settings_.header_limit()) {
+      return ConnectionError(http2::Error::kEnhanceYourCalm);
+    }
+    if (hdr.flags & http2::kEndHeaders) {
+      continuation_stream_ = 0;
+      return OnHeaderBlock(hdr.stream_id);
+    }
+    return true;
+  }
+
+  bool OnHeaderBlock(std::uint32_t id) {
+    // Fields are counted while they are decoded, a block expanding past
+    // the limit is never held whole
+    HpackHeaderList headers;
+    switch (decoder_.Decode(
+        reinterpret_cast<const std::uint8_t*>(header_block_.data()),
+        header_block_.size(), settings_.header_limit(), headers)) {
+      case HpackDecoder::Result::kOk:
+        break;
+      case HpackDecoder::Result::kHeaderListTooLarge:
+        return ConnectionError(http2::Error::kEnhanceYourCalm);
+      default:
+        return ConnectionError(http2::Error::kCompressionError);
+    }
+    header_block_.clear();
+    auto it = streams_.find(id);
+    if (it != streams_.end()) {
+      // Trailers, their fields are dropped
+      if (it->second.end_stream) {
+        ResetStream(id, http2::Error::kStreamClosed);
+      } else if (!header_end_stream_) {
+        ResetStream(id, http2::Error::kProtocolError);
+      } else {
+        EndRequest(id, it->second);
+      }
+      return true;
+    }
+    if (id <= last_stream_id_) {
+      return ConnectionError(http2::Error::kStreamClosed);
+    }
+    last_stream_id_ = id;
+    if (goaway_received_) {
+      return true;
+    }
+    if (streams_.size() >= options_.max_concurrent_streams()) {
+      AppendRstStream(id, http2::Error::kRefusedStream);
+      return true;
+    }
+    auto& st = streams_[id];
+    st.send_window = peer_window_size_;
+    st.recv_window = options_.stream_window_size();
+    if (header_priority_) {
+      SetPriority(id, header_parent_, header_exclusive_, header_weight_);
+    }
+    if (!MakeRequest(headers, st.req)) {
+      ResetStream(id, http2::Error::kProtocolError);
+      return true;
+    }
+    if (header_end_stream_) {
+      EndRequest(id, st);
+    }
+    return true;
+  }
+
+  static bool MakeRequest(HpackHeaderList& headers, Request& req) {
+    boost::beast::string_view method, scheme, path, authority;
+    std::string cookie;
+    bool regular = false;
+    for (const auto& [name, value] : headers) {
+      if (name.empty() ||
+          std::any_of(name.begin(), name.end(),
+                      [](char c) { return c >= 'A' && c <= 'Z'; })) {
+        return false;
+      }
+      if (name[0] == ':') {
+        if (regular) {
+          return false;
+        }
+        if (name == ":method") {
+          method = value;
+        } else if (name == ":scheme") {
+          scheme = value;
+        } else if (name == ":path") {
+          path = value;
+        } else if (name == ":authority") {
+          authority = value;
+        } else {
+          return false;
+        }
+        continue;
+      }
+      regular = true;
+      if (IsConnectionHeader(name) || (name == "te" && value != "trailers")) {
+        return false;
+      }
+      if (name == "cookie") {
+        // Split cookies are joined back for HTTP/1.x handlers
+        if (!cookie.empty()) {
+          cookie += "; ";
+        }
+        cookie += value;
+        continue;
+      }
+      req.insert(name, value);
+    }
+    if (method.empty() || scheme.empty() || path.empty()) {
+      return false;
+    }
+    req.method_string(method);
+    req.target(path);
+    req.version(20);
+    if (!authority.empty() &&
+        req.find(boost::beast::http::field::host) == req.end()) {
+      req.set(boost::beast::http::field::host, authority);
+    }
+    if (!cookie.empty()) {
+      req.set(boost::beast::http::field::cookie, cookie);
+    }
+    return true;
+  }
+
+  void EndRequest(std::uint32_t id, StreamState& st) {
+    st.end_stream = true;
+    auto ctx = std::make_shared<Context>(this->shared_from_this(),
+                                         std::move(st.req), id);
+    // The handler may respond and close the stream right away
+    DispatchRequest(ctx, settings_, router_);
+  }
+
+  static void ParsePriority(const std::uint8_t* p, std::uint32_t& parent,
+                            bool& exclusive, std::uint32_t& weight) noexcept {
+    auto val = http2::FrameHeader::ReadUint32(p);
+    exclusive = (val & 0x80000000) != 0;
+    parent = val & 0x7fffffff;
+    weight = p[4] + 1;
+  }
+
+  void SetPriority(std::uint32_t id, std::uint32_t parent, bool exclusive,
+                   std::uint32_t weight) {
+    auto it = streams_.find(id);
+    if (it == streams_.end()) {
+      return;
+    }
+    if (parent == id) {
+      return ResetStream(id, http2::Error::kProtocolError);
+    }
+    if (IsAncestor(id, parent)) {
+      // The new parent moves to the former place of the stream
+      streams_[parent].parent = it->second.parent;
+    }
+    if (exclusive) {
+      for (auto& [child_id, child] : streams_) {
+        if (child.parent == parent && child_id != id) {
+          child.parent = id;
+        }
+      }
+    }
+    it->second.parent = parent;
+    it->second.weight = weight;
+  }
+
+  bool IsAncestor(std::uint32_t id, std::uint32_t stream_id) const {
+    for (std::size_t depth = 0; depth < kMaxPriorityDepth; ++depth) {
+      auto it = streams_.find(stream_id);
+      if (it == streams_.end()) {
+        return false;
+      }
+      if (it->second.parent == id) {
+        return true;
+      }
+      stream_id = it->second.parent;
+    }
+    return false;
+  }
+
+  bool OnPriority(const http2::FrameHeader& hdr, const std::uint8_t* p) {
+    if (hdr.stream_id == 0) {
+      return ConnectionError(http2::Error::kProtocolError);
+    }
+    if (hdr.length != 5) {
+      ResetStream(hdr.stream_id, http2::Error::kFrameSizeError);
+      return true;
+    }
+    std::uint32_t parent = 0, weight = 0;
+    bool exclusive = false;
+    ParsePriority(p, parent, exclusive, weight);
+    SetPriority(hdr.stream_id, parent, exclusive, weight);
+    return true;
+  }
+
+  bool OnRstStream(const http2::FrameHeader& hdr, const std::uint8_t* p) {
+    if (hdr.length != 4) {
+      return ConnectionError(http2::Error::kFrameSizeError);
+    }
+    if (hdr.stream_id == 0 || hdr.stream_id > last_stream_id_) {
+      return ConnectionError(http2::Error::kProtocolError);
+    }
+    CloseStream(hdr.stream_id);
+    return true;
+  }
+
+  bool OnSettings(const http2::FrameHeader& hdr, const std::uint8_t* p) {
+    if (hdr.stream_id != 0) {
+      return ConnectionError(http2::Error::kProtocolError);
+    }
+    if (hdr.flags & http2::kAck) {
+      return hdr.length == 0 ||
+             ConnectionError(http2::Error::kFrameSizeError);
+    }
+    if (hdr.length % 6 != 0) {
+      return ConnectionError(http2::Error::kFrameSizeError);
+    }
+    for (std::size_t i = 0; i < hdr.length; i += 6) {
+      std::uint16_t id = (p[i] << 8) | p[i + 1];
+      auto val = http2::FrameHeader::ReadUint32(p + i + 2);
+      switch (id) {
+        case http2::kHeaderTableSize:
+          encoder_.set_max_table_size(std::min(val, kMaxEncoderTableSize));
+          break;
+        case http2::kEnablePush:
+          if (val > 1) {
+            return ConnectionError(http2::Error::kProtocolError);
+          }
+          break;
+        case http2::kInitialWindowSize: {
+          if (val > http2::kMaxWindowSize) {
+            return ConnectionError(http2::Error::kFlowControlError);
+          }
+          std::int64_t delta = std::int64_t(val) - peer_window_size_;
+          for (auto& [id, st] : streams_) {
+            st.send_window += delta;
+            if (st.send_window > http2::kMaxWindowSize) {
+              return ConnectionError(http2::Error::kFlowControlError);
+            }
+          }
+          peer_window_size_ = val;
+          break;
+        }
+        case http2::kMaxFrameSizeSetting:
+          if (val < http2::kMinFrameSize || val > http2::kMaxFrameSize) {
+            return ConnectionError(http2::Error::kProtocolError);
+          }
+          peer_frame_size_ = val;
+          break;
+        default:
+          break;
+      }
+    }
+    http2::FrameHeader{0, http2::kSettings, http2::kAck, 0}.AppendTo(out_);
+    return true;
+  }
+
+  bool OnPing(const http2::FrameHeader& hdr, const std::uint8_t* p) {
+    if (hdr.stream_id != 0) {
+      return ConnectionError(http2::Error::kProtocolError);
+    }
+    if (hdr.length != 8) {
+      return ConnectionError(http2::Error::kFrameSizeError);
+    }
+    if ((hdr.flags & http2::kAck) == 0) {
+      http2::FrameHeader{8, http2::kPing, http2::kAck, 0}.AppendTo(out_);
+      out_.append(reinterpret_cast<const char*>(p), 8);
+    }
+    return true;
+  }
+
+  bool OnGoaway(const http2::FrameHeader& hdr, const std::uint8_t* p) {
+    if (hdr.stream_id != 0) {
+      return ConnectionError(http2::Error::kProtocolError);
+    }
+    // Streams in progress are still answered
+    goaway_received_ = true;
+    return true;
+  }
+
+  bool OnWindowUpdate(const http2::FrameHeader& hdr, const std::uint8_t* p) {
+    if (hdr.length != 4) {
+      return ConnectionError(http2::Error::kFrameSizeError);
+    }
+    auto increment = http2::FrameHeader::ReadUint32(p) & 0x7fffffff;
+    if (hdr.stream_id == 0) {
+      if (increment == 0) {
+        return ConnectionError(http2::Error::kProtocolError);
+      }
+      send_window_ += increment;
+      if (send_window_ > http2::kMaxWindowSize) {
+        return ConnectionError(http2::Error::kFlowControlError);
+      }
+      return true;
+    }
+    auto it = streams_.find(hdr.stream_id);
+    if (it == streams_.end()) {
+      return hdr.stream_id <= last_stream_id_ ||
+             ConnectionError(http2::Error::kProtocolError);
+    }
+    if (increment == 0) {
+      ResetStream(hdr.stream_id, http2::Error::kProtocolError);
+      return true;
+    }
+    it->second.send_window += increment;
+    if (it->second.send_window > http2::kMaxWindowSize) {
+      ResetStream(hdr.stream_id, http2::Error::kFlowControlError);
+    }
+    return true;
+  }
+
+  void WriteSettings() {
+    const std::pair<std::uint16_t, std::uint32_t> params[] = {
+        {http2::kMaxConcurrentStreams, options_.max_concurrent_streams()},
+        {http2::kInitialWindowSize, options_.stream_window_size()},
+        {http2::kMaxFrameSizeSetting, options_.max_frame_size()},
+        {http2::kHeaderTableSize, options_.header_table_size()},
+        {http2::kMaxHeaderListSize, settings_.header_limit()},
+        {http2::kEnablePush, 0},
+    };
+    http2::FrameHeader{sizeof(params) / sizeof(params[0]) * 6,
+                       http2::kSettings, 0, 0}
+        .AppendTo(out_);
+    for (const auto& [id, val] : params) {
+      out_.push_back(static_cast<char>(id >> 8));
+      out_.push_back(static_cast<char>(id));
+      http2::AppendUint32(val, out_);
+    }
+    if (options_.connection_window_size() > http2::kDefaultWindowSize) {
+      AppendWindowUpdate(
+          0, options_.connection_window_size() - http2::kDefaultWindowSize);
+    }
+  }
+
+  void AppendWindowUpdate(std::uint32_t id, std::uint32_t increment) {
+    http2::FrameHeader{4, http2::kWindowUpdate, 0, id}.AppendTo(out_);
+    http2::AppendUint32(increment, out_);
+  }
+
+  void AppendRstStream(std::uint32_t id, http2::Error error) {
+    http2::FrameHeader{4, http2::kRstStream, 0, id}.AppendTo(out_);
+    http2::AppendUint32(static_cast<std::uint32_t>(error), out_);
+  }
+
+  // HEADERS followed by as many CONTINUATION frames as the block needs
+  void AppendHeaders(std::uint32_t id, const std::string& block,
+                     bool end_stream) {
+    std::size_t offset = 0;
+    std::uint8_t type = http2::kHeaders;
+    do {
+      auto size =
+          std::min<std::size_t>(block.size() - offset, peer_frame_size_);
+      std::uint8_t flags = type == http2::kHeaders && end_stream
+                               ? http2::kEndStream
+                               : 0;
+      if (offset + size == block.size()) {
+        flags |= http2::kEndHeaders;
+      }
+      http2::FrameHeader{static_cast<std::uint32_t>(size), type, flags, id}
+          .AppendTo(out_);
+      out_.append(block, offset, size);
+      offset += size;
+      type = http2::kContinuation;
+    } while (offset < block.size());
+  }
+
+  void ResetStream(std::uint32_t id, http2::Error error) {
+    AppendRstStream(id, error);
+    CloseStream(id);
+  }
+
+  // Answers a stream with an empty response before its request is complete,
+  // the client is then told to stop sending
+  void RejectStream(std::uint32_t id, boost::beast::http::status status) {
+    std::string block;
+    encoder_.Begin(block);
+    encoder_.Encode(":status", std::to_string(static_cast<unsigned>(status)),
+                    block);
+    AppendHeaders(id, block, true);
+    ResetStream(id, http2::Error::kNoError);
+  }
+
+  void CloseStream(std::uint32_t id) {
+    auto it = streams_.find(id);
+    if (it == streams_.end()) {
+      return;
+    }
+    // Children of a closed stream depend on its parent
+    for (auto& [child_id, child] : streams_) {
+      if (child.parent == id) {
+        child.parent = it->second.parent;
+      }
+    }
+    streams_.erase(it);
+  }
+
+  bool ConnectionError(http2::Error error) {
+    if (!closing_) {
+      closing_ = true;
+      http2::FrameHeader{8, http2::kGoaway, 0, 0}.AppendTo(out_);
+      http2::AppendUint32(last_stream_id_, out_);
+      http2::AppendUint32(static_cast<std::uint32_t>(error), out_);
+    }
+    return false;
+  }
+
+  bool IsReady(const StreamState& st) const noexcept {
+    return st.responded && st.data_offset < st.data.size();
+  }
+
+  // A ready stream is served only when none of its ancestors is, siblings
+  // share the connection in proportion to their weights (stride scheduling)
+  typename std::unordered_map<std::uint32_t, StreamState>::iterator
+  NextStream() {
+    auto next = streams_.end();
+    for (auto it = streams_.begin(); it != streams_.end(); ++it) {
+      const auto& st = it->second;
+      if (!IsReady(st) || st.send_window <= 0) {
+        continue;
+      }
+      if (next != streams_.end() && st.pass >= next->second.pass) {
+        continue;
+      }
+      bool blocked = false;
+      auto parent = st.parent;
+      for (std::size_t depth = 0; parent != 0 && depth < kMaxPriorityDepth;
+           ++depth) {
+        auto parent_it = streams_.find(parent);
+        if (parent_it == streams_.end()) {
+          break;
+        }
+        if (IsReady(parent_it->second) && parent_it->second.send_window > 0) {
+          blocked = true;
+          break;
+        }
+        parent = parent_it->second.parent;
+      }
+      if (!blocked) {
+        next = it;
+      }
+    }
+    return next;
+  }
+
+  void ScheduleData() {
+    while (out_.size() < kWriteBatchSize && send_window_ > 0) {
+      auto it = NextStream();
+      if (it == streams_.end()) {
+        break;
+      }
+      auto id = it->first;
+      auto& st = it->second;
+      auto remaining = st.data.size() - st.data_offset;
+      auto size = static_cast<std::size_t>(std::min<std::int64_t>(
+          {static_cast<std::int64_t>(remaining), peer_frame_size_,
+           send_window_, st.send_window}));
+      bool end_stream = size == remaining;
+      http2::FrameHeader{static_cast<std::uint32_t>(size), http2::kData,
+                         static_cast<std::uint8_t>(
+                             end_stream ? http2::kEndStream : 0),
+                         id}
+          .AppendTo(out_);
+      out_.append(st.data, st.data_offset, size);
+      st.data_offset += size;
+      send_window_ -= size;
+      st.send_window -= size;
+      virtual_time_ = st.pass;
+      st.pass += std::max<std::uint64_t>(size, 1) * kStride / st.weight;
+      if (end_stream) {
+        CloseStream(id);
+      }
+    }
+  }
+
+  void Flush() {
+    if (writing_ || closed_) {
+      return;
+    }
+    if (!closing_) {
+      ScheduleData();
+    }
+    if (out_.empty()) {
+      if (closing_ || (goaway_received_ && streams_.empty())) {
+        Shutdown();
+      }
+      return;
+    }
+    writing_ = true;
+    out_.swap(write_buffer_);
+    boost::asio::async_write(
+        stream_, boost::asio::buffer(write_buffer_),
+        [self = this->shared_from_this()](const boost::beast::error_code& ec,
+                                          std::size_t bytes_transferred) {
+          self->OnWrite(ec);
+        });
+  }
+
+  void OnWrite(const boost::beast::error_code& ec) {
+    writing_ = false;
+    write_buffer_.clear();
+    if (ec) {
+      return Close();
+    }
+    Flush();
+  }
+
+  // Sends FIN after the GOAWAY, the pending read ends with the peer's
+  void Shutdown() {
+    closed_ = true;
+    boost::beast::error_code ec;
+    boost::beast::get_lowest_layer(stream_).socket().shutdown(
+        boost::asio::socket_base::shutdown_send, ec);
+  }
+
+  void Close() {
+    closed_ = true;
+    streams_.clear();
+    boost::beast::get_lowest_layer(stream_).close();
+  }
+
+ private:
+  Stream stream_;
+  boost::beast::flat_buffer buffer_;
+  Settings& settings_;
+  Http2Settings options_;
+  Router& router_;
+  HpackDecoder decoder_;
+  HpackEncoder encoder_;
+  std::size_t preface_offset_ = 0;
+  std::unordered_map<std::uint32_t, StreamState> streams_;
+  std::uint32_t last_stream_id_ = 0;
+  std::uint32_t continuation_stream_ = 0;
+  std::string header_block_;
+  bool header_end_stream_ = false;
+  bool header_priority_ = false;
+  bool header_exclusive_ = false;
+  std::uint32_t header_parent_ = 0;
+  std::uint32_t header_weight_ = kDefaultWeight;
+  std::int64_t recv_window_;
+  std::uint32_t recv_unacked_ = 0;
+  std::int64_t send_window_ = http2::kDefaultWindowSize;
+  std::int64_t peer_window_size_ = http2::kDefaultWindowSize;
+  std::int64_t peer_frame_size_ = http2::kMinFrameSize;
+  std::uint64_t virtual_time_ = 0;
+  std::string out_;
+  std::string write_buffer_;
+  bool writing_ = false;
+  bool closing_ = false;
+  bool closed_ = false;
+  bool goaway_received_ = false;
+  std::any user_data_;
+  IoContextPool::Lease lease_;
+};
+
+}  // namespace netkit::http
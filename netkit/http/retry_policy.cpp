@@ -0,0 +1,74 @@
+#include <netkit/http/retry_policy.h>
+
+#include <algorithm>
+#include <random>
+
+namespace netkit::http {
+
+std::chrono::milliseconds RetryPolicy::Backoff(std::size_t retry) const {
+  if (retry == 0 || backoff_base_.count() <= 0) {
+    return std::chrono::milliseconds(0);
+  }
+  auto shift = std::min<std::size_t>(retry - 1, 20);
+  auto ceiling = std::min<std::int64_t>(backoff_base_.count() << shift,
+                                        backoff_max_.count());
+  thread_local std::minstd_rand engine(std::random_device{}());
+  std::uniform_int_distribution<std::int64_t> dist(0, ceiling);
+  return std::chrono::milliseconds(dist(engine));
+}
+
+bool RetryPolicy::IsRetryStatus(unsigned status) const noexcept {
+  return std::find(retry_statuses_.begin(), retry_statuses_.end(), status) !=
+         retry_statuses_.end();
+}
+
+bool RetryPolicy::IsIdempotent(boost::beast::http::verb method) noexcept {
+  switch (method) {
+    case boost::beast::http::verb::get:
+    case boost::beast::http::verb::head:
+    case boost::beast::http::verb::options:
+    case boost::beast::http::verb::trace:
+    case boost::beast::http::verb::put:
+    case boost::beast::http::verb::delete_:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void RetryBudget::Add(std::int64_t delta) noexcept {
+  auto tokens = tokens_.load(std::memory_order_relaxed);
+  std::int64_t next;
+  do {
+    next = std::clamp<std::int64_t>(tokens + delta, 0, max_);
+  } while (!tokens_.compare_exchange_weak(tokens, next,
+                                          std::memory_order_relaxed));
+}
+
+void LatencyTracker::Record(std::chrono::microseconds latency) noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+  samples_[next_] = latency.count();
+  next_ = (next_ + 1) % kSamples;
+  count_ = std::min(count_ + 1, kSamples);
+}
+
+std::optional<std::chrono::microseconds> LatencyTracker::Percentile(
+    double percentile) const {
+  std::array<std::int64_t, kSamples> samples;
+  std::size_t count;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    count = count_;
+    std::copy_n(samples_.begin(), count, samples.begin());
+  }
+  if (count < kMinSamples) {
+    return std::nullopt;
+  }
+  auto index = static_cast<std::size_t>(percentile * (count - 1));
+  index = std::min(index, count - 1);
+  std::nth_element(samples.begin(), samples.begin() + index,
+                   samples.begin() + count);
+  return std::chrono::microseconds(samples[index]);
+}
+
+}  // namespace netkit::http
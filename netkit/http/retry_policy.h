@@ -0,0 +1,168 @@
+#pragma once
+#include <boost/beast/http/verb.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace netkit::http {
+
+// How ClientPool::AsyncSendRequest() retries. The default sends once without
+// a deadline, as a single client does.
+class RetryPolicy {
+  using Self = RetryPolicy;
+
+ public:
+  std::size_t max_attempts() const noexcept { return max_attempts_; }
+
+  // Attempts of a request, retries and hedges included. Only idempotent
+  // methods are retried.
+  Self& set_max_attempts(std::size_t val) noexcept {
+    max_attempts_ = val > 0 ? val : 1;
+    return *this;
+  }
+
+  std::chrono::milliseconds deadline() const noexcept { return deadline_; }
+
+  // For the whole request, every attempt included, 0 for none. The request
+  // then completes with boost::beast::error::timeout, as a client past one
+  // of its ClientTimeouts does.
+  Self& set_deadline(const std::chrono::milliseconds& val) noexcept {
+    deadline_ = val;
+    return *this;
+  }
+
+  std::chrono::milliseconds backoff_base() const noexcept {
+    return backoff_base_;
+  }
+
+  std::chrono::milliseconds backoff_max() const noexcept {
+    return backoff_max_;
+  }
+
+  // Exponential with full jitter, see Backoff()
+  Self& set_backoff(const std::chrono::milliseconds& base,
+                    const std::chrono::milliseconds& max) noexcept {
+    backoff_base_ = base;
+    backoff_max_ = max;
+    return *this;
+  }
+
+  const std::vector<unsigned>& retry_statuses() const noexcept {
+    return retry_statuses_;
+  }
+
+  // Responses retried like errors, the last one is returned when no
+  // attempt is left
+  Self& set_retry_statuses(const std::vector<unsigned>& val) {
+    retry_statuses_ = val;
+    return *this;
+  }
+
+  double hedge_percentile() const noexcept { return hedge_percentile_; }
+
+  std::chrono::milliseconds hedge_min_delay() const noexcept {
+    return hedge_min_delay_;
+  }
+
+  // A second attempt of an idempotent request is sent on another
+  // connection once the first one takes longer than this percentile of the
+  // latencies of the host (0.95...), and not before min_delay. The first
+  // response wins and the other attempt is cancelled. 0 disables it.
+  Self& set_hedging(double percentile,
+                    const std::chrono::milliseconds& min_delay =
+                        std::chrono::milliseconds(1)) noexcept {
+    hedge_percentile_ = percentile;
+    hedge_min_delay_ = min_delay;
+    return *this;
+  }
+
+  double budget_tokens() const noexcept { return budget_tokens_; }
+
+  double budget_ratio() const noexcept { return budget_ratio_; }
+
+  // See RetryBudget, set on the policy of the pool
+  Self& set_budget(double max_tokens, double token_ratio) noexcept {
+    budget_tokens_ = max_tokens;
+    budget_ratio_ = token_ratio;
+    return *this;
+  }
+
+  // Delay before the given retry (1 for the first one), random between 0
+  // and base * 2^(retry - 1) capped to max
+  std::chrono::milliseconds Backoff(std::size_t retry) const;
+
+  bool IsRetryStatus(unsigned status) const noexcept;
+
+  // GET, HEAD, OPTIONS, TRACE, PUT and DELETE
+  static bool IsIdempotent(boost::beast::http::verb method) noexcept;
+
+ private:
+  std::size_t max_attempts_ = 1;
+  std::chrono::milliseconds deadline_{0};
+  std::chrono::milliseconds backoff_base_{25};
+  std::chrono::milliseconds backoff_max_{1000};
+  std::vector<unsigned> retry_statuses_ = {502, 503, 504};
+  double hedge_percentile_ = 0;
+  std::chrono::milliseconds hedge_min_delay_{1};
+  double budget_tokens_ = 10;
+  double budget_ratio_ = 0.1;
+};
+
+// Retry throttling shared by the requests of a host, as gRPC does: a
+// failure takes a token, a success gives token_ratio back, and retries or
+// hedges are only sent while more than half the tokens are left. A failing
+// host then gets about one attempt per request.
+class RetryBudget {
+ public:
+  RetryBudget(double max_tokens, double token_ratio) noexcept
+      : max_(static_cast<std::int64_t>(max_tokens * kScale)),
+        ratio_(static_cast<std::int64_t>(token_ratio * kScale)),
+        tokens_(max_) {}
+
+  void OnSuccess() noexcept { Add(ratio_); }
+
+  void OnFailure() noexcept { Add(-kScale); }
+
+  bool AllowRetry() const noexcept {
+    return tokens_.load(std::memory_order_relaxed) * 2 > max_;
+  }
+
+  double tokens() const noexcept {
+    return static_cast<double>(tokens_.load(std::memory_order_relaxed)) /
+           kScale;
+  }
+
+ private:
+  static constexpr std::int64_t kScale = 1000;
+
+  void Add(std::int64_t delta) noexcept;
+
+  const std::int64_t max_;
+  const std::int64_t ratio_;
+  std::atomic<std::int64_t> tokens_;
+};
+
+// Latencies of the last responses of a host, for the hedging delay
+class LatencyTracker {
+ public:
+  static constexpr std::size_t kSamples = 256;
+  // Fewer samples give no percentile
+  static constexpr std::size_t kMinSamples = 16;
+
+  void Record(std::chrono::microseconds latency) noexcept;
+
+  // percentile in (0, 1]
+  std::optional<std::chrono::microseconds> Percentile(double percentile) const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::array<std::int64_t, kSamples> samples_{};
+  std::size_t count_ = 0;
+  std::size_t next_ = 0;
+};
+
+}  // namespace netkit::http
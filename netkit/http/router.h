@@ -4,6 +4,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time.hpp>
 #include <boost/lexical_cast.hpp>
+#include <deque>
 #include <memory>
 #include <optional>
 #include <regex>
@@ -287,6 +288,11 @@ class BasicRouter {
 
     const std::string& regex_path() const noexcept { return regex_path_; }
 
+    // Path of the first AddRoute() of the item, as written there
+    const std::string& pattern() const noexcept { return pattern_; }
+
+    void set_pattern(const std::string& pattern) { pattern_ = pattern; }
+
     template <class Function>
     void AddHandleFunc(std::size_t path_arg_num, MethodList allowed_methods,
                        ParamList capture_params, Function&& func) {
@@ -330,6 +336,7 @@ class BasicRouter {
    private:
     std::regex regex_;
     std::string regex_path_;
+    std::string pattern_;
     std::unordered_map<std::string, BinderList> allowed_method_binders_;
   };
 
@@ -397,6 +404,10 @@ class BasicRouter {
       }
     }
 
+    if (item_ptr->pattern().empty()) {
+      item_ptr->set_pattern(path);
+    }
+
     for (auto& method : allowed_methods) {
       util::ToUpper(method);
     }
@@ -423,6 +434,15 @@ class BasicRouter {
 
   Ret Routing(PreArgs&&... pre_args, const std::string& method,
               std::string_view target) {
+    return Routing(std::forward<PreArgs>(pre_args)..., method, target,
+                   [](const std::string&) {});
+  }
+
+  // on_match gets the pattern of the matched route before its handler runs,
+  // the pattern stays valid as long as the router
+  template <class OnMatch>
+  Ret Routing(PreArgs&&... pre_args, const std::string& method,
+              std::string_view target, OnMatch&& on_match) {
     std::string_view path_sv, param_sv;
     auto pos = target.find('?');
     if (pos != std::string_view::npos) {
@@ -447,6 +467,7 @@ class BasicRouter {
     if (!route->IsAllowedMethod(method)) {
       throw std::runtime_error("Method not allowed");
     }
+    on_match(route->pattern());
     ArgumentMap arg_map;
     while (param_sv.size() > 0) {
       std::string_view kv_sv;
@@ -475,7 +496,8 @@ class BasicRouter {
   }
 
  private:
-  std::vector<RouteItem> route_vec_;
+  // Stable addresses for the patterns handed out by Routing()
+  std::deque<RouteItem> route_vec_;
   std::unordered_map<std::string, RouteItem> route_map_;
 };
 
@@ -2,8 +2,19 @@
 #include <netkit/http/connection.h>
 #include <netkit/http/router.h>
 #include <netkit/io_context_pool.h>
+#include <netkit/local/handoff.h>
+#include <netkit/local/listener.h>
+#include <netkit/ssl/certificate_store.h>
+#include <netkit/ssl/ktls.h>
+#include <netkit/ssl/session_manager.h>
 #include <netkit/tcp/listener.h>
 
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
 namespace netkit::http {
 
 template <class T>
@@ -26,41 +37,231 @@ class BasicServer : public std::enable_shared_from_this<BasicServer<T>> {
         "<DetectConnection>");
   }
 
+  // Certificates selected by SNI server name, connections are created from
+  // the front context of the store
+  BasicServer(IoContextPool& pool, ssl::CertificateStore& store) noexcept
+      : listener_(pool), ssl_ctx_(&store.front()), store_(&store) {
+    static_assert(
+        std::is_same_v<T, SslConnection> || std::is_same_v<T, DetectConnection>,
+        "The connection type must be <SslConnection> or "
+        "<DetectConnection>");
+  }
+
   ~BasicServer() noexcept {}
 
   Settings& settings() noexcept { return settings_; }
 
+  // Session id cache and stateless tickets with timed key rotation, the
+  // handshake counters are available through Settings::handshake_stats()
+  void EnableSessionResumption(const ssl::SessionOptions& options = {}) {
+    static_assert(!std::is_same_v<T, PlainConnection>,
+                  "Session resumption requires an ssl context");
+    session_manager_ = std::make_unique<ssl::SessionManager>(options);
+    Configure([manager = session_manager_.get()](SSL_CTX* ctx) {
+      manager->Attach(ctx);
+    });
+  }
+
+  // Installs the negotiated keys on the socket after the handshake so that
+  // responses are encrypted by the kernel (Linux, AES-GCM with TLS 1.2/1.3),
+  // connections which can't be offloaded keep using OpenSSL
+  void EnableKtls() {
+    static_assert(!std::is_same_v<T, PlainConnection>,
+                  "Kernel TLS requires an ssl context");
+    Configure([](SSL_CTX* ctx) { ssl::PrepareKtls(ctx); });
+    settings_.set_ktls(true);
+  }
+
+  // HTTP/2 negotiated by ALPN over TLS, and over cleartext for clients with
+  // prior knowledge. Routes and filters are shared with HTTP/1.x.
+  void EnableHttp2(const Http2Settings& options = {}) {
+    if constexpr (!std::is_same_v<T, PlainConnection>) {
+      Configure([](SSL_CTX* ctx) { http2::EnableAlpn(ctx); });
+    }
+    settings_.set_http2(options);
+  }
+
   template <class Function>
   void HandleFunc(const std::string& target, Function&& func,
                   const std::vector<std::string>& allowed_methods = {}) {
     router_.AddRoute(target, std::forward<Function>(func), allowed_methods);
   }
 
+  // reuse_port accepts on every thread of the pool, see tcp::Listener
   void ListenAndServe(const std::string& address, std::uint16_t port,
-                      bool reuse_address = true) {
-    listener_.ListenAndAccept(
-        address, port, reuse_address,
-        [this, self = Self::shared_from_this()](
-            boost::asio::ip::tcp::socket&& socket) {
-          boost::beast::tcp_stream stream(std::move(socket));
-          stream.expires_after(settings_.read_timeout());
-          std::make_shared<T>(std::move(stream), *ssl_ctx_,
-                              boost::beast::flat_buffer{}, settings_, router_)
-              ->Run();
+                      bool reuse_address = true, bool reuse_port = false) {
+    listener_.set_socket_options(settings_.socket_options());
+    listener_.ListenAndAccept(address, port, reuse_address, reuse_port,
+                              [this, self = Self::shared_from_this()](
+                                  boost::asio::ip::tcp::socket&& socket) {
+                                Serve(std::move(socket));
+                              });
+  }
+
+  // Accepts on listening sockets bound elsewhere, by a Supervisor or a
+  // previous process, which the server owns from then on. See
+  // tcp::Listener::Adopt() for how they are spread over the pool.
+  void ServeListeners(const std::vector<tcp::Listener::NativeHandle>& fds) {
+    listener_.set_socket_options(settings_.socket_options());
+    listener_.Adopt(fds, [this, self = Self::shared_from_this()](
+                             boost::asio::ip::tcp::socket&& socket) {
+      Serve(std::move(socket));
+    });
+  }
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  // Unix domain socket with the same routes and filters, "@name" listens in
+  // the Linux abstract namespace. Connections are served in cleartext
+  // (HTTP/1.x, HTTP/2 with prior knowledge) whatever the server type, see
+  // Context::peer_credentials() to tell the clients apart.
+  void ListenAndServeLocal(const std::string& path) {
+    local_listener_ = std::make_unique<local::Listener>(listener_.pool());
+    local_listener_->ListenAndAccept(
+        path, [this, self = Self::shared_from_this()](local::Socket&& socket) {
+          Start<LocalConnection>(local::Stream(std::move(socket)));
         });
   }
 
+  // Zero-downtime restart, old process. The TCP listening sockets are handed
+  // to the process calling ListenAndServeHandoff() with the same path. Once it
+  // confirms that it accepts on them, this server stops accepting and
+  // on_handoff runs, typically to drain the connections and exit. A failed
+  // handoff keeps the server listening for another successor.
+  void ExposeListeners(const std::string& path,
+                       std::function<void()>&& on_handoff = nullptr) {
+    handoff_path_ = path;
+    on_handoff_ = std::move(on_handoff);
+    handoff_listener_ = std::make_unique<local::Listener>(listener_.pool());
+    DoExpose();
+  }
+
+  // Zero-downtime restart, new process. Accepts on the listening sockets of
+  // the process exposing them on path without binding again, false when no
+  // process does (ListenAndServe() is then the way to go).
+  bool ListenAndServeHandoff(const std::string& path) {
+    local::Socket socket(listener_.pool().Get());
+    boost::system::error_code ec;
+    socket.connect(local::MakeEndpoint(path), ec);
+    if (ec) {
+      return false;
+    }
+    ServeListeners(local::ReceiveDescriptors(socket));
+    // Accepting from now on, the old process may stop
+    char ack = 1;
+    boost::asio::write(socket, boost::asio::buffer(&ack, 1));
+    return true;
+  }
+#endif
+
   void Close() noexcept {
-    boost::asio::post(
-        listener_.executor(),
-        [this, self = Self::shared_from_this()]() { listener_.Close(); });
+    for (std::size_t i = 0; i < listener_.size(); ++i) {
+      boost::asio::post(
+          listener_.executor(i),
+          [this, self = Self::shared_from_this(), i]() { listener_.Close(i); });
+    }
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (local_listener_) {
+      boost::asio::post(local_listener_->executor(),
+                        [this, self = Self::shared_from_this()]() {
+                          local_listener_->Close();
+                        });
+    }
+    if (handoff_listener_) {
+      boost::asio::post(handoff_listener_->executor(),
+                        [this, self = Self::shared_from_this()]() {
+                          handoff_listener_->Close();
+                        });
+    }
+#endif
+  }
+
+ private:
+  void Serve(boost::asio::ip::tcp::socket&& socket) {
+    Start<T>(boost::beast::tcp_stream(std::move(socket)));
+  }
+
+  // The connection lives in the arena of the context serving it
+  template <class Connection, class Stream>
+  void Start(Stream&& stream) {
+    auto& pool = listener_.pool();
+    auto index = pool.IndexOf(stream.get_executor());
+    auto lease = pool.Track(stream.get_executor());
+    stream.expires_after(settings_.read_timeout());
+    std::allocate_shared<Connection>(
+        std::pmr::polymorphic_allocator<Connection>(pool.arena(index)),
+        std::move(stream), *ssl_ctx_, boost::beast::flat_buffer{}, settings_,
+        router_, std::move(lease))
+        ->Run();
+  }
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  void DoExpose() {
+    handoff_listener_->ListenAndAccept(
+        handoff_path_,
+        [this, self = Self::shared_from_this()](local::Socket&& socket) {
+          Handoff(std::move(socket));
+        });
+  }
+
+  void Handoff(local::Socket&& socket) {
+    // One successor at a time, it also frees the path for the successor
+    handoff_listener_->Close();
+    auto successor = std::make_shared<local::Socket>(std::move(socket));
+    try {
+      local::SendDescriptors(*successor, listener_.native_handles());
+    } catch (const std::exception&) {
+      return RetryExpose();
+    }
+    auto ack = std::make_shared<char>();
+    boost::asio::async_read(
+        *successor, boost::asio::buffer(ack.get(), 1),
+        [this, self = Self::shared_from_this(), successor, ack](
+            const boost::system::error_code& ec, std::size_t) {
+          if (ec) {
+            // The successor is gone before accepting
+            return RetryExpose();
+          }
+          Close();
+          if (on_handoff_) {
+            on_handoff_();
+          }
+        });
+  }
+
+  void RetryExpose() {
+    boost::asio::post(handoff_listener_->executor(),
+                      [this, self = Self::shared_from_this()]() {
+                        try {
+                          DoExpose();
+                        } catch (const std::exception&) {
+                          // The path is taken, no more handoffs
+                        }
+                      });
+  }
+#endif
+
+  // Applies to every context the connections may switch to
+  void Configure(const ssl::CertificateStore::Configurator& func) {
+    if (store_) {
+      store_->AddConfigurator(func);
+    } else {
+      func(ssl_ctx_->native_handle());
+    }
   }
 
  private:
   Router router_;
   Settings settings_;
   tcp::Listener listener_;
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  std::unique_ptr<local::Listener> local_listener_;
+  std::unique_ptr<local::Listener> handoff_listener_;
+  std::string handoff_path_;
+  std::function<void()> on_handoff_;
+#endif
   boost::asio::ssl::context* ssl_ctx_ = nullptr;
+  ssl::CertificateStore* store_ = nullptr;
+  std::unique_ptr<ssl::SessionManager> session_manager_;
 };
 
 // Only for http
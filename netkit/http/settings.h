@@ -1,14 +1,77 @@
 #pragma once
+#include <netkit/ssl/handshake_stats.h>
+#include <netkit/tcp/socket_options.h>
+
 #include <chrono>
 #include <memory>
 #include <optional>
 #include <string>
 #include <vector>
 
+namespace netkit {
+class IoContextPool;
+}  // namespace netkit
+
 namespace netkit::http {
 
 class Filter;
 
+class Http2Settings {
+ public:
+  std::uint32_t max_concurrent_streams() const noexcept {
+    return max_concurrent_streams_;
+  }
+
+  Http2Settings& set_max_concurrent_streams(std::uint32_t val) noexcept {
+    max_concurrent_streams_ = val;
+    return *this;
+  }
+
+  // Flow control window of each request body
+  std::uint32_t stream_window_size() const noexcept {
+    return stream_window_size_;
+  }
+
+  Http2Settings& set_stream_window_size(std::uint32_t val) noexcept {
+    stream_window_size_ = val;
+    return *this;
+  }
+
+  // Flow control window shared by the request bodies of a connection
+  std::uint32_t connection_window_size() const noexcept {
+    return connection_window_size_;
+  }
+
+  Http2Settings& set_connection_window_size(std::uint32_t val) noexcept {
+    connection_window_size_ = val;
+    return *this;
+  }
+
+  std::uint32_t max_frame_size() const noexcept { return max_frame_size_; }
+
+  Http2Settings& set_max_frame_size(std::uint32_t val) noexcept {
+    max_frame_size_ = val;
+    return *this;
+  }
+
+  // HPACK dynamic table of the request headers
+  std::uint32_t header_table_size() const noexcept {
+    return header_table_size_;
+  }
+
+  Http2Settings& set_header_table_size(std::uint32_t val) noexcept {
+    header_table_size_ = val;
+    return *this;
+  }
+
+ private:
+  std::uint32_t max_concurrent_streams_ = 100;
+  std::uint32_t stream_window_size_ = 1024 * 1024;
+  std::uint32_t connection_window_size_ = 4 * 1024 * 1024;
+  std::uint32_t max_frame_size_ = 16384;
+  std::uint32_t header_table_size_ = 4096;
+};
+
 class Settings {
  public:
   using FilterList = std::vector<std::shared_ptr<Filter>>;
@@ -38,8 +101,68 @@ class Settings {
     return *this;
   }
 
+  // Kernel TLS for the outgoing records of https connections, see
+  // BasicServer::EnableKtls()
+  bool ktls() const noexcept { return ktls_; }
+
+  Settings& set_ktls(bool val) noexcept {
+    ktls_ = val;
+    return *this;
+  }
+
+  // HTTP/2 is spoken when set, see BasicServer::EnableHttp2()
+  const std::optional<Http2Settings>& http2() const noexcept { return http2_; }
+
+  Settings& set_http2(const std::optional<Http2Settings>& val) noexcept {
+    http2_ = val;
+    return *this;
+  }
+
+  // Listening socket and accepted connections, applied by ListenAndServe()
+  const tcp::SocketOptions& socket_options() const noexcept {
+    return socket_options_;
+  }
+
+  Settings& set_socket_options(const tcp::SocketOptions& val) {
+    socket_options_ = val;
+    return *this;
+  }
+
   const FilterList& filters() const noexcept { return filters_; }
 
+  // Pool running the TLS handshakes, nullptr runs them on the io_context of
+  // the connection. The connection moves back to its own io_context after the
+  // handshake.
+  IoContextPool* handshake_pool() const noexcept { return handshake_pool_; }
+
+  Settings& set_handshake_pool(IoContextPool* val) noexcept {
+    handshake_pool_ = val;
+    return *this;
+  }
+
+  // Maximum number of handshakes in progress, new connections wait for a
+  // slot beyond it. 0 means no limit.
+  std::uint32_t handshake_limit() const noexcept { return handshake_limit_; }
+
+  Settings& set_handshake_limit(std::uint32_t val) noexcept {
+    handshake_limit_ = val;
+    return *this;
+  }
+
+  // Connections waiting for a handshake slot, the next ones are closed
+  std::uint32_t handshake_queue_limit() const noexcept {
+    return handshake_queue_limit_;
+  }
+
+  Settings& set_handshake_queue_limit(std::uint32_t val) noexcept {
+    handshake_queue_limit_ = val;
+    return *this;
+  }
+
+  ssl::HandshakeStats& handshake_stats() const noexcept {
+    return *handshake_stats_;
+  }
+
   Settings& AddFilter(const std::shared_ptr<Filter>& filter) {
     filters_.emplace_back(filter);
     return *this;
@@ -49,7 +172,15 @@ class Settings {
   std::uint32_t header_limit_ = 8 * 1024;
   std::optional<std::uint64_t> body_limit_ = 1024 * 1024;
   std::chrono::milliseconds read_timeout_ = std::chrono::seconds(60);
+  bool ktls_ = false;
+  std::optional<Http2Settings> http2_;
+  tcp::SocketOptions socket_options_;
+  IoContextPool* handshake_pool_ = nullptr;
+  std::uint32_t handshake_limit_ = 0;
+  std::uint32_t handshake_queue_limit_ = 1024;
   FilterList filters_;
+  std::shared_ptr<ssl::HandshakeStats> handshake_stats_ =
+      std::make_shared<ssl::HandshakeStats>();
 };
 
 }  // namespace netkit::http
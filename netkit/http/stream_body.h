@@ -0,0 +1,146 @@
+#pragma once
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/http/file_body.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+namespace netkit::http {
+
+// Request body pulled from a producer while it is sent, one chunk at a
+// time. Set content_length() when the size is known, prepare_payload()
+// sends it chunked otherwise. Files are sent with
+// boost::beast::http::file_body.
+struct ProducerBody {
+  // Fills up to size bytes of data and returns how many, 0 at the end
+  using Producer = std::function<std::size_t(
+      char* data, std::size_t size, boost::system::error_code& ec)>;
+
+  // Move only, a producer runs once
+  class value_type {
+   public:
+    value_type() = default;
+    value_type(value_type&&) = default;
+    value_type& operator=(value_type&&) = default;
+    value_type(const value_type&) = delete;
+    value_type& operator=(const value_type&) = delete;
+
+    Producer producer;
+    // Memory held while sending
+    std::size_t chunk_size = 64 * 1024;
+  };
+
+  class writer {
+   public:
+    using const_buffers_type = boost::asio::const_buffer;
+
+    template <bool isRequest, class Fields>
+    writer(boost::beast::http::header<isRequest, Fields>&,
+           value_type& body) noexcept
+        : body_(body) {}
+
+    void init(boost::system::error_code& ec) {
+      buffer_.resize(std::max<std::size_t>(body_.chunk_size, 1));
+      ec = {};
+    }
+
+    boost::optional<std::pair<const_buffers_type, bool>> get(
+        boost::system::error_code& ec) {
+      ec = {};
+      if (!body_.producer) {
+        return boost::none;
+      }
+      auto size = body_.producer(buffer_.data(), buffer_.size(), ec);
+      if (ec || size == 0) {
+        return boost::none;
+      }
+      return {{const_buffers_type(buffer_.data(), size), true}};
+    }
+
+   private:
+    value_type& body_;
+    std::vector<char> buffer_;
+  };
+};
+
+// Response body handed to a sink as it arrives, never held whole. The
+// client reads no further until the sink returns, an error from the sink
+// fails the request. Files are received with boost::beast::http::file_body.
+struct SinkBody {
+  using Sink = std::function<void(const char* data, std::size_t size,
+                                  boost::system::error_code& ec)>;
+
+  // Move only, a response is received once
+  class value_type {
+   public:
+    value_type() = default;
+    value_type(value_type&&) = default;
+    value_type& operator=(value_type&&) = default;
+    value_type(const value_type&) = delete;
+    value_type& operator=(const value_type&) = delete;
+
+    Sink sink;
+  };
+
+  class reader {
+   public:
+    template <bool isRequest, class Fields>
+    reader(boost::beast::http::header<isRequest, Fields>&,
+           value_type& body) noexcept
+        : body_(body) {}
+
+    void init(const boost::optional<std::uint64_t>&,
+              boost::system::error_code& ec) noexcept {
+      ec = {};
+    }
+
+    template <class ConstBufferSequence>
+    std::size_t put(const ConstBufferSequence& buffers,
+                    boost::system::error_code& ec) {
+      ec = {};
+      std::size_t size = 0;
+      for (auto it = boost::asio::buffer_sequence_begin(buffers);
+           it != boost::asio::buffer_sequence_end(buffers); ++it) {
+        boost::asio::const_buffer buffer = *it;
+        if (body_.sink) {
+          body_.sink(static_cast<const char*>(buffer.data()), buffer.size(),
+                     ec);
+          if (ec) {
+            break;
+          }
+        }
+        size += buffer.size();
+      }
+      return size;
+    }
+
+    void finish(boost::system::error_code& ec) noexcept { ec = {}; }
+
+   private:
+    value_type& body_;
+  };
+};
+
+// Bodies streamed instead of held in memory. A client reads them without
+// the body limit, keeps them across attempts and doesn't send them twice.
+template <class Body>
+struct IsStreamBody : std::false_type {};
+
+template <>
+struct IsStreamBody<ProducerBody> : std::true_type {};
+
+template <>
+struct IsStreamBody<SinkBody> : std::true_type {};
+
+template <class File>
+struct IsStreamBody<boost::beast::http::basic_file_body<File>>
+    : std::true_type {};
+
+template <class Body>
+inline constexpr bool kIsStreamBody = IsStreamBody<Body>::value;
+
+}  // namespace netkit::http
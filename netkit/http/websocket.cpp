@@ -0,0 +1,108 @@
+#include "websocket.h"
+
+namespace netkit::http {
+
+bool WebSocket::Send(std::string&& data, bool binary) {
+  return Enqueue({std::move(data), nullptr, binary});
+}
+
+bool WebSocket::Send(const std::string& data, bool binary) {
+  return Enqueue({data, nullptr, binary});
+}
+
+bool WebSocket::Send(const std::shared_ptr<const std::string>& data,
+                     bool binary) {
+  return Enqueue({std::string(), data, binary});
+}
+
+void WebSocket::Close(boost::beast::websocket::close_code code) {
+  {
+    std::lock_guard lock(mutex_);
+    if (closing_) {
+      return;
+    }
+    closing_ = true;
+    close_code_ = code;
+    if (writing_) {
+      return;
+    }
+    writing_ = true;
+  }
+  Post();
+}
+
+void WebSocket::Opened() {
+  if (options_.on_open()) {
+    options_.on_open()(shared_from_this());
+  }
+  Post();
+}
+
+bool WebSocket::TakeBatch(
+    MessageQueue& batch,
+    std::optional<boost::beast::websocket::close_code>& close) {
+  std::lock_guard lock(mutex_);
+  if (!pending_.empty()) {
+    batch.swap(pending_);
+    return true;
+  }
+  if (close_code_) {
+    close = close_code_;
+    close_code_.reset();
+    return true;
+  }
+  writing_ = false;
+  return false;
+}
+
+void WebSocket::Sent(std::size_t size) {
+  auto queued = queued_bytes_.fetch_sub(size, std::memory_order_relaxed) - size;
+  if (queued <= options_.low_water_mark() &&
+      dropped_.exchange(false, std::memory_order_relaxed)) {
+    if (options_.on_drain()) {
+      options_.on_drain()(shared_from_this());
+    }
+  }
+}
+
+void WebSocket::Abort(std::size_t unsent) {
+  std::lock_guard lock(mutex_);
+  closing_ = true;
+  close_code_.reset();
+  for (const auto& msg : pending_) {
+    unsent += msg.view().size();
+  }
+  pending_.clear();
+  queued_bytes_.fetch_sub(unsent, std::memory_order_relaxed);
+}
+
+void WebSocket::Closed(const boost::beast::error_code& ec) {
+  if (options_.on_close()) {
+    options_.on_close()(shared_from_this(), ec);
+  }
+}
+
+bool WebSocket::Enqueue(Message&& msg) {
+  auto size = msg.view().size();
+  {
+    std::lock_guard lock(mutex_);
+    if (closing_) {
+      return false;
+    }
+    if (queued_bytes_.load(std::memory_order_relaxed) >=
+        options_.high_water_mark()) {
+      dropped_.store(true, std::memory_order_relaxed);
+      return false;
+    }
+    queued_bytes_.fetch_add(size, std::memory_order_relaxed);
+    pending_.emplace_back(std::move(msg));
+    if (writing_) {
+      return true;
+    }
+    writing_ = true;
+  }
+  Post();
+  return true;
+}
+
+}  // namespace netkit::http
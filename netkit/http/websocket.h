@@ -0,0 +1,488 @@
+#pragma once
+#include <netkit/io_context_pool.h>
+
+#include <any>
+#include <atomic>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace netkit::http {
+
+class WebSocket;
+
+class WebSocketOptions {
+ public:
+  using OpenHandler = std::function<void(const std::shared_ptr<WebSocket>&)>;
+  // The data is only valid during the call
+  using MessageHandler = std::function<void(
+      const std::shared_ptr<WebSocket>&, std::string_view data, bool binary)>;
+  using DrainHandler = std::function<void(const std::shared_ptr<WebSocket>&)>;
+  using CloseHandler = std::function<void(const std::shared_ptr<WebSocket>&,
+                                          const boost::beast::error_code&)>;
+
+  // Send() drops messages while this many bytes are queued
+  std::size_t high_water_mark() const noexcept { return high_water_mark_; }
+
+  WebSocketOptions& set_high_water_mark(std::size_t val) noexcept {
+    high_water_mark_ = val;
+    return *this;
+  }
+
+  // on_drain is called once the queue falls to this size after a drop
+  std::size_t low_water_mark() const noexcept { return low_water_mark_; }
+
+  WebSocketOptions& set_low_water_mark(std::size_t val) noexcept {
+    low_water_mark_ = val;
+    return *this;
+  }
+
+  // Frames of queued messages are coalesced into writes of up to this size,
+  // 0 writes every frame on its own
+  std::size_t write_batch_size() const noexcept { return write_batch_size_; }
+
+  WebSocketOptions& set_write_batch_size(std::size_t val) noexcept {
+    write_batch_size_ = val;
+    return *this;
+  }
+
+  std::size_t message_limit() const noexcept { return message_limit_; }
+
+  WebSocketOptions& set_message_limit(std::size_t val) noexcept {
+    message_limit_ = val;
+    return *this;
+  }
+
+  // The socket is pinged after this long without incoming data and closed
+  // if the peer stays silent for as long again
+  const std::chrono::seconds& idle_timeout() const noexcept {
+    return idle_timeout_;
+  }
+
+  WebSocketOptions& set_idle_timeout(const std::chrono::seconds& val) noexcept {
+    idle_timeout_ = val;
+    return *this;
+  }
+
+  bool permessage_deflate() const noexcept { return permessage_deflate_; }
+
+  WebSocketOptions& set_permessage_deflate(bool val) noexcept {
+    permessage_deflate_ = val;
+    return *this;
+  }
+
+  int deflate_level() const noexcept { return deflate_level_; }
+
+  WebSocketOptions& set_deflate_level(int val) noexcept {
+    deflate_level_ = val;
+    return *this;
+  }
+
+  int deflate_window_bits() const noexcept { return deflate_window_bits_; }
+
+  WebSocketOptions& set_deflate_window_bits(int val) noexcept {
+    deflate_window_bits_ = val;
+    return *this;
+  }
+
+  // Keeping the compression window between messages compresses better but
+  // holds the deflate state for the life of the socket
+  bool deflate_context_takeover() const noexcept {
+    return deflate_context_takeover_;
+  }
+
+  WebSocketOptions& set_deflate_context_takeover(bool val) noexcept {
+    deflate_context_takeover_ = val;
+    return *this;
+  }
+
+  const OpenHandler& on_open() const noexcept { return on_open_; }
+
+  WebSocketOptions& set_on_open(const OpenHandler& val) {
+    on_open_ = val;
+    return *this;
+  }
+
+  const MessageHandler& on_message() const noexcept { return on_message_; }
+
+  WebSocketOptions& set_on_message(const MessageHandler& val) {
+    on_message_ = val;
+    return *this;
+  }
+
+  const DrainHandler& on_drain() const noexcept { return on_drain_; }
+
+  WebSocketOptions& set_on_drain(const DrainHandler& val) {
+    on_drain_ = val;
+    return *this;
+  }
+
+  const CloseHandler& on_close() const noexcept { return on_close_; }
+
+  WebSocketOptions& set_on_close(const CloseHandler& val) {
+    on_close_ = val;
+    return *this;
+  }
+
+ private:
+  std::size_t high_water_mark_ = 1024 * 1024;
+  std::size_t low_water_mark_ = 256 * 1024;
+  std::size_t write_batch_size_ = 16 * 1024;
+  std::size_t message_limit_ = 16 * 1024 * 1024;
+  std::chrono::seconds idle_timeout_ = std::chrono::seconds(300);
+  bool permessage_deflate_ = false;
+  int deflate_level_ = 8;
+  int deflate_window_bits_ = 15;
+  bool deflate_context_takeover_ = true;
+  OpenHandler on_open_;
+  MessageHandler on_message_;
+  DrainHandler on_drain_;
+  CloseHandler on_close_;
+};
+
+// Server side of an upgraded connection. Send() and Close() may be called
+// from any thread, the handlers run on the io_context of the connection.
+class WebSocket : public std::enable_shared_from_this<WebSocket> {
+  using Self = WebSocket;
+
+ public:
+  using Ptr = std::shared_ptr<Self>;
+
+  explicit WebSocket(const WebSocketOptions& options) : options_(options) {}
+
+  virtual ~WebSocket() noexcept {}
+
+  const WebSocketOptions& options() const noexcept { return options_; }
+
+  // Bytes accepted by Send() and not written yet
+  std::size_t queued_bytes() const noexcept {
+    return queued_bytes_.load(std::memory_order_relaxed);
+  }
+
+  // Returns false if the message was dropped, because the queue is above the
+  // high-water mark or the socket is closing
+  bool Send(std::string&& data, bool binary = false);
+
+  bool Send(const std::string& data, bool binary = false);
+
+  // Shares one payload between sockets, for broadcasts
+  bool Send(const std::shared_ptr<const std::string>& data,
+            bool binary = false);
+
+  // Closes the socket once the queued messages are written
+  void Close(boost::beast::websocket::close_code code =
+                 boost::beast::websocket::close_code::normal);
+
+  void set_user_data(std::any&& data) noexcept { user_data_ = std::move(data); }
+
+  template <class T>
+  T* try_get_user_data() noexcept {
+    if (user_data_.has_value()) {
+      try {
+        return std::any_cast<T>(&user_data_);
+      } catch (const std::exception&) {
+      }
+    }
+    return nullptr;
+  }
+
+ protected:
+  struct Message {
+    std::string data;
+    std::shared_ptr<const std::string> shared;
+    bool binary = false;
+
+    std::string_view view() const noexcept {
+      return shared ? std::string_view(*shared) : std::string_view(data);
+    }
+  };
+
+  using MessageQueue = std::deque<Message>;
+
+  // Runs Flush() on the io_context of the connection
+  virtual void Post() = 0;
+
+  // Called after the handshake, the messages sent so far are written next
+  void Opened();
+
+  // Moves the queued messages into batch, or sets close when only the close
+  // frame is left. Returns false when there is nothing to write, the writer
+  // is idle until the next Send() or Close().
+  bool TakeBatch(MessageQueue& batch,
+                 std::optional<boost::beast::websocket::close_code>& close);
+
+  void Sent(std::size_t size);
+
+  // Drops the queue and rejects further messages, unsent is the size of the
+  // taken messages that will not be written
+  void Abort(std::size_t unsent = 0);
+
+  void Closed(const boost::beast::error_code& ec);
+
+ private:
+  bool Enqueue(Message&& msg);
+
+ private:
+  WebSocketOptions options_;
+  std::mutex mutex_;
+  MessageQueue pending_;
+  std::optional<boost::beast::websocket::close_code> close_code_;
+  bool writing_ = true;
+  bool closing_ = false;
+  std::atomic<std::size_t> queued_bytes_ = 0;
+  std::atomic<bool> dropped_ = false;
+  std::any user_data_;
+};
+
+// Stream taken over from an HTTP connection. Bytes the connection read past
+// the upgrade request are served first, and writes are held back while more
+// frames of the same batch follow, so that they go out in one system call.
+template <class NextLayer>
+class UpgradeStream {
+ public:
+  using executor_type = typename NextLayer::executor_type;
+
+  UpgradeStream(NextLayer&& next_layer, boost::beast::flat_buffer&& buffer,
+                std::size_t batch_size)
+      : next_layer_(std::move(next_layer)),
+        read_buffer_(std::move(buffer)),
+        batch_size_(batch_size) {}
+
+  executor_type get_executor() noexcept { return next_layer_.get_executor(); }
+
+  NextLayer& next_layer() noexcept { return next_layer_; }
+
+  // Set while more frames are about to be written
+  void set_cork(bool val) noexcept { cork_ = val; }
+
+  template <class MutableBufferSequence, class ReadHandler>
+  auto async_read_some(const MutableBufferSequence& buffers,
+                       ReadHandler&& handler) {
+    return boost::asio::async_initiate<ReadHandler,
+                                       void(boost::beast::error_code,
+                                            std::size_t)>(
+        [this](auto&& handler, const MutableBufferSequence& buffers) {
+          if (read_buffer_.size() == 0) {
+            return next_layer_.async_read_some(buffers, std::move(handler));
+          }
+          auto size = boost::asio::buffer_copy(buffers, read_buffer_.data());
+          read_buffer_.consume(size);
+          boost::asio::post(
+              get_executor(),
+              boost::beast::bind_front_handler(
+                  std::move(handler), boost::beast::error_code(), size));
+        },
+        handler, buffers);
+  }
+
+  template <class ConstBufferSequence, class WriteHandler>
+  auto async_write_some(const ConstBufferSequence& buffers,
+                        WriteHandler&& handler) {
+    return boost::asio::async_initiate<WriteHandler,
+                                       void(boost::beast::error_code,
+                                            std::size_t)>(
+        [this](auto&& handler, const ConstBufferSequence& buffers) {
+          auto size = boost::asio::buffer_size(buffers);
+          if (cork_ && write_buffer_.size() + size <= batch_size_) {
+            write_buffer_.commit(
+                boost::asio::buffer_copy(write_buffer_.prepare(size), buffers));
+            boost::asio::post(
+                get_executor(),
+                boost::beast::bind_front_handler(
+                    std::move(handler), boost::beast::error_code(), size));
+          } else if (write_buffer_.size() == 0) {
+            next_layer_.async_write_some(buffers, std::move(handler));
+          } else {
+            auto ex = boost::asio::get_associated_executor(handler,
+                                                           get_executor());
+            boost::asio::async_write(
+                next_layer_,
+                boost::beast::buffers_cat(write_buffer_.data(), buffers),
+                boost::asio::bind_executor(
+                    ex, [this, size, handler = std::move(handler)](
+                            const boost::beast::error_code& ec,
+                            std::size_t bytes_transferred) mutable {
+                      write_buffer_.clear();
+                      std::move(handler)(ec, ec ? 0 : size);
+                    }));
+          }
+        },
+        handler, buffers);
+  }
+
+  // Writes what is held back, then tears down the next layer
+  template <class TeardownHandler>
+  void AsyncTeardown(boost::beast::role_type role, TeardownHandler&& handler) {
+    if (write_buffer_.size() == 0) {
+      using boost::beast::websocket::async_teardown;
+      return async_teardown(role, next_layer_,
+                            std::forward<TeardownHandler>(handler));
+    }
+    boost::asio::async_write(
+        next_layer_, write_buffer_.data(),
+        [this, role, handler = std::forward<TeardownHandler>(handler)](
+            const boost::beast::error_code& ec,
+            std::size_t bytes_transferred) mutable {
+          write_buffer_.clear();
+          using boost::beast::websocket::async_teardown;
+          async_teardown(role, next_layer_, std::move(handler));
+        });
+  }
+
+ private:
+  NextLayer next_layer_;
+  boost::beast::flat_buffer read_buffer_;
+  boost::beast::flat_buffer write_buffer_;
+  std::size_t batch_size_;
+  bool cork_ = false;
+};
+
+template <class NextLayer, class TeardownHandler>
+void async_teardown(boost::beast::role_type role,
+                    UpgradeStream<NextLayer>& stream,
+                    TeardownHandler&& handler) {
+  stream.AsyncTeardown(role, std::forward<TeardownHandler>(handler));
+}
+
+template <class NextLayer>
+class BasicWebSocket : public WebSocket {
+  using Self = BasicWebSocket;
+
+ public:
+  BasicWebSocket(NextLayer&& next_layer, boost::beast::flat_buffer&& buffer,
+                 const WebSocketOptions& options,
+                 IoContextPool::Lease&& lease = {})
+      : WebSocket(options),
+        ws_(std::move(next_layer), std::move(buffer),
+            options.write_batch_size()),
+        lease_(std::move(lease)) {
+    ws_.read_message_max(options.message_limit());
+    if (options.permessage_deflate()) {
+      boost::beast::websocket::permessage_deflate pmd;
+      pmd.server_enable = true;
+      pmd.compLevel = options.deflate_level();
+      pmd.server_max_window_bits = options.deflate_window_bits();
+      pmd.server_no_context_takeover = !options.deflate_context_takeover();
+      ws_.set_option(pmd);
+    }
+    auto timeout = boost::beast::websocket::stream_base::timeout::suggested(
+        boost::beast::role_type::server);
+    if (options.idle_timeout().count() > 0) {
+      timeout.idle_timeout = options.idle_timeout();
+      timeout.keep_alive_pings = true;
+    }
+    ws_.set_option(timeout);
+  }
+
+  ~BasicWebSocket() noexcept {}
+
+  // Answers the upgrade request, decorator may add fields to the response
+  template <class Request, class Decorator>
+  void Accept(const Request& req, Decorator&& decorator) {
+    ws_.set_option(boost::beast::websocket::stream_base::decorator(
+        std::forward<Decorator>(decorator)));
+    ws_.async_accept(req,
+                     [self = Shared()](const boost::beast::error_code& ec) {
+                       if (ec) {
+                         self->Abort();
+                         return;
+                       }
+                       self->Opened();
+                       self->Read();
+                     });
+    // The response is built when the accept starts, release what the
+    // decorator holds
+    ws_.set_option(boost::beast::websocket::stream_base::decorator(
+        [](boost::beast::websocket::response_type&) {}));
+  }
+
+ protected:
+  void Post() override {
+    boost::asio::post(ws_.get_executor(),
+                      [self = Shared()]() { self->Flush(); });
+  }
+
+ private:
+  std::shared_ptr<Self> Shared() noexcept {
+    return std::static_pointer_cast<Self>(shared_from_this());
+  }
+
+  void Read() {
+    ws_.async_read(read_buffer_,
+                   [self = Shared()](const boost::beast::error_code& ec,
+                                     std::size_t bytes_transferred) {
+                     self->OnRead(ec, bytes_transferred);
+                   });
+  }
+
+  void OnRead(const boost::beast::error_code& ec,
+              std::size_t bytes_transferred) {
+    if (ec) {
+      Abort();
+      return Closed(ec);
+    }
+    if (options().on_message()) {
+      auto data = read_buffer_.data();
+      options().on_message()(
+          shared_from_this(),
+          std::string_view(static_cast<const char*>(data.data()), data.size()),
+          ws_.got_binary());
+    }
+    read_buffer_.consume(bytes_transferred);
+    Read();
+  }
+
+  void Flush() {
+    if (batch_.empty()) {
+      std::optional<boost::beast::websocket::close_code> close;
+      if (!TakeBatch(batch_, close)) {
+        return;
+      }
+      if (close) {
+        ws_.async_close(*close,
+                        [self = Shared()](const boost::beast::error_code&) {});
+        return;
+      }
+    }
+    const auto& msg = batch_.front();
+    ws_.next_layer().set_cork(batch_.size() > 1);
+    ws_.binary(msg.binary);
+    ws_.async_write(boost::asio::buffer(msg.view()),
+                    [self = Shared()](const boost::beast::error_code& ec,
+                                      std::size_t bytes_transferred) {
+                      self->OnWrite(ec);
+                    });
+  }
+
+  void OnWrite(const boost::beast::error_code& ec) {
+    if (ec) {
+      std::size_t unsent = 0;
+      for (const auto& msg : batch_) {
+        unsent += msg.view().size();
+      }
+      batch_.clear();
+      Abort(unsent);
+      boost::beast::close_socket(boost::beast::get_lowest_layer(ws_));
+      return;
+    }
+    auto size = batch_.front().view().size();
+    batch_.pop_front();
+    Sent(size);
+    Flush();
+  }
+
+ private:
+  boost::beast::websocket::stream<UpgradeStream<NextLayer>> ws_;
+  boost::beast::flat_buffer read_buffer_;
+  MessageQueue batch_;
+  IoContextPool::Lease lease_;
+};
+
+}  // namespace netkit::http
@@ -1,31 +1,353 @@
 #pragma once
-#include <boost/asio.hpp>
+#include <netkit/affinity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <cerrno>
+#include <chrono>
 #include <memory>
+#include <memory_resource>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <vector>
 
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace netkit {
 
+// Load of one io_context of the pool, updated from any thread
+class IoContextLoad {
+ public:
+  // Connections counted by an IoContextPool::Lease
+  std::size_t connections() const noexcept {
+    return connections_.load(std::memory_order_relaxed);
+  }
+
+  // Handlers posted through IoContextPool::Post() which haven't run yet
+  std::size_t pending() const noexcept {
+    return pending_.load(std::memory_order_relaxed);
+  }
+
+  // How late the last probe timer ran, see IoContextPool::set_probe_interval()
+  std::chrono::microseconds lag() const noexcept {
+    return std::chrono::microseconds(lag_.load(std::memory_order_relaxed));
+  }
+
+  // The counters below are kept while the probe is enabled. Handlers run
+  // back to back are timed one by one, the handler waking up an idle thread
+  // only for the route it dispatched. A saturated thread is accounted for
+  // exactly, an idle one may look idler than it is.
+
+  // Completion handlers run by the thread since Run()
+  std::uint64_t handlers() const noexcept {
+    return handlers_.load(std::memory_order_relaxed);
+  }
+
+  // Time spent in handlers since Run()
+  std::chrono::nanoseconds busy() const noexcept {
+    return std::chrono::nanoseconds(busy_.load(std::memory_order_relaxed));
+  }
+
+  // Handlers per second over the last probe interval
+  std::uint64_t handlers_per_second() const noexcept {
+    return handlers_per_second_.load(std::memory_order_relaxed);
+  }
+
+  // Share of the last probe interval spent in handlers, from 0 to 1
+  double busy_ratio() const noexcept {
+    return busy_permille_.load(std::memory_order_relaxed) / 1000.0;
+  }
+
+  // Longest handler since Run() or ResetLongestHandler()
+  std::chrono::nanoseconds longest_handler() const noexcept {
+    return std::chrono::nanoseconds(longest_.load(std::memory_order_relaxed));
+  }
+
+  // Route pattern dispatched by the longest handler, empty when it didn't
+  // dispatch a request
+  std::string longest_route() const {
+    auto route = longest_route_.load(std::memory_order_relaxed);
+    return route ? *route : std::string();
+  }
+
+  void ResetLongestHandler() noexcept {
+    longest_.store(0, std::memory_order_relaxed);
+    longest_route_.store(nullptr, std::memory_order_relaxed);
+  }
+
+ private:
+  friend class IoContextPool;
+  friend class Watchdog;
+
+  // Only called by the thread of the context, hence no read-modify-write
+  void Record(std::chrono::nanoseconds elapsed,
+              const std::string* route) noexcept {
+    handlers_.store(handlers_.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+    busy_.store(busy_.load(std::memory_order_relaxed) + elapsed.count(),
+                std::memory_order_relaxed);
+    if (elapsed.count() > longest_.load(std::memory_order_relaxed)) {
+      longest_.store(elapsed.count(), std::memory_order_relaxed);
+      longest_route_.store(route, std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<std::size_t> connections_ = 0;
+  std::atomic<std::size_t> pending_ = 0;
+  std::atomic<std::int64_t> lag_ = 0;
+  std::atomic<std::uint64_t> handlers_ = 0;
+  std::atomic<std::int64_t> busy_ = 0;
+  std::atomic<std::uint64_t> handlers_per_second_ = 0;
+  std::atomic<std::uint32_t> busy_permille_ = 0;
+  std::atomic<std::int64_t> longest_ = 0;
+  std::atomic<const std::string*> longest_route_ = nullptr;
+  // Previous probe, owned by the thread of the context
+  std::chrono::steady_clock::time_point window_start_;
+  std::uint64_t window_handlers_ = 0;
+  std::int64_t window_busy_ = 0;
+  // Route handler in progress, see IoContextPool::RouteScope. The start is
+  // written last and cleared at the end, readers check it did not change
+  // while they read the rest.
+  std::atomic<std::int64_t> route_start_ = 0;
+  std::atomic<const std::string*> route_pattern_ = nullptr;
+  std::atomic<const char*> route_method_ = nullptr;
+  std::atomic<std::thread::native_handle_type> thread_{};
+};
+
+class IoContextPool;
+
+// Picks the context returned by IoContextPool::Get() among the candidate
+// indexes (never empty), called from any thread
+class SelectPolicy {
+ public:
+  virtual ~SelectPolicy() noexcept {}
+
+  virtual std::size_t Select(const IoContextPool& pool,
+                             std::span<const std::size_t> candidates) = 0;
+};
+
+class RoundRobinPolicy : public SelectPolicy {
+ public:
+  std::size_t Select(const IoContextPool& pool,
+                     std::span<const std::size_t> candidates) override;
+
+ private:
+  std::atomic<std::size_t> next_index_ = 0;
+};
+
+// Fewest live connections, ties go to the next context in turn
+class LeastConnectionsPolicy : public SelectPolicy {
+ public:
+  std::size_t Select(const IoContextPool& pool,
+                     std::span<const std::size_t> candidates) override;
+
+ private:
+  std::atomic<std::size_t> next_index_ = 0;
+};
+
+// The less loaded of two random contexts, by connections and pending
+// handlers first and loop lag next. Close to least connections without
+// herding every caller onto the same context.
+class PowerOfTwoChoicesPolicy : public SelectPolicy {
+ public:
+  std::size_t Select(const IoContextPool& pool,
+                     std::span<const std::size_t> candidates) override;
+};
+
 class IoContextPool {
  public:
-  explicit IoContextPool(std::size_t size) {
+  // Counts a live connection on one context while held
+  class Lease {
+   public:
+    Lease() noexcept {}
+
+    explicit Lease(IoContextLoad* load) noexcept : load_(load) {
+      if (load_) {
+        load_->connections_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    Lease(Lease&& other) noexcept : load_(other.load_) {
+      other.load_ = nullptr;
+    }
+
+    Lease& operator=(Lease&& other) noexcept {
+      if (this != &other) {
+        Release();
+        load_ = other.load_;
+        other.load_ = nullptr;
+      }
+      return *this;
+    }
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    ~Lease() noexcept { Release(); }
+
+    void Release() noexcept {
+      if (load_) {
+        load_->connections_.fetch_sub(1, std::memory_order_relaxed);
+        load_ = nullptr;
+      }
+    }
+
+   private:
+    IoContextLoad* load_ = nullptr;
+  };
+
+  explicit IoContextPool(std::size_t size)
+      : policy_(std::make_shared<RoundRobinPolicy>()) {
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+    if (!IoUringSupported()) {
+      throw std::runtime_error(
+          "io_uring is not available, build without NETKIT_IO_URING");
+    }
+#endif
     for (std::size_t i = 0; i < size; ++i) {
       auto ctx = std::make_unique<boost::asio::io_context>(1);
       works_.emplace_back(boost::asio::make_work_guard(*ctx));
       contexts_.emplace_back(std::move(ctx));
+      loads_.emplace_back(std::make_unique<IoContextLoad>());
+      indexes_.push_back(i);
     }
+    placements_.resize(size);
   }
 
   ~IoContextPool() noexcept {}
 
+  // Reactor the contexts run on, chosen at build time (see the NETKIT_IO_URING
+  // CMake option)
+  static const char* backend() noexcept {
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+    return "io_uring";
+#elif defined(BOOST_ASIO_HAS_IOCP)
+    return "iocp";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+    return "epoll";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+    return "kqueue";
+#else
+    return "select";
+#endif
+  }
+
+  // Whether the kernel accepts io_uring_setup(), seccomp or a sysctl may
+  // deny it even on recent kernels
+  static bool IoUringSupported() noexcept {
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+    // Invalid arguments fail with EFAULT when the syscall exists
+    return syscall(__NR_io_uring_setup, 1, nullptr) < 0 && errno == EFAULT;
+#else
+    return false;
+#endif
+  }
+
+  // Must be set before the pool is used
+  IoContextPool& set_policy(std::shared_ptr<SelectPolicy> policy) noexcept {
+    policy_ = std::move(policy);
+    return *this;
+  }
+
+  // Period of the timer measuring the loop lag of every context and the
+  // handler rates (see IoContextLoad), 0 disables the probe and the handler
+  // instrumentation. Takes effect on Run().
+  IoContextPool& set_probe_interval(
+      const std::chrono::milliseconds& val) noexcept {
+    probe_interval_ = val;
+    return *this;
+  }
+
+  // Must be set before Run(), the node of every context is known from then
+  IoContextPool& set_affinity(const AffinityOptions& options) {
+    const auto& topology = NumaTopology::Get();
+    std::vector<std::size_t> nodes;
+    for (std::size_t node = 0; node < topology.size(); ++node) {
+      if (!topology.cpus(node).empty()) {
+        nodes.push_back(node);
+      }
+    }
+    for (std::size_t i = 0; i < contexts_.size(); ++i) {
+      auto& placement = placements_[i];
+      if (!options.cpus().empty()) {
+        placement.cpus = {options.cpus()[i % options.cpus().size()]};
+        placement.node = topology.NodeOf(placement.cpus[0]);
+      } else if (options.numa_spread()) {
+        // Thread i goes to node i % n, the threads of a node take its cpus
+        // in turn
+        auto node = nodes[i % nodes.size()];
+        const auto& cpus = topology.cpus(node);
+        placement.cpus = {cpus[(i / nodes.size()) % cpus.size()]};
+        placement.node = static_cast<int>(node);
+      } else {
+        placement = {};
+      }
+    }
+    node_indexes_.assign(topology.size(), {});
+    for (std::size_t i = 0; i < contexts_.size(); ++i) {
+      if (placements_[i].node >= 0) {
+        node_indexes_[placements_[i].node].push_back(i);
+      }
+    }
+    // The contexts of a node share the pages bound to it
+    arenas_.clear();
+    node_memory_.clear();
+    if (options.arenas()) {
+      for (std::size_t node = 0; node < topology.size(); ++node) {
+        node_memory_.emplace_back(
+            std::make_unique<NodeMemoryResource>(static_cast<int>(node)));
+      }
+      for (const auto& placement : placements_) {
+        auto upstream = placement.node >= 0
+                            ? node_memory_[placement.node].get()
+                            : std::pmr::new_delete_resource();
+        arenas_.emplace_back(
+            std::make_unique<std::pmr::synchronized_pool_resource>(upstream));
+      }
+    }
+    return *this;
+  }
+
   void Run() {
     std::vector<std::unique_ptr<std::thread>> threads;
-    for (const auto& ctx : contexts_) {
-      auto thread = std::make_unique<std::thread>([&ctx]() { ctx->run(); });
+    std::vector<std::unique_ptr<boost::asio::steady_timer>> probes;
+    for (std::size_t i = 0; i < contexts_.size(); ++i) {
+      if (probe_interval_.count() > 0) {
+        probes.emplace_back(
+            std::make_unique<boost::asio::steady_timer>(*contexts_[i]));
+        Probe(*probes.back(), *loads_[i]);
+      }
+      auto thread = std::make_unique<std::thread>([this, i]() {
+        PinCurrentThread(placements_[i].cpus);
+        current_arena_ = i < arenas_.size() ? arenas_[i].get() : nullptr;
+        current_load_ = loads_[i].get();
+        if (probe_interval_.count() > 0) {
+          RunInstrumented(*contexts_[i], *loads_[i]);
+        } else {
+          contexts_[i]->run();
+        }
+        current_arena_ = nullptr;
+        current_load_ = nullptr;
+      });
+      loads_[i]->thread_.store(thread->native_handle(),
+                               std::memory_order_release);
       threads.emplace_back(std::move(thread));
     }
-    for (const auto& thread : threads) {
-      thread->join();
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+      threads[i]->join();
+      loads_[i]->route_start_.store(0, std::memory_order_relaxed);
+      loads_[i]->thread_.store({}, std::memory_order_release);
     }
   }
 
@@ -35,17 +357,262 @@ class IoContextPool {
     }
   }
 
-  boost::asio::io_context& Get() {
-    auto index = next_index_++ % contexts_.size();
+  std::size_t size() const noexcept { return contexts_.size(); }
+
+  boost::asio::io_context& At(std::size_t index) noexcept {
     return *contexts_[index];
   }
 
+  const IoContextLoad& load(std::size_t index) const noexcept {
+    return *loads_[index];
+  }
+
+  // NUMA node the thread of the context is pinned to, -1 when not pinned
+  int node(std::size_t index) const noexcept { return placements_[index].node; }
+
+  // Memory pool of the context when the pool has AffinityOptions::arenas(),
+  // allocating on the node of its thread, the default resource otherwise.
+  // It may be used from any thread but must not outlive the pool.
+  std::pmr::memory_resource* arena(std::size_t index) const noexcept {
+    return index < arenas_.size() ? arenas_[index].get()
+                                  : std::pmr::get_default_resource();
+  }
+
+  // Memory pool of the context run by the calling thread, see arena()
+  static std::pmr::memory_resource* arena() noexcept {
+    return current_arena_ ? current_arena_ : std::pmr::get_default_resource();
+  }
+
+  // The context picked by the policy, round-robin by default
+  boost::asio::io_context& Get() {
+    return *contexts_[policy_->Select(*this, indexes_)];
+  }
+
+  // Prefers the contexts pinned to the node, for instance the node of the
+  // NIC queue (see DeviceNode()), any context when none is
+  boost::asio::io_context& GetOnNode(int node) {
+    if (node < 0 || static_cast<std::size_t>(node) >= node_indexes_.size() ||
+        node_indexes_[node].empty()) {
+      return Get();
+    }
+    return *contexts_[policy_->Select(*this, node_indexes_[node])];
+  }
+
+  // Prefers the contexts on the node of the calling thread
+  boost::asio::io_context& GetLocal() { return GetOnNode(CurrentNode()); }
+
+  // Index of the context running the executor, size() when not in the pool
+  std::size_t IndexOf(const boost::asio::any_io_executor& ex) const noexcept {
+    auto& ctx = boost::asio::query(ex, boost::asio::execution::context);
+    for (std::size_t i = 0; i < contexts_.size(); ++i) {
+      if (contexts_[i].get() == &ctx) {
+        return i;
+      }
+    }
+    return contexts_.size();
+  }
+
+  // Counts a connection on the context of the executor, the lease is empty
+  // when the context is not part of the pool
+  Lease Track(const boost::asio::any_io_executor& ex) noexcept {
+    auto index = IndexOf(ex);
+    return Lease(index < loads_.size() ? loads_[index].get() : nullptr);
+  }
+
+  // Marks a route handler running on a pool thread, for the handler
+  // instrumentation and the Watchdog. Does nothing on other threads.
+  class RouteScope {
+   public:
+    // method must be a string literal
+    explicit RouteScope(const char* method) noexcept
+        : load_(current_load_), start_(std::chrono::steady_clock::now()) {
+      if (load_) {
+        load_->route_pattern_.store(nullptr, std::memory_order_relaxed);
+        load_->route_method_.store(method, std::memory_order_relaxed);
+        load_->route_start_.store(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                start_.time_since_epoch())
+                .count(),
+            std::memory_order_release);
+      }
+    }
+
+    ~RouteScope() noexcept {
+      if (load_) {
+        load_->route_start_.store(0, std::memory_order_release);
+      }
+      if (current_trace_) {
+        current_trace_->route = pattern_;
+        current_trace_->route_time += std::chrono::steady_clock::now() - start_;
+      }
+    }
+
+    RouteScope(const RouteScope&) = delete;
+    RouteScope& operator=(const RouteScope&) = delete;
+
+    // Pattern of the matched route, see BasicRouter::Routing()
+    void set_pattern(const std::string* pattern) noexcept {
+      pattern_ = pattern;
+      if (load_) {
+        load_->route_pattern_.store(pattern, std::memory_order_relaxed);
+      }
+    }
+
+   private:
+    IoContextLoad* load_;
+    std::chrono::steady_clock::time_point start_;
+    const std::string* pattern_ = nullptr;
+  };
+
+  // Runs the handler on the context picked by the policy
+  template <class Handler>
+  void Post(Handler&& handler) {
+    auto index = policy_->Select(*this, indexes_);
+    auto& load = *loads_[index];
+    load.pending_.fetch_add(1, std::memory_order_relaxed);
+    boost::asio::post(
+        *contexts_[index],
+        [&load, handler = std::forward<Handler>(handler)]() mutable {
+          load.pending_.fetch_sub(1, std::memory_order_relaxed);
+          handler();
+        });
+  }
+
  private:
+  void Probe(boost::asio::steady_timer& timer, IoContextLoad& load) {
+    timer.expires_after(probe_interval_);
+    timer.async_wait(
+        [this, &timer, &load](const boost::system::error_code& ec) {
+          if (ec) {
+            return;
+          }
+          auto now = std::chrono::steady_clock::now();
+          auto lag = std::chrono::duration_cast<std::chrono::microseconds>(
+              now - timer.expiry());
+          load.lag_.store(lag.count(), std::memory_order_relaxed);
+          UpdateRates(load, now);
+          Probe(timer, load);
+        });
+  }
+
+  static void UpdateRates(IoContextLoad& load,
+                          std::chrono::steady_clock::time_point now) noexcept {
+    auto handlers = load.handlers_.load(std::memory_order_relaxed);
+    auto busy = load.busy_.load(std::memory_order_relaxed);
+    auto window = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      now - load.window_start_)
+                      .count();
+    if (load.window_start_.time_since_epoch().count() != 0 && window > 0) {
+      load.handlers_per_second_.store(
+          (handlers - load.window_handlers_) * 1000000000 / window,
+          std::memory_order_relaxed);
+      auto permille = (busy - load.window_busy_) * 1000 / window;
+      load.busy_permille_.store(
+          static_cast<std::uint32_t>(std::clamp<std::int64_t>(permille, 0,
+                                                              1000)),
+          std::memory_order_relaxed);
+    }
+    load.window_start_ = now;
+    load.window_handlers_ = handlers;
+    load.window_busy_ = busy;
+  }
+
+  // run() one handler at a time. poll_one() runs a ready handler without
+  // waiting so it is timed as a whole. When nothing is ready run_one() waits
+  // and runs the handler which woke the thread up, only the route it
+  // dispatched is timed then.
+  static void RunInstrumented(boost::asio::io_context& ctx,
+                              IoContextLoad& load) {
+    using Clock = std::chrono::steady_clock;
+    HandlerTrace trace;
+    current_trace_ = &trace;
+    for (;;) {
+      trace = {};
+      auto start = Clock::now();
+      std::chrono::nanoseconds elapsed;
+      if (ctx.poll_one() > 0) {
+        elapsed = Clock::now() - start;
+      } else if (ctx.stopped() || ctx.run_one() == 0) {
+        break;
+      } else {
+        elapsed = trace.route_time;
+      }
+      load.Record(elapsed, trace.route);
+    }
+    current_trace_ = nullptr;
+  }
+
+ private:
+  struct Placement {
+    std::vector<int> cpus;
+    int node = -1;
+  };
+
+  // Filled by RouteScope during the current handler
+  struct HandlerTrace {
+    const std::string* route = nullptr;
+    std::chrono::nanoseconds route_time{0};
+  };
+
+  static inline thread_local HandlerTrace* current_trace_ = nullptr;
+  static inline thread_local IoContextLoad* current_load_ = nullptr;
+
+  static inline thread_local std::pmr::memory_resource* current_arena_ =
+      nullptr;
+  // Before the contexts, whose pending handlers still hold connections
+  // allocated from the arenas when they are destroyed
+  std::vector<std::unique_ptr<NodeMemoryResource>> node_memory_;
+  std::vector<std::unique_ptr<std::pmr::memory_resource>> arenas_;
   std::vector<std::unique_ptr<boost::asio::io_context>> contexts_;
   std::vector<
       boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>
       works_;
-  std::size_t next_index_ = 0;
+  std::vector<std::unique_ptr<IoContextLoad>> loads_;
+  std::vector<std::size_t> indexes_;
+  std::vector<Placement> placements_;
+  std::vector<std::vector<std::size_t>> node_indexes_;
+  std::shared_ptr<SelectPolicy> policy_;
+  std::chrono::milliseconds probe_interval_ = std::chrono::milliseconds(100);
 };
 
+inline std::size_t RoundRobinPolicy::Select(
+    const IoContextPool& pool, std::span<const std::size_t> candidates) {
+  auto index = next_index_.fetch_add(1, std::memory_order_relaxed);
+  return candidates[index % candidates.size()];
+}
+
+inline std::size_t LeastConnectionsPolicy::Select(
+    const IoContextPool& pool, std::span<const std::size_t> candidates) {
+  auto size = candidates.size();
+  auto start = next_index_.fetch_add(1, std::memory_order_relaxed);
+  auto best = candidates[start % size];
+  for (std::size_t i = 1; i < size; ++i) {
+    auto index = candidates[(start + i) % size];
+    if (pool.load(index).connections() < pool.load(best).connections()) {
+      best = index;
+    }
+  }
+  return best;
+}
+
+inline std::size_t PowerOfTwoChoicesPolicy::Select(
+    const IoContextPool& pool, std::span<const std::size_t> candidates) {
+  auto size = candidates.size();
+  if (size < 2) {
+    return candidates[0];
+  }
+  thread_local std::minstd_rand engine(std::random_device{}());
+  std::size_t pick = engine() % size;
+  auto first = candidates[pick];
+  auto second = candidates[(pick + 1 + engine() % (size - 1)) % size];
+  const auto& a = pool.load(first);
+  const auto& b = pool.load(second);
+  auto cost_a = a.connections() + a.pending();
+  auto cost_b = b.connections() + b.pending();
+  if (cost_a != cost_b) {
+    return cost_a < cost_b ? first : second;
+  }
+  return a.lag() <= b.lag() ? first : second;
+}
+
 }  // namespace netkit
@@ -0,0 +1,100 @@
+#include "handoff.h"
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#endif
+
+namespace netkit::local {
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+namespace {
+
+// Linux SCM_MAX_FD
+constexpr std::size_t kMaxDescriptors = 253;
+
+#if defined(MSG_CMSG_CLOEXEC)
+constexpr int kReceiveFlags = MSG_CMSG_CLOEXEC;
+#else
+constexpr int kReceiveFlags = 0;
+#endif
+
+boost::system::system_error LastError(const char* what) {
+  return boost::system::system_error(
+      boost::system::error_code(errno, boost::system::system_category()),
+      what);
+}
+
+}  // namespace
+
+void SendDescriptors(Socket& socket, const std::vector<NativeHandle>& fds) {
+  if (fds.empty() || fds.size() > kMaxDescriptors) {
+    throw boost::system::system_error(
+        boost::asio::error::invalid_argument, "send descriptors");
+  }
+  // The count goes in the payload, a message with ancillary data must carry
+  // at least one byte
+  auto count = static_cast<std::uint32_t>(fds.size());
+  iovec iov = {&count, sizeof(count)};
+  std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  auto cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+  std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+  ssize_t n;
+  do {
+    n = sendmsg(socket.native_handle(), &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    throw LastError("send descriptors");
+  }
+}
+
+std::vector<NativeHandle> ReceiveDescriptors(Socket& socket) {
+  std::uint32_t count = 0;
+  iovec iov = {&count, sizeof(count)};
+  std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxDescriptors));
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data();
+  msg.msg_controllen = control.size();
+  ssize_t n;
+  do {
+    n = recvmsg(socket.native_handle(), &msg, kReceiveFlags);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    throw LastError("receive descriptors");
+  }
+  std::vector<NativeHandle> fds;
+  for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      std::size_t size = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      auto offset = fds.size();
+      fds.resize(offset + size);
+      std::memcpy(fds.data() + offset, CMSG_DATA(cmsg), sizeof(int) * size);
+    }
+  }
+  if (n != sizeof(count) || fds.size() != count ||
+      (msg.msg_flags & MSG_CTRUNC)) {
+    for (auto fd : fds) {
+      ::close(fd);
+    }
+    throw boost::system::system_error(boost::asio::error::message_size,
+                                      "receive descriptors");
+  }
+  return fds;
+}
+#endif
+
+}  // namespace netkit::local
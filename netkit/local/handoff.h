@@ -0,0 +1,19 @@
+#pragma once
+#include <netkit/local/socket.h>
+
+#include <vector>
+
+namespace netkit::local {
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+using NativeHandle = Socket::native_handle_type;
+
+// Passes descriptors to the process on the other end with SCM_RIGHTS, the
+// receiver gets its own duplicates. Blocking, throws system_error.
+void SendDescriptors(Socket& socket, const std::vector<NativeHandle>& fds);
+
+// Descriptors of one SendDescriptors() call, owned by the caller
+std::vector<NativeHandle> ReceiveDescriptors(Socket& socket);
+#endif
+
+}  // namespace netkit::local
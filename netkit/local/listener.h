@@ -0,0 +1,85 @@
+#pragma once
+#include <netkit/io_context_pool.h>
+#include <netkit/local/socket.h>
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace netkit::local {
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+// Accepts Unix domain stream connections and hands them out to the pool
+class Listener {
+  using Self = Listener;
+
+ public:
+  explicit Listener(IoContextPool& pool) noexcept
+      : pool_(pool), acceptor_(pool.Get()) {}
+
+  ~Listener() noexcept {}
+
+  // path as in MakeEndpoint(), a stale socket file is removed before
+  // binding. Any other file at path fails the bind.
+  template <class Handler>
+  void ListenAndAccept(const std::string& path, Handler&& handler) {
+    auto endpoint = MakeEndpoint(path);
+    if (!path.empty() && path[0] != '@') {
+      RemoveSocketFile(path);
+      path_ = path;
+    }
+    acceptor_.open(endpoint.protocol());
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+    DoAccept(std::forward<Handler>(handler));
+  }
+
+  // Also removes the socket file
+  void Close() { DoClose(); }
+
+  boost::asio::any_io_executor executor() noexcept {
+    return acceptor_.get_executor();
+  }
+
+ private:
+  template <class Handler>
+  void DoAccept(Handler&& handler) {
+    acceptor_.async_accept(
+        pool_.Get(), [this, handler = std::forward<Handler>(handler)](
+                         const boost::system::error_code& ec,
+                         Socket socket) mutable {
+          if (!ec) {
+            handler(std::move(socket));
+          }
+          if (acceptor_.is_open()) {
+            DoAccept(std::move(handler));
+          }
+        });
+  }
+
+  void DoClose() noexcept {
+    boost::system::error_code ec;
+    acceptor_.cancel(ec);
+    acceptor_.close(ec);
+    if (!path_.empty()) {
+      RemoveSocketFile(path_);
+      path_.clear();
+    }
+  }
+
+  static void RemoveSocketFile(const std::string& path) noexcept {
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+      unlink(path.c_str());
+    }
+  }
+
+ private:
+  IoContextPool& pool_;
+  boost::asio::local::stream_protocol::acceptor acceptor_;
+  std::string path_;
+};
+#endif
+
+}  // namespace netkit::local
@@ -0,0 +1,57 @@
+#include "socket.h"
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace netkit::local {
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+Endpoint MakeEndpoint(const std::string& path) {
+  if (!path.empty() && path[0] == '@') {
+    std::string name(path);
+    name[0] = '\0';
+    return Endpoint(name);
+  }
+  return Endpoint(path);
+}
+#endif
+
+std::optional<PeerCredentials> GetPeerCredentials(
+    boost::asio::ip::tcp::socket::native_handle_type fd) noexcept {
+#if defined(_WIN32)
+  return std::nullopt;
+#else
+  sockaddr_storage addr = {};
+  socklen_t addr_len = sizeof(addr);
+  if (getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0 ||
+      addr.ss_family != AF_UNIX) {
+    return std::nullopt;
+  }
+  PeerCredentials creds;
+#if defined(SO_PEERCRED)
+  ucred cred = {};
+  socklen_t cred_len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0) {
+    return std::nullopt;
+  }
+  creds.pid = cred.pid;
+  creds.uid = cred.uid;
+  creds.gid = cred.gid;
+#else
+  uid_t uid = 0;
+  gid_t gid = 0;
+  if (getpeereid(fd, &uid, &gid) != 0) {
+    return std::nullopt;
+  }
+  creds.uid = uid;
+  creds.gid = gid;
+#endif
+  return creds;
+#endif
+}
+
+}  // namespace netkit::local
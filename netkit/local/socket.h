@@ -0,0 +1,36 @@
+#pragma once
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/beast/core/basic_stream.hpp>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace netkit::local {
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+using Endpoint = boost::asio::local::stream_protocol::endpoint;
+
+using Socket = boost::asio::local::stream_protocol::socket;
+
+// Counterpart of boost::beast::tcp_stream, with timeouts
+using Stream = boost::beast::basic_stream<boost::asio::local::stream_protocol>;
+
+// Endpoint of a Unix domain socket path, a leading '@' selects the Linux
+// abstract namespace (no file, gone with the last descriptor)
+Endpoint MakeEndpoint(const std::string& path);
+#endif
+
+// Process on the other end of a Unix domain socket when it connected
+struct PeerCredentials {
+  std::int64_t pid = -1;  // -1 when the platform doesn't report it
+  std::uint32_t uid = 0;
+  std::uint32_t gid = 0;
+};
+
+// nullopt when the descriptor isn't a Unix domain socket or the platform has
+// no way to tell
+std::optional<PeerCredentials> GetPeerCredentials(
+    boost::asio::ip::tcp::socket::native_handle_type fd) noexcept;
+
+}  // namespace netkit::local
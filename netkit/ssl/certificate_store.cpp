@@ -0,0 +1,164 @@
+#include "certificate_store.h"
+
+#include "netkit/utility.h"
+
+namespace netkit::ssl {
+
+CertificateStore::CertificateStore(boost::asio::ssl::context& front)
+    : front_(front), table_(std::make_shared<const Table>()) {
+  SSL_CTX_set_tlsext_servername_callback(front_.native_handle(),
+                                         &OnServerName);
+  SSL_CTX_set_tlsext_servername_arg(front_.native_handle(), this);
+}
+
+CertificateStore::~CertificateStore() noexcept {
+  SSL_CTX_set_tlsext_servername_callback(front_.native_handle(), nullptr);
+  SSL_CTX_set_tlsext_servername_arg(front_.native_handle(), nullptr);
+}
+
+void CertificateStore::Add(const std::string& server_name,
+                           const ContextPtr& ctx) {
+  std::lock_guard lock(mutex_);
+  Configure(ctx);
+  auto table = CopyTable();
+  Insert(*table, server_name, ctx);
+  table_.store(std::move(table));
+}
+
+void CertificateStore::Remove(const std::string& server_name) {
+  std::lock_guard lock(mutex_);
+  auto table = CopyTable();
+  std::string name = server_name;
+  util::ToLower(name);
+  if (name.starts_with("*.")) {
+    table->wildcard.erase(name.substr(2));
+  } else {
+    table->exact.erase(name);
+  }
+  table_.store(std::move(table));
+}
+
+void CertificateStore::SetDefault(const ContextPtr& ctx) {
+  std::lock_guard lock(mutex_);
+  Configure(ctx);
+  auto table = CopyTable();
+  table->default_ctx = ctx;
+  table_.store(std::move(table));
+}
+
+void CertificateStore::Reload(const ContextMap& contexts,
+                              const ContextPtr& default_ctx) {
+  std::lock_guard lock(mutex_);
+  auto table = std::make_shared<Table>();
+  for (const auto& pair : contexts) {
+    Configure(pair.second);
+    Insert(*table, pair.first, pair.second);
+  }
+  Configure(default_ctx);
+  table->default_ctx = default_ctx;
+  table_.store(std::move(table));
+}
+
+CertificateStore::ContextPtr CertificateStore::Find(
+    std::string_view server_name) const {
+  auto table = table_.load();
+  auto ctx = Lookup(*table, server_name);
+  return ctx ? *ctx : table->default_ctx;
+}
+
+void CertificateStore::AddConfigurator(const Configurator& func) {
+  std::lock_guard lock(mutex_);
+  configurators_.emplace_back(func);
+  func(front_.native_handle());
+  auto table = table_.load();
+  for (const auto& pair : table->exact) {
+    func(pair.second->native_handle());
+  }
+  for (const auto& pair : table->wildcard) {
+    func(pair.second->native_handle());
+  }
+  if (table->default_ctx) {
+    func(table->default_ctx->native_handle());
+  }
+}
+
+CertificateStore::ContextPtr CertificateStore::MakeContext(
+    const std::string& cert_chain_file, const std::string& private_key_file) {
+  auto ctx = std::make_shared<boost::asio::ssl::context>(
+      boost::asio::ssl::context::tls_server);
+  ctx->use_certificate_chain_file(cert_chain_file);
+  ctx->use_private_key_file(private_key_file, boost::asio::ssl::context::pem);
+  return ctx;
+}
+
+std::shared_ptr<CertificateStore::Table> CertificateStore::CopyTable() const {
+  return std::make_shared<Table>(*table_.load());
+}
+
+void CertificateStore::Insert(Table& table, const std::string& server_name,
+                              const ContextPtr& ctx) {
+  std::string name = server_name;
+  util::ToLower(name);
+  if (name.starts_with("*.")) {
+    table.wildcard[name.substr(2)] = ctx;
+  } else {
+    table.exact[name] = ctx;
+  }
+}
+
+const CertificateStore::ContextPtr* CertificateStore::Lookup(
+    const Table& table, std::string_view server_name) noexcept {
+  // host names are at most 253 characters
+  char buffer[256];
+  if (server_name.empty() || server_name.size() >= sizeof(buffer)) {
+    return nullptr;
+  }
+  for (std::size_t i = 0; i < server_name.size(); ++i) {
+    auto c = server_name[i];
+    buffer[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+  }
+  std::string_view name(buffer, server_name.size());
+  auto it = table.exact.find(name);
+  if (it != table.exact.end()) {
+    return &it->second;
+  }
+  auto pos = name.find('.');
+  if (pos != std::string_view::npos) {
+    it = table.wildcard.find(name.substr(pos + 1));
+    if (it != table.wildcard.end()) {
+      return &it->second;
+    }
+  }
+  return nullptr;
+}
+
+void CertificateStore::Configure(const ContextPtr& ctx) const {
+  if (ctx) {
+    for (const auto& func : configurators_) {
+      func(ctx->native_handle());
+    }
+  }
+}
+
+int CertificateStore::OnServerName(SSL* ssl, int* alert, void* arg) {
+  auto self = static_cast<CertificateStore*>(arg);
+  if (!self) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+  auto name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+  auto table = self->table_.load();
+  const ContextPtr* ctx = nullptr;
+  if (name) {
+    ctx = Lookup(*table, name);
+  }
+  if (!ctx && table->default_ctx) {
+    ctx = &table->default_ctx;
+  }
+  if (ctx) {
+    // the SSL object takes its own reference of the context
+    SSL_set_SSL_CTX(ssl, (*ctx)->native_handle());
+  }
+  return SSL_TLSEXT_ERR_OK;
+}
+
+}  // namespace netkit::ssl
@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <boost/asio/ssl.hpp>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace netkit::ssl {
+
+// Selects the certificate of a connection by its SNI server name. Names are
+// either exact ("example.com") or wildcards matching one label
+// ("*.example.com"). The store can be modified while the server is running.
+class CertificateStore {
+ public:
+  using ContextPtr = std::shared_ptr<boost::asio::ssl::context>;
+  using ContextMap = std::unordered_map<std::string, ContextPtr>;
+  using Configurator = std::function<void(SSL_CTX*)>;
+
+  // Connections are created from the front context, its certificate is used
+  // when no name matches and no default context is set
+  explicit CertificateStore(boost::asio::ssl::context& front);
+
+  ~CertificateStore() noexcept;
+
+  CertificateStore(const CertificateStore&) = delete;
+  CertificateStore& operator=(const CertificateStore&) = delete;
+
+  boost::asio::ssl::context& front() noexcept { return front_; }
+
+  void Add(const std::string& server_name, const ContextPtr& ctx);
+
+  void Remove(const std::string& server_name);
+
+  void SetDefault(const ContextPtr& ctx);
+
+  // Replaces all the certificates at once
+  void Reload(const ContextMap& contexts, const ContextPtr& default_ctx);
+
+  ContextPtr Find(std::string_view server_name) const;
+
+  // Applied to the front context and to every context of the store, now and
+  // when added later
+  void AddConfigurator(const Configurator& func);
+
+  // Server context holding the certificate chain and private key of the files
+  static ContextPtr MakeContext(const std::string& cert_chain_file,
+                                const std::string& private_key_file);
+
+ private:
+  struct Hash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view sv) const noexcept {
+      return std::hash<std::string_view>()(sv);
+    }
+  };
+
+  using Map = std::unordered_map<std::string, ContextPtr, Hash,
+                                 std::equal_to<>>;
+
+  struct Table {
+    Map exact;
+    Map wildcard;  // keyed by the name without "*."
+    ContextPtr default_ctx;
+  };
+
+  std::shared_ptr<Table> CopyTable() const;
+
+  static void Insert(Table& table, const std::string& server_name,
+                     const ContextPtr& ctx);
+
+  static const ContextPtr* Lookup(const Table& table,
+                                  std::string_view server_name) noexcept;
+
+  void Configure(const ContextPtr& ctx) const;
+
+  static int OnServerName(SSL* ssl, int* alert, void* arg);
+
+ private:
+  boost::asio::ssl::context& front_;
+  std::mutex mutex_;
+  std::vector<Configurator> configurators_;
+  std::atomic<std::shared_ptr<const Table>> table_;
+};
+
+}  // namespace netkit::ssl
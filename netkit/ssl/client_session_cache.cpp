@@ -0,0 +1,151 @@
+#include "client_session_cache.h"
+
+#include <algorithm>
+#include <ctime>
+
+namespace netkit::ssl {
+
+namespace {
+
+bool IsUsable(SSL_SESSION* session) noexcept {
+  if (SSL_SESSION_is_resumable(session) != 1) {
+    return false;
+  }
+  auto expiry =
+      SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session);
+  return std::time(nullptr) < expiry;
+}
+
+}  // namespace
+
+ClientSessionCache::~ClientSessionCache() noexcept { Clear(); }
+
+void ClientSessionCache::Attach(boost::asio::ssl::context& ctx) {
+  Attach(ctx.native_handle());
+}
+
+void ClientSessionCache::Attach(SSL_CTX* ctx) {
+  SSL_CTX_set_ex_data(ctx, GetIndex(), this);
+  // Stored here by host instead of the internal cache, which servers use
+  SSL_CTX_set_session_cache_mode(
+      ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx, &OnNewSession);
+  SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+}
+
+ClientSessionCache* ClientSessionCache::Get(SSL_CTX* ctx) noexcept {
+  return static_cast<ClientSessionCache*>(SSL_CTX_get_ex_data(ctx, GetIndex()));
+}
+
+void ClientSessionCache::Prepare(SSL* ssl, const std::string& key) {
+  SSL_set_ex_data(ssl, GetKeyIndex(), const_cast<std::string*>(&key));
+  SSL_SESSION* expired = nullptr;
+  {
+    std::lock_guard lock(mutex_);
+    auto it = sessions_.find(key);
+    if (it == sessions_.end()) {
+      return;
+    }
+    if (IsUsable(it->second.session)) {
+      SSL_set_session(ssl, it->second.session);
+      return;
+    }
+    expired = it->second.session;
+    sessions_.erase(it);
+  }
+  SSL_SESSION_free(expired);
+}
+
+void ClientSessionCache::OnHandshake(SSL* ssl) noexcept {
+  if (SSL_session_reused(ssl) == 1) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void ClientSessionCache::Remove(const std::string& key) {
+  SSL_SESSION* session = nullptr;
+  {
+    std::lock_guard lock(mutex_);
+    auto it = sessions_.find(key);
+    if (it == sessions_.end()) {
+      return;
+    }
+    session = it->second.session;
+    sessions_.erase(it);
+  }
+  SSL_SESSION_free(session);
+}
+
+void ClientSessionCache::Clear() {
+  std::unordered_map<std::string, Entry> sessions;
+  {
+    std::lock_guard lock(mutex_);
+    sessions.swap(sessions_);
+  }
+  for (auto& pair : sessions) {
+    SSL_SESSION_free(pair.second.session);
+  }
+}
+
+std::size_t ClientSessionCache::size() const {
+  std::lock_guard lock(mutex_);
+  return sessions_.size();
+}
+
+void ClientSessionCache::Store(const std::string& key, SSL_SESSION* session) {
+  SSL_SESSION* replaced = nullptr;
+  {
+    std::lock_guard lock(mutex_);
+    auto it = sessions_.find(key);
+    if (it != sessions_.end()) {
+      replaced = it->second.session;
+      it->second = {session, std::chrono::steady_clock::now()};
+    } else {
+      if (sessions_.size() >= max_size_) {
+        // The host stored the longest ago
+        auto oldest = std::min_element(
+            sessions_.begin(), sessions_.end(),
+            [](const auto& a, const auto& b) {
+              return a.second.stored < b.second.stored;
+            });
+        replaced = oldest->second.session;
+        sessions_.erase(oldest);
+      }
+      sessions_.emplace(key, Entry{session, std::chrono::steady_clock::now()});
+    }
+  }
+  if (replaced) {
+    SSL_SESSION_free(replaced);
+  }
+}
+
+int ClientSessionCache::GetIndex() noexcept {
+  static int index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+int ClientSessionCache::GetKeyIndex() noexcept {
+  static int index =
+      SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+int ClientSessionCache::OnNewSession(SSL* ssl, SSL_SESSION* session) {
+  auto self = Get(SSL_get_SSL_CTX(ssl));
+  auto key =
+      static_cast<const std::string*>(SSL_get_ex_data(ssl, GetKeyIndex()));
+  if (!self || !key) {
+    return 0;  // not kept, OpenSSL frees it
+  }
+  try {
+    self->Store(*key, session);
+  } catch (const std::exception&) {
+    return 0;
+  }
+  return 1;  // the cache owns the reference now
+}
+
+}  // namespace netkit::ssl
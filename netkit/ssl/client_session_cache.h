@@ -0,0 +1,81 @@
+#pragma once
+#include <boost/asio/ssl.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace netkit::ssl {
+
+// Sessions of the client connections of a context, the last one of each
+// host:port. It is offered on the next connection to the same host, which
+// then resumes with an abbreviated handshake (session id or ticket, TLS 1.3
+// tickets included as they arrive after the handshake).
+class ClientSessionCache {
+ public:
+  explicit ClientSessionCache(std::size_t max_size = 1024) noexcept
+      : max_size_(max_size > 0 ? max_size : 1) {}
+
+  ~ClientSessionCache() noexcept;
+
+  ClientSessionCache(const ClientSessionCache&) = delete;
+  ClientSessionCache& operator=(const ClientSessionCache&) = delete;
+
+  // Enables the client session cache and tickets on the context, which
+  // SslClient then uses. The cache must outlive the context.
+  void Attach(boost::asio::ssl::context& ctx);
+
+  void Attach(SSL_CTX* ctx);
+
+  // The cache attached to the context, if any
+  static ClientSessionCache* Get(SSL_CTX* ctx) noexcept;
+
+  // Before the handshake: offers the session of key, and stores the ones
+  // the server sends for it. key must outlive ssl.
+  void Prepare(SSL* ssl, const std::string& key);
+
+  // After the handshake, counts it as a hit or a miss
+  void OnHandshake(SSL* ssl) noexcept;
+
+  void Remove(const std::string& key);
+
+  void Clear();
+
+  std::size_t size() const;
+
+  // Handshakes which resumed the offered session
+  std::uint64_t hits() const noexcept {
+    return hits_.load(std::memory_order_relaxed);
+  }
+
+  // Full handshakes, no session to offer or the server declined it
+  std::uint64_t misses() const noexcept {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Entry {
+    SSL_SESSION* session;
+    std::chrono::steady_clock::time_point stored;
+  };
+
+  void Store(const std::string& key, SSL_SESSION* session);
+
+  static int GetIndex() noexcept;
+
+  static int GetKeyIndex() noexcept;
+
+  static int OnNewSession(SSL* ssl, SSL_SESSION* session);
+
+ private:
+  const std::size_t max_size_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry> sessions_;
+  std::atomic<std::uint64_t> hits_ = 0;
+  std::atomic<std::uint64_t> misses_ = 0;
+};
+
+}  // namespace netkit::ssl
@@ -0,0 +1,200 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace netkit::ssl {
+
+// Power of two buckets from 128us up to ~2s, the last one counts the rest
+class LatencyHistogram {
+ public:
+  static constexpr std::size_t kBuckets = 16;
+
+  static std::chrono::microseconds upper_bound(std::size_t index) noexcept {
+    if (index + 1 >= kBuckets) {
+      return std::chrono::microseconds::max();
+    }
+    return std::chrono::microseconds(128LL << index);
+  }
+
+  std::uint64_t count(std::size_t index) const noexcept {
+    return buckets_[index].load(std::memory_order_relaxed);
+  }
+
+  void Add(const std::chrono::steady_clock::duration& latency) noexcept {
+    auto us =
+        std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    std::size_t index = 0;
+    while (index + 1 < kBuckets && us >= (128LL << index)) {
+      ++index;
+    }
+    buckets_[index].fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  std::array<std::atomic<std::uint64_t>, kBuckets> buckets_ = {};
+};
+
+// Handshake counters, and the queue bounding the handshakes in progress
+class HandshakeStats {
+ public:
+  // A handshake in progress, the next queued connection starts once it is
+  // destroyed
+  class Slot {
+   public:
+    Slot() noexcept = default;
+
+    explicit Slot(HandshakeStats* stats) noexcept : stats_(stats) {}
+
+    Slot(Slot&& other) noexcept : stats_(other.stats_) {
+      other.stats_ = nullptr;
+    }
+
+    Slot& operator=(Slot&& other) noexcept {
+      if (this != &other) {
+        Release();
+        stats_ = other.stats_;
+        other.stats_ = nullptr;
+      }
+      return *this;
+    }
+
+    Slot(const Slot&) = delete;
+    Slot& operator=(const Slot&) = delete;
+
+    ~Slot() noexcept { Release(); }
+
+    void Release() noexcept {
+      if (stats_) {
+        std::exchange(stats_, nullptr)->Release();
+      }
+    }
+
+   private:
+    HandshakeStats* stats_ = nullptr;
+  };
+
+  using Waiter = std::function<void(Slot&&)>;
+
+  std::uint64_t full() const noexcept {
+    return full_.load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t resumed() const noexcept {
+    return resumed_.load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t failed() const noexcept {
+    return failed_.load(std::memory_order_relaxed);
+  }
+
+  // Connections closed because the queue was full
+  std::uint64_t rejected() const noexcept {
+    return rejected_.load(std::memory_order_relaxed);
+  }
+
+  // Handshakes in progress
+  std::uint64_t pending() const noexcept {
+    return pending_.load(std::memory_order_relaxed);
+  }
+
+  // Connections waiting for a handshake slot
+  std::size_t queued() const {
+    std::lock_guard lock(mutex_);
+    return waiters_.size();
+  }
+
+  // Connections whose outgoing records are encrypted by the kernel
+  std::uint64_t offloaded() const noexcept {
+    return offloaded_.load(std::memory_order_relaxed);
+  }
+
+  // Time from the start of the handshake (queueing included) to its end
+  const LatencyHistogram& full_latency() const noexcept {
+    return full_latency_;
+  }
+
+  const LatencyHistogram& resumed_latency() const noexcept {
+    return resumed_latency_;
+  }
+
+  // Calls start with a slot right away when fewer than limit handshakes are
+  // in progress (0 means no limit), otherwise once one ends. Up to
+  // queue_limit connections wait in FIFO order; beyond it, returns false
+  // and start is not called. start may run on the thread ending another
+  // handshake.
+  bool Begin(std::uint32_t limit, std::uint32_t queue_limit, Waiter start) {
+    {
+      std::lock_guard lock(mutex_);
+      if (limit > 0 && pending_.load(std::memory_order_relaxed) >= limit) {
+        if (waiters_.size() >= queue_limit) {
+          rejected_.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+        waiters_.emplace_back(std::move(start));
+        return true;
+      }
+      pending_.fetch_add(1, std::memory_order_relaxed);
+    }
+    start(Slot(this));
+    return true;
+  }
+
+  void AddHandshake(
+      bool resumed,
+      const std::chrono::steady_clock::duration& latency) noexcept {
+    if (resumed) {
+      resumed_.fetch_add(1, std::memory_order_relaxed);
+      resumed_latency_.Add(latency);
+    } else {
+      full_.fetch_add(1, std::memory_order_relaxed);
+      full_latency_.Add(latency);
+    }
+  }
+
+  void AddFailure() noexcept {
+    failed_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void AddOffload() noexcept {
+    offloaded_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  // Hands the slot over to the first waiter, if any
+  void Release() noexcept {
+    Waiter waiter;
+    {
+      std::lock_guard lock(mutex_);
+      if (waiters_.empty()) {
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+        return;
+      }
+      waiter = std::move(waiters_.front());
+      waiters_.pop_front();
+    }
+    try {
+      waiter(Slot(this));
+    } catch (const std::exception&) {
+    }
+  }
+
+ private:
+  std::atomic<std::uint64_t> full_ = 0;
+  std::atomic<std::uint64_t> resumed_ = 0;
+  std::atomic<std::uint64_t> failed_ = 0;
+  std::atomic<std::uint64_t> rejected_ = 0;
+  std::atomic<std::uint64_t> pending_ = 0;
+  std::atomic<std::uint64_t> offloaded_ = 0;
+  LatencyHistogram full_latency_;
+  LatencyHistogram resumed_latency_;
+  mutable std::mutex mutex_;
+  std::deque<Waiter> waiters_;
+};
+
+}  // namespace netkit::ssl
@@ -0,0 +1,365 @@
+#include "ktls.h"
+
+#include <openssl/kdf.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+
+#if defined(__linux__)
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+namespace netkit::ssl {
+
+namespace {
+
+int GetIndex() noexcept {
+  static int index =
+      SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+// Callbacks of the context before PrepareKtls()
+struct PreviousCallbacks {
+  SSL_CTX_keylog_cb_func keylog = nullptr;
+  void (*info)(const SSL*, int, int) = nullptr;
+};
+
+void FreePreviousCallbacks(void*, void* ptr, CRYPTO_EX_DATA*, int, long,
+                           void*) {
+  delete static_cast<PreviousCallbacks*>(ptr);
+}
+
+int GetCtxIndex() noexcept {
+  static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr,
+                                              &FreePreviousCallbacks);
+  return index;
+}
+
+const PreviousCallbacks* GetPreviousCallbacks(const SSL* ssl) noexcept {
+  return static_cast<const PreviousCallbacks*>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), GetCtxIndex()));
+}
+
+bool DecodeHex(std::string_view hex, unsigned char* out, std::size_t max_size,
+               std::size_t& size) noexcept {
+  if (hex.size() % 2 != 0 || hex.size() / 2 > max_size) {
+    return false;
+  }
+  auto value = [](char c) -> int {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  };
+  for (std::size_t i = 0; i < hex.size(); i += 2) {
+    auto hi = value(hex[i]);
+    auto lo = value(hex[i + 1]);
+    if (hi < 0 || lo < 0) {
+      return false;
+    }
+    out[i / 2] = static_cast<unsigned char>(hi * 16 + lo);
+  }
+  size = hex.size() / 2;
+  return true;
+}
+
+void OnKeylog(const SSL* ssl, const char* line) {
+  if (auto previous = GetPreviousCallbacks(ssl); previous && previous->keylog) {
+    previous->keylog(ssl, line);
+  }
+  auto secrets = static_cast<KtlsSecrets*>(SSL_get_ex_data(ssl, GetIndex()));
+  if (!secrets) {
+    return;
+  }
+  // <label> <client random> <secret>
+  std::string_view sv(line);
+  constexpr std::string_view kLabel = "SERVER_TRAFFIC_SECRET_0 ";
+  if (!sv.starts_with(kLabel)) {
+    return;
+  }
+  auto pos = sv.rfind(' ');
+  DecodeHex(sv.substr(pos + 1), secrets->secret, sizeof(secrets->secret),
+            secrets->secret_size);
+}
+
+// Called before each state change of the handshake state machine, with the
+// state being left
+void OnInfo(const SSL* ssl, int where, int ret) {
+  if (auto previous = GetPreviousCallbacks(ssl); previous && previous->info) {
+    previous->info(ssl, where, ret);
+  }
+  auto secrets = static_cast<KtlsSecrets*>(SSL_get_ex_data(ssl, GetIndex()));
+  if (!secrets || (where & SSL_CB_LOOP) == 0) {
+    return;
+  }
+  switch (SSL_get_state(ssl)) {
+    case TLS_ST_SW_SESSION_TICKET:
+      // TLS 1.3 tickets are sent after the handshake with the traffic keys
+      if (secrets->offloaded_fd < 0 && SSL_version(ssl) == TLS1_3_VERSION) {
+        ++secrets->tickets;
+      }
+      break;
+    case TLS_ST_SR_KEY_UPDATE:
+      // OpenSSL is about to send its KeyUpdate with the user space keys,
+      // which neither the kernel nor the peer would follow. The connection
+      // is closed instead.
+      if (secrets->offloaded_fd >= 0 &&
+          SSL_get_key_update_type(ssl) != SSL_KEY_UPDATE_NONE) {
+#if defined(__linux__)
+        shutdown(secrets->offloaded_fd, SHUT_RDWR);
+#endif
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+#if defined(__linux__)
+struct KeyMaterial {
+  unsigned char key[32];
+  std::size_t key_size = 0;
+  unsigned char salt[4];
+  unsigned char iv[8];
+  std::uint64_t seq = 0;
+};
+
+bool ExpandLabel(const EVP_MD* md, const unsigned char* secret,
+                 std::size_t secret_size, std::string_view label,
+                 unsigned char* out, std::size_t size) {
+  // struct HkdfLabel of RFC 8446 section 7.1 with an empty context
+  unsigned char info[2 + 1 + 255 + 1];
+  std::size_t info_size = 0;
+  std::string_view prefix = "tls13 ";
+  info[info_size++] = static_cast<unsigned char>(size >> 8);
+  info[info_size++] = static_cast<unsigned char>(size);
+  info[info_size++] =
+      static_cast<unsigned char>(prefix.size() + label.size());
+  std::memcpy(info + info_size, prefix.data(), prefix.size());
+  info_size += prefix.size();
+  std::memcpy(info + info_size, label.data(), label.size());
+  info_size += label.size();
+  info[info_size++] = 0;
+
+  auto pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+  if (!pctx) {
+    return false;
+  }
+  bool ok =
+      EVP_PKEY_derive_init(pctx) > 0 &&
+      EVP_PKEY_CTX_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+      EVP_PKEY_CTX_set_hkdf_md(pctx, md) > 0 &&
+      EVP_PKEY_CTX_set1_hkdf_key(pctx, secret, static_cast<int>(secret_size)) >
+          0 &&
+      EVP_PKEY_CTX_add1_hkdf_info(pctx, info, static_cast<int>(info_size)) >
+          0 &&
+      EVP_PKEY_derive(pctx, out, &size) > 0;
+  EVP_PKEY_CTX_free(pctx);
+  return ok;
+}
+
+bool DeriveTls13(SSL* ssl, const KtlsSecrets& secrets, KeyMaterial& km) {
+  if (secrets.secret_size == 0) {
+    return false;
+  }
+  auto md = SSL_CIPHER_get_handshake_digest(SSL_get_current_cipher(ssl));
+  unsigned char iv[12];
+  if (!md ||
+      !ExpandLabel(md, secrets.secret, secrets.secret_size, "key", km.key,
+                   km.key_size) ||
+      !ExpandLabel(md, secrets.secret, secrets.secret_size, "iv", iv,
+                   sizeof(iv))) {
+    return false;
+  }
+  std::memcpy(km.salt, iv, sizeof(km.salt));
+  std::memcpy(km.iv, iv + sizeof(km.salt), sizeof(km.iv));
+  km.seq = secrets.tickets;
+  return true;
+}
+
+bool DeriveTls12(SSL* ssl, KeyMaterial& km) {
+  auto md = SSL_CIPHER_get_handshake_digest(SSL_get_current_cipher(ssl));
+  unsigned char master[SSL_MAX_MASTER_KEY_LENGTH];
+  auto master_size =
+      SSL_SESSION_get_master_key(SSL_get_session(ssl), master, sizeof(master));
+  unsigned char client_random[SSL3_RANDOM_SIZE];
+  unsigned char server_random[SSL3_RANDOM_SIZE];
+  SSL_get_client_random(ssl, client_random, sizeof(client_random));
+  SSL_get_server_random(ssl, server_random, sizeof(server_random));
+  if (!md || master_size == 0) {
+    return false;
+  }
+
+  // AEAD key block: client key, server key, client salt, server salt
+  unsigned char block[2 * 32 + 2 * 4];
+  std::size_t block_size = 2 * km.key_size + 2 * sizeof(km.salt);
+  const unsigned char kLabel[] = "key expansion";
+  auto pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, nullptr);
+  if (!pctx) {
+    return false;
+  }
+  bool ok =
+      EVP_PKEY_derive_init(pctx) > 0 &&
+      EVP_PKEY_CTX_set_tls1_prf_md(pctx, md) > 0 &&
+      EVP_PKEY_CTX_set1_tls1_prf_secret(pctx, master,
+                                        static_cast<int>(master_size)) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, kLabel, sizeof(kLabel) - 1) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, server_random,
+                                      sizeof(server_random)) > 0 &&
+      EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, client_random,
+                                      sizeof(client_random)) > 0 &&
+      EVP_PKEY_derive(pctx, block, &block_size) > 0;
+  EVP_PKEY_CTX_free(pctx);
+  OPENSSL_cleanse(master, sizeof(master));
+  if (ok) {
+    std::memcpy(km.key, block + km.key_size, km.key_size);
+    std::memcpy(km.salt, block + 2 * km.key_size + sizeof(km.salt),
+                sizeof(km.salt));
+    // The server Finished record was the first one sent with these keys
+    km.seq = 1;
+    for (std::size_t i = 0; i < sizeof(km.iv); ++i) {
+      km.iv[i] = static_cast<unsigned char>(km.seq >> (56 - 8 * i));
+    }
+  }
+  OPENSSL_cleanse(block, sizeof(block));
+  return ok;
+}
+
+template <class CryptoInfo>
+bool SetCryptoInfo(int fd, std::uint16_t version, std::uint16_t cipher,
+                   const KeyMaterial& km) {
+  CryptoInfo info;
+  std::memset(&info, 0, sizeof(info));
+  info.info.version = version;
+  info.info.cipher_type = cipher;
+  std::memcpy(info.key, km.key, sizeof(info.key));
+  std::memcpy(info.salt, km.salt, sizeof(info.salt));
+  std::memcpy(info.iv, km.iv, sizeof(info.iv));
+  for (std::size_t i = 0; i < sizeof(info.rec_seq); ++i) {
+    info.rec_seq[i] = static_cast<unsigned char>(km.seq >> (56 - 8 * i));
+  }
+  bool ok = setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info)) == 0;
+  OPENSSL_cleanse(&info, sizeof(info));
+  return ok;
+}
+
+std::atomic<bool> kernel_unsupported = false;
+#endif
+
+}  // namespace
+
+void PrepareKtls(boost::asio::ssl::context& ctx) {
+  PrepareKtls(ctx.native_handle());
+}
+
+void PrepareKtls(SSL_CTX* ctx) {
+  if (SSL_CTX_get_keylog_callback(ctx) == &OnKeylog) {
+    return;  // already prepared
+  }
+  auto previous = new PreviousCallbacks;
+  previous->keylog = SSL_CTX_get_keylog_callback(ctx);
+  previous->info = SSL_CTX_get_info_callback(ctx);
+  SSL_CTX_set_ex_data(ctx, GetCtxIndex(), previous);
+  SSL_CTX_set_keylog_callback(ctx, &OnKeylog);
+  SSL_CTX_set_info_callback(ctx, &OnInfo);
+  // Renegotiation would require OpenSSL to write records, TLS 1.3 key
+  // updates close the offloaded connection (see OnInfo())
+  SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION);
+}
+
+void AttachKtlsSecrets(SSL* ssl, KtlsSecrets* secrets) noexcept {
+  SSL_set_ex_data(ssl, GetIndex(), secrets);
+}
+
+bool InstallKtlsSend(SSL* ssl, const KtlsSecrets& secrets, int fd) noexcept {
+#if defined(__linux__)
+  if (kernel_unsupported.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  auto cipher = SSL_get_current_cipher(ssl);
+  if (!cipher) {
+    return false;
+  }
+  KeyMaterial km;
+  std::uint16_t cipher_type = 0;
+  switch (SSL_CIPHER_get_id(cipher) & 0xffff) {
+    case 0x1301:  // TLS_AES_128_GCM_SHA256
+    case 0xc02b:  // ECDHE_ECDSA_WITH_AES_128_GCM_SHA256
+    case 0xc02f:  // ECDHE_RSA_WITH_AES_128_GCM_SHA256
+      cipher_type = TLS_CIPHER_AES_GCM_128;
+      km.key_size = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+      break;
+    case 0x1302:  // TLS_AES_256_GCM_SHA384
+    case 0xc02c:  // ECDHE_ECDSA_WITH_AES_256_GCM_SHA384
+    case 0xc030:  // ECDHE_RSA_WITH_AES_256_GCM_SHA384
+      cipher_type = TLS_CIPHER_AES_GCM_256;
+      km.key_size = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+      break;
+    default:
+      return false;
+  }
+  std::uint16_t version = 0;
+  bool derived = false;
+  if (SSL_version(ssl) == TLS1_3_VERSION) {
+    version = TLS_1_3_VERSION;
+    derived = DeriveTls13(ssl, secrets, km);
+  } else if (SSL_version(ssl) == TLS1_2_VERSION) {
+    version = TLS_1_2_VERSION;
+    derived = DeriveTls12(ssl, km);
+  }
+  if (!derived) {
+    return false;
+  }
+  bool ok = false;
+  if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0) {
+    if (cipher_type == TLS_CIPHER_AES_GCM_128) {
+      ok = SetCryptoInfo<tls12_crypto_info_aes_gcm_128>(fd, version,
+                                                        cipher_type, km);
+    } else {
+      ok = SetCryptoInfo<tls12_crypto_info_aes_gcm_256>(fd, version,
+                                                        cipher_type, km);
+    }
+  } else if (errno == ENOENT || errno == ENOPROTOOPT) {
+    // tls module not available, don't try again
+    kernel_unsupported.store(true, std::memory_order_relaxed);
+  }
+  OPENSSL_cleanse(&km, sizeof(km));
+  return ok;
+#else
+  return false;
+#endif
+}
+
+bool SendKtlsCloseNotify(int fd) noexcept {
+#if defined(__linux__)
+  unsigned char alert[2] = {1, 0};  // warning, close_notify
+  unsigned char record_type = 21;   // alert
+  char control[CMSG_SPACE(sizeof(record_type))];
+  iovec iov{alert, sizeof(alert)};
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  auto cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_TLS;
+  cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(record_type));
+  std::memcpy(CMSG_DATA(cmsg), &record_type, sizeof(record_type));
+  return sendmsg(fd, &msg, MSG_NOSIGNAL) == sizeof(alert);
+#else
+  return false;
+#endif
+}
+
+}  // namespace netkit::ssl
@@ -0,0 +1,126 @@
+#pragma once
+#include <boost/asio/async_result.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl.hpp>
+#include <cstdint>
+#include <memory>
+
+namespace netkit::ssl {
+
+// Traffic secret and record count captured during the handshake
+struct KtlsSecrets {
+  unsigned char secret[64];
+  std::size_t secret_size = 0;
+  std::uint64_t tickets = 0;
+  // Offloaded socket, shut down when the peer requests a KeyUpdate: OpenSSL
+  // would answer with records the kernel doesn't encrypt
+  int offloaded_fd = -1;
+};
+
+// Installs the callbacks that capture the TLS 1.3 traffic secrets, required on
+// every context whose connections may be offloaded. The keylog and info
+// callbacks already set on the context are still called.
+void PrepareKtls(boost::asio::ssl::context& ctx);
+
+void PrepareKtls(SSL_CTX* ctx);
+
+void AttachKtlsSecrets(SSL* ssl, KtlsSecrets* secrets) noexcept;
+
+// Hands the encryption of outgoing records to the kernel once the handshake
+// is done. Returns false and leaves the socket untouched when the kernel, the
+// protocol version or the cipher is not supported.
+bool InstallKtlsSend(SSL* ssl, const KtlsSecrets& secrets, int fd) noexcept;
+
+// Sends a close_notify alert through an offloaded socket
+bool SendKtlsCloseNotify(int fd) noexcept;
+
+// ssl_stream whose writes bypass OpenSSL after a successful Offload(), reads
+// are always decrypted in user space
+template <class NextLayer>
+class KtlsStream {
+ public:
+  using executor_type = typename NextLayer::executor_type;
+  using ssl_stream_type = boost::beast::ssl_stream<NextLayer>;
+
+  KtlsStream(NextLayer&& next_layer, boost::asio::ssl::context& ctx,
+             bool ktls)
+      : stream_(std::move(next_layer), ctx) {
+    if (ktls) {
+      secrets_ = std::make_unique<KtlsSecrets>();
+      AttachKtlsSecrets(stream_.native_handle(), secrets_.get());
+    }
+  }
+
+  executor_type get_executor() noexcept { return stream_.get_executor(); }
+
+  ssl_stream_type& ssl_stream() noexcept { return stream_; }
+
+  NextLayer& next_layer() noexcept { return stream_.next_layer(); }
+
+  SSL* native_handle() noexcept { return stream_.native_handle(); }
+
+  bool offloaded() const noexcept { return offloaded_; }
+
+  bool Offload() noexcept {
+    if (secrets_ && !offloaded_) {
+      auto fd =
+          boost::beast::get_lowest_layer(stream_).socket().native_handle();
+      offloaded_ = InstallKtlsSend(stream_.native_handle(), *secrets_, fd);
+      if (offloaded_) {
+        // Kept to watch for KeyUpdate, without the secret
+        OPENSSL_cleanse(secrets_->secret, sizeof(secrets_->secret));
+        secrets_->offloaded_fd = fd;
+      } else {
+        AttachKtlsSecrets(stream_.native_handle(), nullptr);
+        secrets_.reset();
+      }
+    }
+    return offloaded_;
+  }
+
+  template <class MutableBufferSequence, class ReadHandler>
+  auto async_read_some(const MutableBufferSequence& buffers,
+                       ReadHandler&& handler) {
+    return stream_.async_read_some(buffers,
+                                   std::forward<ReadHandler>(handler));
+  }
+
+  template <class ConstBufferSequence, class WriteToken>
+  auto async_write_some(const ConstBufferSequence& buffers,
+                        WriteToken&& token) {
+    return boost::asio::async_initiate<WriteToken,
+                                       void(boost::system::error_code,
+                                            std::size_t)>(
+        [this](auto handler, const ConstBufferSequence& buffers) {
+          if (offloaded_) {
+            stream_.next_layer().async_write_some(buffers, std::move(handler));
+          } else {
+            stream_.async_write_some(buffers, std::move(handler));
+          }
+        },
+        token, buffers);
+  }
+
+ private:
+  ssl_stream_type stream_;
+  std::unique_ptr<KtlsSecrets> secrets_;
+  bool offloaded_ = false;
+};
+
+// WebSocket closing handshake, an offloaded stream sends its close_notify
+// through the kernel before the TCP teardown
+template <class NextLayer, class TeardownHandler>
+void async_teardown(boost::beast::role_type role, KtlsStream<NextLayer>& stream,
+                    TeardownHandler&& handler) {
+  using boost::beast::websocket::async_teardown;
+  if (stream.offloaded()) {
+    SendKtlsCloseNotify(stream.next_layer().socket().native_handle());
+    async_teardown(role, stream.next_layer(),
+                   std::forward<TeardownHandler>(handler));
+  } else {
+    async_teardown(role, stream.ssl_stream(),
+                   std::forward<TeardownHandler>(handler));
+  }
+}
+
+}  // namespace netkit::ssl
@@ -0,0 +1,168 @@
+#include "session_manager.h"
+
+#include <openssl/rand.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
+
+namespace netkit::ssl {
+
+namespace {
+
+const unsigned char kSessionIdContext[] = "netkit";
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+using MacCtx = EVP_MAC_CTX;
+
+bool InitMac(MacCtx* mac_ctx, unsigned char* key, std::size_t size) {
+  char digest[] = "SHA256";
+  OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key, size),
+      OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+      OSSL_PARAM_construct_end()};
+  return EVP_MAC_CTX_set_params(mac_ctx, params) == 1;
+}
+#else
+using MacCtx = HMAC_CTX;
+
+bool InitMac(MacCtx* mac_ctx, unsigned char* key, std::size_t size) {
+  return HMAC_Init_ex(mac_ctx, key, static_cast<int>(size), EVP_sha256(),
+                      nullptr) == 1;
+}
+#endif
+
+}  // namespace
+
+SessionManager::SessionManager(const SessionOptions& options)
+    : options_(options) {
+  keys_.emplace_front(MakeTicketKey());
+}
+
+void SessionManager::Attach(boost::asio::ssl::context& ctx) {
+  Attach(ctx.native_handle());
+}
+
+void SessionManager::Attach(SSL_CTX* ctx) {
+  SSL_CTX_set_session_id_context(ctx, kSessionIdContext,
+                                 sizeof(kSessionIdContext) - 1);
+  if (options_.cache_size() > 0) {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, static_cast<long>(options_.cache_size()));
+  } else {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+  }
+  SSL_CTX_set_timeout(ctx,
+                      static_cast<long>(options_.session_timeout().count()));
+  if (options_.tickets()) {
+    SSL_CTX_set_ex_data(ctx, GetIndex(), this);
+    SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &TicketKeyCallback<MacCtx>);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx, &TicketKeyCallback<MacCtx>);
+#endif
+  } else {
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  }
+}
+
+void SessionManager::RotateTicketKeys() {
+  auto key = MakeTicketKey();
+  std::lock_guard lock(mutex_);
+  keys_.emplace_front(key);
+  while (keys_.size() > options_.ticket_key_count()) {
+    keys_.pop_back();
+  }
+}
+
+SessionManager::TicketKey SessionManager::MakeTicketKey() const {
+  TicketKey key;
+  if (RAND_bytes(key.name, sizeof(key.name)) != 1 ||
+      RAND_bytes(key.aes_key, sizeof(key.aes_key)) != 1 ||
+      RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) != 1) {
+    throw std::runtime_error("Failed to generate session ticket key");
+  }
+  key.created = std::chrono::steady_clock::now();
+  return key;
+}
+
+bool SessionManager::GetEncryptKey(TicketKey& key) {
+  auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard lock(mutex_);
+    if (now - keys_.front().created < options_.ticket_key_lifetime()) {
+      key = keys_.front();
+      return true;
+    }
+  }
+  try {
+    RotateTicketKeys();
+  } catch (const std::exception&) {
+    return false;
+  }
+  std::lock_guard lock(mutex_);
+  key = keys_.front();
+  return true;
+}
+
+bool SessionManager::GetDecryptKey(const unsigned char* name, TicketKey& key,
+                                   bool& renew) {
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard lock(mutex_);
+  for (std::size_t i = 0; i < keys_.size(); ++i) {
+    if (std::memcmp(keys_[i].name, name, sizeof(key.name)) == 0) {
+      key = keys_[i];
+      renew = (i > 0 || now - key.created >= options_.ticket_key_lifetime());
+      return true;
+    }
+  }
+  return false;
+}
+
+int SessionManager::GetIndex() noexcept {
+  static int index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+template <class MacCtx>
+int SessionManager::TicketKeyCallback(SSL* ssl, unsigned char* name,
+                                      unsigned char* iv,
+                                      EVP_CIPHER_CTX* cipher_ctx,
+                                      MacCtx* mac_ctx, int enc) {
+  auto self = static_cast<SessionManager*>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), GetIndex()));
+  if (!self) {
+    return 0;
+  }
+  TicketKey key;
+  if (enc) {
+    if (!self->GetEncryptKey(key) ||
+        RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+      return -1;
+    }
+    std::memcpy(name, key.name, sizeof(key.name));
+    if (EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr,
+                           key.aes_key, iv) != 1 ||
+        !InitMac(mac_ctx, key.hmac_key, sizeof(key.hmac_key))) {
+      return -1;
+    }
+    return 1;
+  }
+  bool renew = false;
+  if (!self->GetDecryptKey(name, key, renew)) {
+    return 0;  // unknown or expired key, fall back to a full handshake
+  }
+  if (!InitMac(mac_ctx, key.hmac_key, sizeof(key.hmac_key)) ||
+      EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key,
+                         iv) != 1) {
+    return -1;
+  }
+  return renew ? 2 : 1;
+}
+
+}  // namespace netkit::ssl
@@ -0,0 +1,111 @@
+#pragma once
+#include <boost/asio/ssl.hpp>
+#include <chrono>
+#include <deque>
+#include <mutex>
+
+namespace netkit::ssl {
+
+class SessionOptions {
+ public:
+  // Number of sessions kept in the server-side cache, 0 disables the cache
+  std::size_t cache_size() const noexcept { return cache_size_; }
+
+  SessionOptions& set_cache_size(std::size_t val) noexcept {
+    cache_size_ = val;
+    return *this;
+  }
+
+  const std::chrono::seconds& session_timeout() const noexcept {
+    return session_timeout_;
+  }
+
+  SessionOptions& set_session_timeout(
+      const std::chrono::seconds& val) noexcept {
+    session_timeout_ = val;
+    return *this;
+  }
+
+  bool tickets() const noexcept { return tickets_; }
+
+  SessionOptions& set_tickets(bool val) noexcept {
+    tickets_ = val;
+    return *this;
+  }
+
+  // New tickets are encrypted with a fresh key once the current one is older
+  // than this
+  const std::chrono::seconds& ticket_key_lifetime() const noexcept {
+    return ticket_key_lifetime_;
+  }
+
+  SessionOptions& set_ticket_key_lifetime(
+      const std::chrono::seconds& val) noexcept {
+    ticket_key_lifetime_ = val;
+    return *this;
+  }
+
+  // Number of keys (current one included) still accepted for decryption
+  std::size_t ticket_key_count() const noexcept { return ticket_key_count_; }
+
+  SessionOptions& set_ticket_key_count(std::size_t val) noexcept {
+    ticket_key_count_ = val > 0 ? val : 1;
+    return *this;
+  }
+
+ private:
+  std::size_t cache_size_ = 20 * 1024;
+  std::chrono::seconds session_timeout_ = std::chrono::hours(1);
+  bool tickets_ = true;
+  std::chrono::seconds ticket_key_lifetime_ = std::chrono::hours(1);
+  std::size_t ticket_key_count_ = 2;
+};
+
+class SessionManager {
+ public:
+  explicit SessionManager(const SessionOptions& options = {});
+
+  ~SessionManager() noexcept {}
+
+  SessionManager(const SessionManager&) = delete;
+  SessionManager& operator=(const SessionManager&) = delete;
+
+  const SessionOptions& options() const noexcept { return options_; }
+
+  // Configures the session cache and the ticket callback of the context, the
+  // manager must outlive the context
+  void Attach(boost::asio::ssl::context& ctx);
+
+  void Attach(SSL_CTX* ctx);
+
+  // Forces a new ticket key, the previous ones stay valid for decryption
+  void RotateTicketKeys();
+
+ private:
+  struct TicketKey {
+    unsigned char name[16];
+    unsigned char aes_key[32];
+    unsigned char hmac_key[32];
+    std::chrono::steady_clock::time_point created;
+  };
+
+  TicketKey MakeTicketKey() const;
+
+  bool GetEncryptKey(TicketKey& key);
+
+  bool GetDecryptKey(const unsigned char* name, TicketKey& key, bool& renew);
+
+  static int GetIndex() noexcept;
+
+  template <class MacCtx>
+  static int TicketKeyCallback(SSL* ssl, unsigned char* name,
+                               unsigned char* iv, EVP_CIPHER_CTX* cipher_ctx,
+                               MacCtx* mac_ctx, int enc);
+
+ private:
+  SessionOptions options_;
+  std::mutex mutex_;
+  std::deque<TicketKey> keys_;
+};
+
+}  // namespace netkit::ssl
@@ -0,0 +1,238 @@
+#include "supervisor.h"
+
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#endif
+
+namespace netkit {
+
+#if !defined(_WIN32)
+static_assert(std::atomic<std::int64_t>::is_always_lock_free &&
+                  std::atomic<std::size_t>::is_always_lock_free,
+              "Shared memory counters must be lock free");
+
+// Crashing sooner than this after being forked doubles the restart delay
+static constexpr auto kMinUptime = std::chrono::seconds(1);
+
+static constexpr auto kMaxRestartDelay = std::chrono::seconds(5);
+
+static void Publish(std::shared_ptr<boost::asio::steady_timer> timer,
+                    IoContextPool& pool, WorkerLoad& load,
+                    const std::chrono::milliseconds& interval,
+                    const std::function<void()>& store) {
+  store();
+  timer->expires_after(interval);
+  timer->async_wait([timer, &pool, &load, interval,
+                     store](const boost::system::error_code& ec) {
+    if (!ec) {
+      Publish(timer, pool, load, interval, store);
+    }
+  });
+}
+
+void WorkerLoad::Track(IoContextPool& pool,
+                       const std::chrono::milliseconds& interval) {
+  auto store = [this, &pool]() {
+    std::size_t connections = 0;
+    std::size_t pending = 0;
+    std::int64_t lag = 0;
+    for (std::size_t i = 0; i < pool.size(); ++i) {
+      const auto& load = pool.load(i);
+      connections += load.connections();
+      pending += load.pending();
+      lag = std::max<std::int64_t>(lag, load.lag().count());
+    }
+    connections_.store(connections, std::memory_order_relaxed);
+    pending_.store(pending, std::memory_order_relaxed);
+    lag_.store(lag, std::memory_order_relaxed);
+  };
+  Publish(std::make_shared<boost::asio::steady_timer>(pool.At(0)), pool,
+          *this, interval, store);
+}
+
+Supervisor::Supervisor(std::size_t workers) : size_(workers) {
+  auto memory = mmap(nullptr, sizeof(WorkerLoad) * size_,
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    throw std::runtime_error("Failed to map the worker load block");
+  }
+  loads_ = static_cast<WorkerLoad*>(memory);
+  for (std::size_t i = 0; i < size_; ++i) {
+    new (&loads_[i]) WorkerLoad();
+  }
+}
+
+Supervisor::~Supervisor() noexcept {
+  for (const auto& fds : listeners_) {
+    for (auto fd : fds) {
+      ::close(fd);
+    }
+  }
+  for (std::size_t i = 0; i < size_; ++i) {
+    loads_[i].~WorkerLoad();
+  }
+  munmap(loads_, sizeof(WorkerLoad) * size_);
+}
+
+void Supervisor::Listen(const std::string& address, std::uint16_t port,
+                        bool reuse_address) {
+  auto error = socket_options_.Validate();
+  if (!error.empty()) {
+    throw std::runtime_error("Invalid socket options: " + error);
+  }
+  // Only creates the sockets, no io_context is alive across fork()
+  boost::asio::io_context ioc;
+  boost::asio::ip::tcp::endpoint endpoint(
+      boost::asio::ip::make_address(address), port);
+  bool reuse_port = reuse_port_;
+#ifndef SO_REUSEPORT
+  reuse_port = false;
+#endif
+  std::vector<NativeHandle> fds;
+  std::size_t count = reuse_port ? size_ : 1;
+  for (std::size_t i = 0; i < count; ++i) {
+    boost::asio::ip::tcp::acceptor acceptor(ioc);
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(boost::asio::socket_base::reuse_address(reuse_address));
+#ifdef SO_REUSEPORT
+    if (reuse_port) {
+      acceptor.set_option(
+          boost::asio::detail::socket_option::boolean<SOL_SOCKET,
+                                                      SO_REUSEPORT>(true));
+    }
+#endif
+    boost::system::error_code ec;
+    socket_options_.ApplyToListener(acceptor, ec);
+    if (ec) {
+      throw boost::system::system_error(ec, "socket options");
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen(socket_options_.backlog());
+    endpoint = acceptor.local_endpoint();
+    fds.push_back(acceptor.release());
+  }
+  listeners_.emplace_back(std::move(fds));
+}
+
+void Supervisor::Run(const Worker& worker) {
+  if (listeners_.empty()) {
+    throw std::runtime_error("Supervisor::Listen() must be called first");
+  }
+  stopping_ = false;
+  using Clock = std::chrono::steady_clock;
+  std::vector<Clock::time_point> started(size_, Clock::now());
+  std::vector<std::chrono::milliseconds> delays(size_, restart_delay_);
+  for (std::size_t i = 0; i < size_; ++i) {
+    Fork(i, worker);
+  }
+  std::size_t alive = size_;
+  while (alive > 0) {
+    int status = 0;
+    auto pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    auto index = size_;
+    for (std::size_t i = 0; i < size_; ++i) {
+      if (loads_[i].pid() == pid) {
+        index = i;
+        break;
+      }
+    }
+    if (index == size_) {
+      continue;
+    }
+    auto& load = loads_[index];
+    load.pid_ = 0;
+    load.connections_ = 0;
+    load.pending_ = 0;
+    load.lag_ = 0;
+    bool crashed = WIFSIGNALED(status) ||
+                   (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+    if (!crashed || stopping_) {
+      --alive;
+      continue;
+    }
+    // Backs off a worker crashing on startup
+    if (Clock::now() - started[index] < kMinUptime) {
+      delays[index] = std::min<std::chrono::milliseconds>(delays[index] * 2,
+                                                          kMaxRestartDelay);
+    } else {
+      delays[index] = restart_delay_;
+    }
+    std::this_thread::sleep_for(delays[index]);
+    if (stopping_) {
+      --alive;
+      continue;
+    }
+    load.restarts_.fetch_add(1, std::memory_order_relaxed);
+    started[index] = Clock::now();
+    Fork(index, worker);
+    if (stopping_) {
+      kill(static_cast<pid_t>(load.pid()), SIGTERM);
+    }
+  }
+}
+
+void Supervisor::Stop() noexcept {
+  stopping_ = true;
+  for (std::size_t i = 0; i < size_; ++i) {
+    auto pid = loads_[i].pid();
+    if (pid > 0) {
+      kill(static_cast<pid_t>(pid), SIGTERM);
+    }
+  }
+}
+
+void Supervisor::Fork(std::size_t index, const Worker& worker) {
+  auto pid = fork();
+  if (pid < 0) {
+    throw std::runtime_error("Failed to fork a worker");
+  }
+  if (pid > 0) {
+    loads_[index].pid_ = pid;
+    return;
+  }
+  // Handlers of the supervisor, Stop() in particular, must not run here
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGINT, SIG_DFL);
+#if defined(__linux__)
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+  loads_[index].pid_ = getpid();
+  int code = 0;
+  try {
+    worker(index, ListenersOf(index));
+  } catch (const std::exception&) {
+    code = 1;
+  }
+  // Skips the destructors and atexit handlers of the supervisor
+  _exit(code);
+}
+
+std::vector<Supervisor::NativeHandle> Supervisor::ListenersOf(
+    std::size_t index) const {
+  std::vector<NativeHandle> fds;
+  for (const auto& group : listeners_) {
+    fds.push_back(group.size() == 1 ? group[0] : group[index]);
+  }
+  return fds;
+}
+#endif
+
+}  // namespace netkit
@@ -0,0 +1,140 @@
+#pragma once
+#include <netkit/io_context_pool.h>
+#include <netkit/tcp/socket_options.h>
+
+#include <atomic>
+#include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace netkit {
+
+#if !defined(_WIN32)
+// Load of one worker process, in memory shared by the supervisor and the
+// workers. Written by the worker, see Track().
+class WorkerLoad {
+ public:
+  // 0 while the worker is down
+  std::int64_t pid() const noexcept {
+    return pid_.load(std::memory_order_relaxed);
+  }
+
+  // Sum over the contexts of the worker pool
+  std::size_t connections() const noexcept {
+    return connections_.load(std::memory_order_relaxed);
+  }
+
+  std::size_t pending() const noexcept {
+    return pending_.load(std::memory_order_relaxed);
+  }
+
+  // Highest loop lag among the contexts of the worker pool
+  std::chrono::microseconds lag() const noexcept {
+    return std::chrono::microseconds(lag_.load(std::memory_order_relaxed));
+  }
+
+  // Times the worker was restarted after a crash
+  std::size_t restarts() const noexcept {
+    return restarts_.load(std::memory_order_relaxed);
+  }
+
+  // Publishes the load of the pool every interval while it runs, called by
+  // the worker once its pool exists
+  void Track(IoContextPool& pool, const std::chrono::milliseconds& interval =
+                                      std::chrono::milliseconds(100));
+
+ private:
+  friend class Supervisor;
+  std::atomic<std::int64_t> pid_ = 0;
+  std::atomic<std::size_t> connections_ = 0;
+  std::atomic<std::size_t> pending_ = 0;
+  std::atomic<std::int64_t> lag_ = 0;
+  std::atomic<std::size_t> restarts_ = 0;
+};
+
+// Prefork mode, for handlers which don't scale over threads of one process.
+// The supervisor binds the listening sockets and forks the workers, each one
+// runs its own IoContextPool and BasicServer on the inherited sockets (see
+// BasicServer::ServeListeners()). Crashed workers are forked again.
+class Supervisor {
+  using Self = Supervisor;
+
+ public:
+  using NativeHandle = boost::asio::ip::tcp::acceptor::native_handle_type;
+
+  // Runs in the worker process with the listening sockets it serves, the
+  // process exits when it returns
+  using Worker = std::function<void(std::size_t index,
+                                    const std::vector<NativeHandle>& fds)>;
+
+  explicit Supervisor(std::size_t workers);
+
+  ~Supervisor() noexcept;
+
+  Supervisor(const Supervisor&) = delete;
+  Supervisor& operator=(const Supervisor&) = delete;
+
+  // Applied by the next Listen()
+  Self& set_socket_options(const tcp::SocketOptions& val) {
+    socket_options_ = val;
+    return *this;
+  }
+
+  // With reuse_port every worker gets its own SO_REUSEPORT socket and the
+  // kernel spreads the connections, otherwise the workers share one socket.
+  // Applied by the next Listen().
+  Self& set_reuse_port(bool val) noexcept {
+    reuse_port_ = val;
+    return *this;
+  }
+
+  // Pause before forking a crashed worker again, doubled while it keeps
+  // crashing within the delay and capped at a few seconds
+  Self& set_restart_delay(const std::chrono::milliseconds& val) noexcept {
+    restart_delay_ = val;
+    return *this;
+  }
+
+  // Binds the sockets, before Run(). The workers get the sockets of every
+  // call in the order of the calls.
+  void Listen(const std::string& address, std::uint16_t port,
+              bool reuse_address = true);
+
+  // Forks the workers and waits for them, restarting the crashed ones until
+  // Stop(). Workers are forked from the calling thread only, the other
+  // threads of the supervisor don't exist in them.
+  void Run(const Worker& worker);
+
+  // Sends SIGTERM to the workers and makes Run() return once they exited.
+  // Async-signal-safe.
+  void Stop() noexcept;
+
+  std::size_t size() const noexcept { return size_; }
+
+  const WorkerLoad& load(std::size_t index) const noexcept {
+    return loads_[index];
+  }
+
+  WorkerLoad& load(std::size_t index) noexcept { return loads_[index]; }
+
+ private:
+  void Fork(std::size_t index, const Worker& worker);
+
+  std::vector<NativeHandle> ListenersOf(std::size_t index) const;
+
+ private:
+  std::size_t size_;
+  WorkerLoad* loads_;
+  // One socket per Listen(), or one per worker with reuse_port
+  std::vector<std::vector<NativeHandle>> listeners_;
+  tcp::SocketOptions socket_options_;
+  bool reuse_port_ = false;
+  std::chrono::milliseconds restart_delay_ = std::chrono::milliseconds(100);
+  std::atomic<bool> stopping_ = false;
+};
+#endif
+
+}  // namespace netkit
@@ -1,5 +1,11 @@
 #pragma once
 #include <netkit/io_context_pool.h>
+#include <netkit/tcp/socket_options.h>
+
+#include <boost/asio/ip/tcp.hpp>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 namespace netkit::tcp {
 
@@ -7,56 +13,200 @@ class Listener {
   using Self = Listener;
 
  public:
-  explicit Listener(IoContextPool& pool) noexcept
-      : pool_(pool), socket_(pool.Get()), acceptor_(pool.Get()) {}
+  using NativeHandle = boost::asio::ip::tcp::acceptor::native_handle_type;
+
+  explicit Listener(IoContextPool& pool) noexcept : pool_(pool) {}
 
   ~Listener() noexcept {}
 
+  // Applied by the next ListenAndAccept() and to every accepted socket
+  Listener& set_socket_options(const SocketOptions& options) {
+    options_ = options;
+    return *this;
+  }
+
+  // With reuse_port every io_context of the pool gets its own SO_REUSEPORT
+  // acceptor, the kernel spreads the connections and each socket stays on
+  // the thread which accepted it. Otherwise a single acceptor hands the
+  // sockets out to the pool. The handler may then run on several threads.
+  // Nothing stays bound when an acceptor fails to listen.
   template <class Handler>
   void ListenAndAccept(const std::string& address, std::uint16_t port,
-                       bool reuse_address, Handler&& handler) {
+                       bool reuse_address, bool reuse_port,
+                       Handler&& handler) {
+    auto error = options_.Validate();
+    if (!error.empty()) {
+      throw std::runtime_error("Invalid socket options: " + error);
+    }
     boost::asio::ip::tcp::endpoint endpoint(
         boost::asio::ip::make_address(address), port);
-    acceptor_.open(endpoint.protocol());
-    acceptor_.set_option(
-        boost::asio::socket_base::reuse_address(reuse_address));
-    acceptor_.bind(endpoint);
-    acceptor_.listen();
-    DoAccept(std::forward<Handler>(handler));
+#ifndef SO_REUSEPORT
+    // Not available (Windows), a single acceptor is used
+    reuse_port = false;
+#endif
+    std::size_t count = reuse_port ? pool_.size() : 1;
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::acceptor>> acceptors;
+    for (std::size_t i = 0; i < count; ++i) {
+      auto& ctx = reuse_port ? pool_.At(i) : pool_.Get();
+      auto acceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(ctx);
+      acceptor->open(endpoint.protocol());
+      acceptor->set_option(
+          boost::asio::socket_base::reuse_address(reuse_address));
+#ifdef SO_REUSEPORT
+      if (reuse_port) {
+        acceptor->set_option(
+            boost::asio::detail::socket_option::boolean<SOL_SOCKET,
+                                                        SO_REUSEPORT>(true));
+      }
+#endif
+      boost::system::error_code ec;
+      options_.ApplyToListener(*acceptor, ec);
+      if (ec) {
+        throw boost::system::system_error(ec, "socket options");
+      }
+      acceptor->bind(endpoint);
+      acceptor->listen(options_.backlog());
+      // Port 0 binds the other acceptors to the one picked for the first
+      endpoint = acceptor->local_endpoint();
+      acceptors.emplace_back(std::move(acceptor));
+    }
+    std::size_t first = acceptors_.size();
+    for (auto& acceptor : acceptors) {
+      acceptors_.emplace_back(std::move(acceptor));
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      DoAccept(*acceptors_[first + i], reuse_port ? &pool_.At(i) : nullptr,
+               handler);
+    }
+  }
+
+  // Accepts on listening sockets bound by another process, see
+  // native_handles(). SO_REUSEPORT sockets bound to the same address are
+  // spread over the contexts of the pool, and their connections stay on the
+  // context which accepted them when there is a socket for every context,
+  // as with ListenAndAccept(). Other sockets hand the connections out to the
+  // pool. The listener owns the descriptors from then on.
+  template <class Handler>
+  void Adopt(const std::vector<NativeHandle>& fds, Handler&& handler) {
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::acceptor>> adopted;
+    std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+    std::vector<bool> reuse_ports;
+    for (auto fd : fds) {
+      auto acceptor =
+          std::make_unique<boost::asio::ip::tcp::acceptor>(pool_.At(0));
+      acceptor->assign(boost::asio::ip::tcp::v4(), fd);
+      // The address family is only known from the bound address
+      endpoints.push_back(acceptor->local_endpoint());
+      if (endpoints.back().protocol() != boost::asio::ip::tcp::v4()) {
+        acceptor->assign(endpoints.back().protocol(), acceptor->release());
+      }
+      reuse_ports.push_back(IsReusePort(*acceptor));
+      adopted.emplace_back(std::move(acceptor));
+    }
+    // Position of every socket within its group and size of the group
+    std::vector<std::size_t> positions(fds.size(), 0);
+    std::vector<std::size_t> sizes(fds.size(), 1);
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+      for (std::size_t j = 0; j < fds.size() && reuse_ports[i]; ++j) {
+        if (j != i && reuse_ports[j] && endpoints[j] == endpoints[i]) {
+          ++sizes[i];
+          positions[i] += j < i;
+        }
+      }
+    }
+    std::size_t first = acceptors_.size();
+    std::vector<boost::asio::io_context*> contexts;
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+      auto& ctx =
+          sizes[i] > 1 ? pool_.At(positions[i] % pool_.size()) : pool_.Get();
+      if (&ctx != &pool_.At(0)) {
+        auto acceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(ctx);
+        acceptor->assign(endpoints[i].protocol(), adopted[i]->release());
+        adopted[i] = std::move(acceptor);
+      }
+      contexts.push_back(sizes[i] > 1 && sizes[i] >= pool_.size() ? &ctx
+                                                                 : nullptr);
+      acceptors_.emplace_back(std::move(adopted[i]));
+    }
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+      DoAccept(*acceptors_[first + i], contexts[i], handler);
+    }
+  }
+
+  // Listening descriptors of the open acceptors, for handing them over
+  std::vector<NativeHandle> native_handles() {
+    std::vector<NativeHandle> fds;
+    for (const auto& acceptor : acceptors_) {
+      if (acceptor->is_open()) {
+        fds.emplace_back(acceptor->native_handle());
+      }
+    }
+    return fds;
+  }
+
+  // Closes every acceptor, see Close(std::size_t) to close them on their own
+  // threads
+  void Close() {
+    for (std::size_t i = 0; i < acceptors_.size(); ++i) {
+      DoClose(i);
+    }
   }
 
-  void Close() { DoClose(); }
+  void Close(std::size_t index) { DoClose(index); }
+
+  IoContextPool& pool() noexcept { return pool_; }
 
-  boost::asio::any_io_executor executor() noexcept {
-    return acceptor_.get_executor();
+  // Number of acceptors, 0 before ListenAndAccept()
+  std::size_t size() const noexcept { return acceptors_.size(); }
+
+  boost::asio::any_io_executor executor(std::size_t index = 0) noexcept {
+    return acceptors_[index]->get_executor();
   }
 
  private:
+  // Sockets are created on ctx, or on the next context of the pool when null
   template <class Handler>
-  void DoAccept(Handler&& handler) {
-    acceptor_.async_accept(
-        socket_, [this, handler = std::forward<Handler>(handler)](
-                     const boost::system::error_code& ec) mutable {
+  void DoAccept(boost::asio::ip::tcp::acceptor& acceptor,
+                boost::asio::io_context* ctx, Handler handler) {
+    acceptor.async_accept(
+        ctx ? *ctx : pool_.Get(),
+        [this, &acceptor, ctx, handler = std::move(handler)](
+            const boost::system::error_code& ec,
+            boost::asio::ip::tcp::socket socket) mutable {
           if (!ec) {
-            handler(std::move(socket_));
+            // Best effort, the connection is served either way
+            boost::system::error_code option_ec;
+            options_.ApplyToConnection(socket, option_ec);
+            handler(std::move(socket));
           }
-          if (acceptor_.is_open()) {
-            socket_ = boost::asio::ip::tcp::socket(pool_.Get());
-            DoAccept(std::move(handler));
+          if (acceptor.is_open()) {
+            DoAccept(acceptor, ctx, std::move(handler));
           }
         });
   }
 
-  void DoClose() noexcept {
+  static bool IsReusePort(boost::asio::ip::tcp::acceptor& acceptor) noexcept {
+#ifdef SO_REUSEPORT
+    boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+        option;
+    boost::system::error_code ec;
+    acceptor.get_option(option, ec);
+    return !ec && option.value();
+#else
+    return false;
+#endif
+  }
+
+  void DoClose(std::size_t index) noexcept {
     boost::system::error_code ec;
-    acceptor_.cancel(ec);
-    acceptor_.close(ec);
+    acceptors_[index]->cancel(ec);
+    acceptors_[index]->close(ec);
   }
 
  private:
   IoContextPool& pool_;
-  boost::asio::ip::tcp::socket socket_;
-  boost::asio::ip::tcp::acceptor acceptor_;
+  SocketOptions options_;
+  std::vector<std::unique_ptr<boost::asio::ip::tcp::acceptor>> acceptors_;
 };
 
 }  // namespace netkit::tcp
@@ -0,0 +1,144 @@
+#include "socket_options.h"
+
+#include <climits>
+
+#if defined(__linux__)
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace netkit::tcp {
+
+std::string SocketOptions::Validate() const {
+  if (backlog_ <= 0) {
+    return "backlog must be positive";
+  }
+  if (defer_accept_) {
+#if defined(TCP_DEFER_ACCEPT)
+    if (defer_accept_->count() <= 0 || defer_accept_->count() > INT_MAX) {
+      return "defer_accept must be between 1s and INT_MAX seconds";
+    }
+#else
+    return "defer_accept is not supported on this platform";
+#endif
+  }
+  if (fast_open_) {
+#if defined(__linux__) && defined(TCP_FASTOPEN)
+    if (*fast_open_ <= 0) {
+      return "fast_open queue length must be positive";
+    }
+#else
+    return "fast_open is not supported on this platform";
+#endif
+  }
+  if (receive_buffer_size_ && *receive_buffer_size_ <= 0) {
+    return "receive_buffer_size must be positive";
+  }
+  if (send_buffer_size_ && *send_buffer_size_ <= 0) {
+    return "send_buffer_size must be positive";
+  }
+  if (quick_ack_) {
+#if !defined(TCP_QUICKACK)
+    return "quick_ack is not supported on this platform";
+#endif
+  }
+  if (busy_poll_) {
+#if defined(SO_BUSY_POLL)
+    if (busy_poll_->count() < 0 || busy_poll_->count() > INT_MAX) {
+      return "busy_poll must be between 0 and INT_MAX microseconds";
+    }
+#else
+    return "busy_poll is not supported on this platform";
+#endif
+  }
+  return {};
+}
+
+void SocketOptions::ApplyToListener(boost::asio::ip::tcp::acceptor& acceptor,
+                                    boost::system::error_code& ec) const {
+  if (receive_buffer_size_) {
+    acceptor.set_option(
+        boost::asio::socket_base::receive_buffer_size(*receive_buffer_size_),
+        ec);
+    if (ec) {
+      return;
+    }
+  }
+  if (send_buffer_size_) {
+    acceptor.set_option(
+        boost::asio::socket_base::send_buffer_size(*send_buffer_size_), ec);
+    if (ec) {
+      return;
+    }
+  }
+#if defined(TCP_DEFER_ACCEPT)
+  if (defer_accept_) {
+    acceptor.set_option(
+        boost::asio::detail::socket_option::integer<IPPROTO_TCP,
+                                                    TCP_DEFER_ACCEPT>(
+            static_cast<int>(defer_accept_->count())),
+        ec);
+    if (ec) {
+      return;
+    }
+  }
+#endif
+#if defined(__linux__) && defined(TCP_FASTOPEN)
+  if (fast_open_) {
+    acceptor.set_option(
+        boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_FASTOPEN>(
+            *fast_open_),
+        ec);
+    if (ec) {
+      return;
+    }
+  }
+#endif
+}
+
+void SocketOptions::ApplyToConnection(boost::asio::ip::tcp::socket& socket,
+                                      boost::system::error_code& ec) const {
+  if (no_delay_) {
+    socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+    if (ec) {
+      return;
+    }
+  }
+#if defined(TCP_QUICKACK)
+  if (quick_ack_) {
+    socket.set_option(
+        boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_QUICKACK>(
+            true),
+        ec);
+    if (ec) {
+      return;
+    }
+  }
+#endif
+#if defined(SO_BUSY_POLL)
+  if (busy_poll_) {
+    socket.set_option(
+        boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>(
+            static_cast<int>(busy_poll_->count())),
+        ec);
+    if (ec) {
+      return;
+    }
+  }
+#endif
+}
+
+void SocketOptions::BeforeRead(
+    boost::asio::ip::tcp::socket& socket) const noexcept {
+#if defined(TCP_QUICKACK)
+  if (quick_ack_) {
+    boost::system::error_code ec;
+    socket.set_option(
+        boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_QUICKACK>(
+            true),
+        ec);
+  }
+#endif
+}
+
+}  // namespace netkit::tcp
@@ -0,0 +1,121 @@
+#pragma once
+#include <boost/asio/ip/tcp.hpp>
+#include <chrono>
+#include <optional>
+#include <string>
+
+namespace netkit::tcp {
+
+// Options of a listening socket and of the connections accepted on it, unset
+// ones keep the system defaults
+class SocketOptions {
+ public:
+  // Length of the queue of completed connections
+  int backlog() const noexcept { return backlog_; }
+
+  SocketOptions& set_backlog(int val) noexcept {
+    backlog_ = val;
+    return *this;
+  }
+
+  // Connections are reported once data arrived or the timeout elapsed
+  // (Linux TCP_DEFER_ACCEPT)
+  const std::optional<std::chrono::seconds>& defer_accept() const noexcept {
+    return defer_accept_;
+  }
+
+  SocketOptions& set_defer_accept(
+      const std::optional<std::chrono::seconds>& val) noexcept {
+    defer_accept_ = val;
+    return *this;
+  }
+
+  // Length of the queue of pending TCP Fast Open requests (TCP_FASTOPEN)
+  const std::optional<int>& fast_open() const noexcept { return fast_open_; }
+
+  SocketOptions& set_fast_open(const std::optional<int>& val) noexcept {
+    fast_open_ = val;
+    return *this;
+  }
+
+  // SO_RCVBUF, set on the listener so that the window scale of accepted
+  // connections takes it into account
+  const std::optional<int>& receive_buffer_size() const noexcept {
+    return receive_buffer_size_;
+  }
+
+  SocketOptions& set_receive_buffer_size(
+      const std::optional<int>& val) noexcept {
+    receive_buffer_size_ = val;
+    return *this;
+  }
+
+  // SO_SNDBUF, inherited by accepted connections
+  const std::optional<int>& send_buffer_size() const noexcept {
+    return send_buffer_size_;
+  }
+
+  SocketOptions& set_send_buffer_size(const std::optional<int>& val) noexcept {
+    send_buffer_size_ = val;
+    return *this;
+  }
+
+  // Disables Nagle's algorithm on accepted connections (TCP_NODELAY)
+  bool no_delay() const noexcept { return no_delay_; }
+
+  SocketOptions& set_no_delay(bool val) noexcept {
+    no_delay_ = val;
+    return *this;
+  }
+
+  // Acknowledges immediately instead of delaying ACKs (Linux TCP_QUICKACK).
+  // The kernel clears it on its own, see BeforeRead().
+  bool quick_ack() const noexcept { return quick_ack_; }
+
+  SocketOptions& set_quick_ack(bool val) noexcept {
+    quick_ack_ = val;
+    return *this;
+  }
+
+  // Busy polls the device queue on blocking reads for this long (Linux
+  // SO_BUSY_POLL), raising it above net.core.busy_read needs CAP_NET_ADMIN
+  const std::optional<std::chrono::microseconds>& busy_poll() const noexcept {
+    return busy_poll_;
+  }
+
+  SocketOptions& set_busy_poll(
+      const std::optional<std::chrono::microseconds>& val) noexcept {
+    busy_poll_ = val;
+    return *this;
+  }
+
+  // Empty when valid, otherwise the first invalid or unsupported option
+  std::string Validate() const;
+
+  // Before bind()
+  void ApplyToListener(boost::asio::ip::tcp::acceptor& acceptor,
+                       boost::system::error_code& ec) const;
+
+  void ApplyToConnection(boost::asio::ip::tcp::socket& socket,
+                         boost::system::error_code& ec) const;
+
+  // Re-arms the options the kernel resets, called before reading a request so
+  // that a client waiting for an ACK (Nagle) doesn't wait for a delayed one
+  void BeforeRead(boost::asio::ip::tcp::socket& socket) const noexcept;
+
+  // Nothing to re-arm on other sockets, Unix domain ones
+  template <class Socket>
+  void BeforeRead(Socket& socket) const noexcept {}
+
+ private:
+  int backlog_ = boost::asio::socket_base::max_listen_connections;
+  std::optional<std::chrono::seconds> defer_accept_;
+  std::optional<int> fast_open_;
+  std::optional<int> receive_buffer_size_;
+  std::optional<int> send_buffer_size_;
+  bool no_delay_ = true;
+  bool quick_ack_ = false;
+  std::optional<std::chrono::microseconds> busy_poll_;
+};
+
+}  // namespace netkit::tcp
@@ -1,5 +1,8 @@
+#include <netkit/watchdog.h>
+
 #include <boost/core/ignore_unused.hpp>
 #include <csignal>
+#include <iostream>
 
 #include "test.h"
 
@@ -22,8 +25,26 @@ static void CtrlHandler(std::int32_t sig) {
 int main() {
   signal(SIGINT, CtrlHandler);
 
+  // Checks which throw on failure, then the demos running until Ctrl+C
+  TestKtls();
+  TestHandshakeQueue();
+  TestHttp2();
+  TestLocalSocket();
+  TestSupervisor();
+  TestWorkStealing();
+  TestClientPool();
+  TestDnsCache();
+  TestRetryPolicy();
+  TestClientTimeouts();
+  TestClientSessions();
+
   {
     IoContextPool pool(2);
+    pool.set_policy(std::make_shared<PowerOfTwoChoicesPolicy>());
+    pool.set_affinity(AffinityOptions().set_numa_spread(true).set_arenas(true));
+
+    Watchdog watchdog(pool, std::make_shared<StreamSink>(std::cerr));
+    watchdog.Start();
 
     std::thread([&pool]() { pool.Run(); }).detach();
 
@@ -35,6 +56,8 @@ int main() {
 
     TestHttpServer(stop.get_token(), pool, "0.0.0.0", 8087);
 
+    TestSslServer(stop.get_token(), pool, "127.0.0.1", 8443);
+
     pool.Stop();
   }
 }
@@ -1,11 +1,23 @@
 #pragma once
 #include <netkit/io_context_pool.h>
 
+#include <boost/asio/ssl/context.hpp>
+#include <stdexcept>
 #include <stop_token>
 #include <string>
 
 using namespace netkit;
 
+// Stops the run with what when condition is false
+inline void Expect(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error(what);
+  }
+}
+
+void MakeSelfSignedCertificate(boost::asio::ssl::context& ssl_ctx,
+                               const std::string& common_name);
+
 void TestTcpListener(std::stop_token st, IoContextPool& pool,
                      const std::string& address, std::uint16_t port);
 
@@ -15,3 +27,28 @@ void TestHttpServer(std::stop_token st, IoContextPool& pool,
                     const std::string& address, std::uint16_t port);
 
 void TestHttpClient(std::stop_token st, IoContextPool& pool);
+
+void TestClientTimeouts();
+
+void TestHandshakeQueue();
+
+void TestClientSessions();
+
+void TestHttp2();
+
+void TestLocalSocket();
+
+void TestSupervisor();
+
+void TestWorkStealing();
+
+void TestClientPool();
+
+void TestDnsCache();
+
+void TestRetryPolicy();
+
+void TestSslServer(std::stop_token st, IoContextPool& pool,
+                   const std::string& address, std::uint16_t port);
+
+void TestKtls();
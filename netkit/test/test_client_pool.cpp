@@ -0,0 +1,142 @@
+#include <netkit/http/client_pool.h>
+#include <netkit/http/server.h>
+
+#include <boost/asio/use_future.hpp>
+#include <iostream>
+
+#include "test.h"
+
+using namespace netkit;
+
+static constexpr std::uint16_t kPort = 18086;
+
+// Answers the number of the connection, counted by the server
+static void OnId(const http::Context::Ptr& ctx) {
+  static std::atomic<int> next_id = 0;
+  auto id = ctx->try_get_user_data<int>();
+  if (!id) {
+    ctx->set_user_data(++next_id);
+    id = ctx->try_get_user_data<int>();
+  }
+  ctx->Ok(std::to_string(*id), "text/plain");
+}
+
+static std::string GetId(http::ClientPool::Connection& conn) {
+  boost::beast::http::request<boost::beast::http::empty_body> req(
+      boost::beast::http::verb::get, "/id", 11);
+  boost::beast::http::response<boost::beast::http::string_body> resp;
+  conn.SendRequest(req, resp);
+  return resp.body();
+}
+
+static http::HostStats StatsOf(const http::ClientPool& clients) {
+  auto stats = clients.stats();
+  Expect(stats.size() == 1, "client pool: hosts");
+  return stats[0];
+}
+
+// The most recently released connection is the next one handed out, the
+// older ones are left to expire
+static void TestReuse(IoContextPool& pool) {
+  http::ClientPool clients(pool);
+  clients.set_idle_timeout(std::chrono::milliseconds(200));
+  auto first = clients.Acquire("http", "127.0.0.1", kPort);
+  auto second = clients.Acquire("http", "127.0.0.1", kPort);
+  auto first_id = GetId(first);
+  auto second_id = GetId(second);
+  Expect(first_id != second_id, "client pool: one connection for two");
+  first.Release();
+  second.Release();
+  auto stats = StatsOf(clients);
+  Expect(stats.active == 0 && stats.idle == 2 && stats.created == 2,
+         "client pool: released");
+
+  auto last = clients.Acquire("http", "127.0.0.1", kPort);
+  Expect(GetId(last) == second_id, "client pool: not LIFO");
+  Expect(StatsOf(clients).reused == 1, "client pool: reused");
+  last.Release();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  auto fresh = clients.Acquire("http", "127.0.0.1", kPort);
+  auto fresh_id = GetId(fresh);
+  Expect(fresh_id != first_id && fresh_id != second_id,
+         "client pool: expired connection reused");
+  stats = StatsOf(clients);
+  Expect(stats.expired == 2 && stats.created == 3,
+         "client pool: idle connections not expired");
+}
+
+// Past max_per_host the requests wait for a release
+static void TestWaiters(IoContextPool& pool) {
+  http::ClientPool clients(pool);
+  clients.set_max_per_host(1);
+  auto held = clients.Acquire("http", "127.0.0.1", kPort);
+  auto id = GetId(held);
+  auto next =
+      clients.AsyncAcquire("http", "127.0.0.1", kPort, boost::asio::use_future);
+  Expect(next.wait_for(std::chrono::milliseconds(50)) ==
+             std::future_status::timeout,
+         "client pool: over max_per_host");
+  auto stats = StatsOf(clients);
+  Expect(stats.active == 1 && stats.waiting == 1 && stats.waited == 1,
+         "client pool: waiter not counted");
+  held.Release();
+  auto conn = next.get();
+  Expect(GetId(conn) == id, "client pool: waiter didn't get the release");
+  stats = StatsOf(clients);
+  Expect(stats.waiting == 0 && stats.reused == 1 && stats.created == 1,
+         "client pool: handed over");
+}
+
+// Asynchronous requests started from every thread of the pool share two
+// connections
+static void TestThreads(IoContextPool& pool) {
+  http::ClientPool clients(pool);
+  clients.set_max_per_host(2);
+  constexpr int kRequests = 32;
+  std::atomic<int> ok = 0;
+  std::atomic<int> done = 0;
+  std::promise<void> finished;
+  for (int i = 0; i < kRequests; ++i) {
+    boost::asio::post(pool.At(i % pool.size()), [&]() {
+      auto req = std::make_shared<
+          boost::beast::http::request<boost::beast::http::empty_body>>(
+          boost::beast::http::verb::get, "/id", 11);
+      auto resp = std::make_shared<
+          boost::beast::http::response<boost::beast::http::string_body>>();
+      clients.AsyncSendRequest(
+          "http", "127.0.0.1", kPort, *req, *resp,
+          [&, req, resp](boost::system::error_code ec) {
+            if (!ec && resp->result() == boost::beast::http::status::ok) {
+              ++ok;
+            }
+            if (++done == kRequests) {
+              finished.set_value();
+            }
+          });
+    });
+  }
+  finished.get_future().get();
+  Expect(ok == kRequests, "client pool: requests from the pool threads");
+  auto stats = StatsOf(clients);
+  Expect(stats.active == 0 && stats.created <= 2 &&
+             stats.reused + stats.created == kRequests,
+         "client pool: connections of the pool threads");
+}
+
+void TestClientPool() {
+  IoContextPool pool(2);
+  std::thread thread([&pool]() { pool.Run(); });
+  auto server = std::make_shared<http::PlainServer>(pool);
+  server->HandleFunc("/id", &OnId, {"GET"});
+  server->ListenAndServe("127.0.0.1", kPort);
+
+  TestReuse(pool);
+  TestWaiters(pool);
+  TestThreads(pool);
+
+  server->Close();
+  pool.Stop();
+  thread.join();
+  std::cout << "client pool: ok" << std::endl;
+}
@@ -0,0 +1,83 @@
+#include <netkit/dns_cache.h>
+
+#include <iostream>
+
+#include "test.h"
+
+using namespace netkit;
+
+// Address served first
+static std::string First(DnsCache& cache) {
+  auto results = cache.Resolve("service", "80");
+  return results.begin()->endpoint().address().to_string();
+}
+
+static bool IsHostNotFound(DnsCache& cache) {
+  try {
+    cache.Resolve("service", "80");
+  } catch (const boost::system::system_error& e) {
+    return e.code() == boost::asio::error::host_not_found;
+  }
+  return false;
+}
+
+// HostsResolver completes on the calling thread, the refreshes are done by
+// the time Resolve() returns
+void TestDnsCache() {
+  using namespace std::chrono_literals;
+  IoContextPool pool(1);
+  auto resolver = std::make_shared<HostsResolver>();
+  resolver->Add("service", "10.0.0.1").Add("service", "10.0.0.2");
+  DnsCache cache(pool, resolver);
+  cache.set_ttl(300ms)
+      .set_refresh_ahead(150ms)
+      .set_max_stale(600ms)
+      .set_retry_interval(100ms);
+
+  // Rotation
+  Expect(First(cache) == "10.0.0.1" && First(cache) == "10.0.0.2" &&
+             First(cache) == "10.0.0.1",
+         "dns: addresses not rotated");
+  auto stats = cache.stats();
+  Expect(stats.misses == 1 && stats.hits == 2, "dns: cached");
+
+  // Refreshed ahead of the expiry, served meanwhile
+  resolver->Add("service", "10.0.0.3");
+  std::this_thread::sleep_for(200ms);
+  Expect(cache.Resolve("service", "80").size() == 2, "dns: refresh waited");
+  Expect(cache.Resolve("service", "80").size() == 3, "dns: not refreshed");
+  stats = cache.stats();
+  Expect(stats.refreshes == 1 && stats.misses == 1, "dns: refresh counted");
+
+  // Expired, the lookup waits for the resolver
+  std::this_thread::sleep_for(350ms);
+  cache.Resolve("service", "80");
+  Expect(cache.stats().misses == 2, "dns: ttl");
+
+  // Stale once the resolver fails, the next lookups don't wait for it
+  resolver->Remove("service");
+  std::this_thread::sleep_for(350ms);
+  Expect(cache.Resolve("service", "80").size() == 3, "dns: stale not served");
+  cache.Resolve("service", "80");
+  stats = cache.stats();
+  Expect(stats.failures == 1 && stats.stale == 2 && stats.misses == 3,
+         "dns: resolver retried before the retry interval");
+  std::this_thread::sleep_for(150ms);
+  cache.Resolve("service", "80");
+  stats = cache.stats();
+  Expect(stats.failures == 2 && stats.stale == 3, "dns: resolver not retried");
+
+  // Back once the resolver succeeds
+  resolver->Add("service", "10.0.0.4");
+  std::this_thread::sleep_for(150ms);
+  cache.Resolve("service", "80");
+  Expect(First(cache) == "10.0.0.4", "dns: not resolved again");
+
+  // Dropped past max_stale
+  resolver->Remove("service");
+  std::this_thread::sleep_for(350ms);
+  cache.Resolve("service", "80");
+  std::this_thread::sleep_for(700ms);
+  Expect(IsHostNotFound(cache), "dns: served past max_stale");
+  std::cout << "dns: ok" << std::endl;
+}
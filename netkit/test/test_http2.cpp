@@ -0,0 +1,194 @@
+#include <netkit/http/hpack.h>
+#include <netkit/http/http2.h>
+#include <netkit/http/server.h>
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <iostream>
+
+#include "test.h"
+
+using namespace netkit;
+
+// Speaks just enough HTTP/2 over a synchronous stream to check the server
+template <class SyncStream>
+class Http2TestClient {
+ public:
+  explicit Http2TestClient(SyncStream& stream) : stream_(stream) {
+    std::string out(http::http2::kPreface);
+    http::http2::FrameHeader{0, http::http2::kSettings, 0, 0}.AppendTo(out);
+    boost::asio::write(stream_, boost::asio::buffer(out));
+  }
+
+  // Sends a GET on a new stream, returns the status and the body
+  std::pair<std::string, std::string> Get(const std::string& path) {
+    std::string block;
+    encoder_.Begin(block);
+    encoder_.Encode(":method", "GET", block);
+    encoder_.Encode(":scheme", "https", block);
+    encoder_.Encode(":path", path, block);
+    encoder_.Encode(":authority", "localhost", block);
+    auto id = next_stream_id_;
+    next_stream_id_ += 2;
+    WriteHeaders(id, block);
+
+    std::pair<std::string, std::string> result;
+    http::http2::FrameHeader hdr;
+    std::string payload;
+    while (ReadFrame(hdr, payload)) {
+      if (hdr.type == http::http2::kGoaway ||
+          (hdr.type == http::http2::kRstStream && hdr.stream_id == id)) {
+        break;
+      }
+      if (hdr.stream_id != id) {
+        continue;
+      }
+      if (hdr.type == http::http2::kHeaders) {
+        http::HpackHeaderList headers;
+        decoder_.Decode(reinterpret_cast<const std::uint8_t*>(payload.data()),
+                        payload.size(), SIZE_MAX, headers);
+        for (const auto& [name, value] : headers) {
+          if (name == ":status") {
+            result.first = value;
+          }
+        }
+      } else if (hdr.type == http::http2::kData) {
+        result.second += payload;
+      }
+      if (hdr.flags & http::http2::kEndStream) {
+        break;
+      }
+    }
+    return result;
+  }
+
+  // Sends a header block as is, returns the error code of the GOAWAY which
+  // ends the connection
+  std::uint32_t SendBlock(const std::string& block) {
+    WriteHeaders(next_stream_id_, block);
+    next_stream_id_ += 2;
+    http::http2::FrameHeader hdr;
+    std::string payload;
+    while (ReadFrame(hdr, payload)) {
+      if (hdr.type == http::http2::kGoaway && payload.size() >= 8) {
+        return http::http2::FrameHeader::ReadUint32(
+            reinterpret_cast<const std::uint8_t*>(payload.data()) + 4);
+      }
+    }
+    return 0;
+  }
+
+ private:
+  void WriteHeaders(std::uint32_t id, const std::string& block) {
+    std::string out;
+    http::http2::FrameHeader{
+        static_cast<std::uint32_t>(block.size()), http::http2::kHeaders,
+        http::http2::kEndStream | http::http2::kEndHeaders, id}
+        .AppendTo(out);
+    out += block;
+    boost::asio::write(stream_, boost::asio::buffer(out));
+  }
+
+  bool ReadFrame(http::http2::FrameHeader& hdr, std::string& payload) {
+    std::uint8_t header[http::http2::kFrameHeaderSize];
+    boost::beast::error_code ec;
+    boost::asio::read(stream_, boost::asio::buffer(header), ec);
+    if (ec) {
+      return false;
+    }
+    hdr = http::http2::FrameHeader::Parse(header);
+    payload.resize(hdr.length);
+    boost::asio::read(stream_, boost::asio::buffer(payload), ec);
+    return !ec;
+  }
+
+ private:
+  SyncStream& stream_;
+  http::HpackEncoder encoder_;
+  http::HpackDecoder decoder_;
+  std::uint32_t next_stream_id_ = 1;
+};
+
+// A literal field of 4000 bytes added to the table, then referenced by one
+// byte each
+static std::string MakeHpackBomb() {
+  std::string block = "\x40\x01x\x7f\xa1\x1e";
+  block.append(4000, 'a');
+  block.append(100, '\xbe');
+  return block;
+}
+
+static void OnHello(const http::Context::Ptr& ctx) {
+  ctx->Ok("Hello", "text/plain");
+}
+
+static void OnWebSocket(const http::Context::Ptr& ctx) {
+  ctx->UpgradeWebSocket();
+}
+
+template <class Server>
+static void AddRoutes(Server& server) {
+  server.EnableHttp2();
+  server.HandleFunc("/hello", &OnHello, {"GET"});
+  server.HandleFunc("/ws", &OnWebSocket, {"GET"});
+}
+
+template <class SyncStream>
+static void Exchange(SyncStream& stream, const std::string& what) {
+  Http2TestClient client(stream);
+  auto [status, body] = client.Get("/hello");
+  Expect(status == "200" && body == "Hello", what + ": response");
+  Expect(client.Get("/ws").first == "501", what + ": WebSocket route");
+  Expect(client.SendBlock(MakeHpackBomb()) ==
+             static_cast<std::uint32_t>(http::http2::Error::kEnhanceYourCalm),
+         what + ": header list over the limit");
+}
+
+void TestHttp2() {
+  // Connections are allocated from the node-local arena
+  IoContextPool pool(1);
+  pool.set_affinity(AffinityOptions().set_numa_spread(true).set_arenas(true));
+  std::thread thread([&pool]() { pool.Run(); });
+  boost::asio::io_context ioc;
+  boost::asio::ip::tcp::endpoint endpoint(
+      boost::asio::ip::make_address("127.0.0.1"), 0);
+
+  // Prior knowledge, the client starts with the preface in cleartext
+  {
+    auto server = std::make_shared<http::PlainServer>(pool);
+    AddRoutes(*server);
+    server->ListenAndServe("127.0.0.1", 18080);
+    boost::asio::ip::tcp::socket socket(ioc);
+    endpoint.port(18080);
+    socket.connect(endpoint);
+    Exchange(socket, "h2c");
+    server->Close();
+  }
+
+  // Negotiated by ALPN
+  {
+    boost::asio::ssl::context ssl_ctx(boost::asio::ssl::context::tls_server);
+    MakeSelfSignedCertificate(ssl_ctx, "localhost");
+    auto server = std::make_shared<http::SslServer>(pool, ssl_ctx);
+    AddRoutes(*server);
+    server->ListenAndServe("127.0.0.1", 18443);
+    boost::asio::ssl::context client_ctx(
+        boost::asio::ssl::context::tls_client);
+    client_ctx.set_verify_mode(boost::asio::ssl::verify_none);
+    SSL_CTX_set_alpn_protos(client_ctx.native_handle(),
+                            reinterpret_cast<const unsigned char*>("\x02h2"),
+                            3);
+    boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream(ioc,
+                                                                  client_ctx);
+    endpoint.port(18443);
+    stream.next_layer().connect(endpoint);
+    stream.handshake(boost::asio::ssl::stream_base::client);
+    Expect(http::http2::IsNegotiated(stream.native_handle()), "h2: ALPN");
+    Exchange(stream, "h2");
+    server->Close();
+  }
+
+  pool.Stop();
+  thread.join();
+  std::cout << "http2: ok" << std::endl;
+}
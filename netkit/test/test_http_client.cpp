@@ -1,20 +1,157 @@
 #include <netkit/http/client.h>
-#include <netkit/http/digest_auth.h>
 #include <netkit/io_context_pool.h>
 
+#include <boost/asio/use_future.hpp>
 #include <boost/json.hpp>
 #include <iostream>
 
+#include "test.h"
+
 using namespace netkit;
 
+// Accepts connections and never reads from them nor answers
+class SilentServer {
+ public:
+  SilentServer()
+      : acceptor_(ioc_, {boost::asio::ip::make_address("127.0.0.1"), 0}) {
+    Accept();
+    thread_ = std::thread([this]() { ioc_.run(); });
+  }
+
+  ~SilentServer() {
+    ioc_.stop();
+    thread_.join();
+  }
+
+  std::uint16_t port() const { return acceptor_.local_endpoint().port(); }
+
+ private:
+  void Accept() {
+    acceptor_.async_accept([this](const boost::system::error_code& ec,
+                                  boost::asio::ip::tcp::socket socket) {
+      if (!ec) {
+        sockets_.emplace_back(std::move(socket));
+        Accept();
+      }
+    });
+  }
+
+  boost::asio::io_context ioc_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  std::vector<boost::asio::ip::tcp::socket> sockets_;
+  std::thread thread_;
+};
+
+// Never completes
+class StalledResolver : public NameResolver {
+ public:
+  void AsyncResolve(const std::string& host, const std::string& port,
+                    Callback&& callback) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callbacks_.emplace_back(std::move(callback));
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<Callback> callbacks_;
+};
+
+static boost::system::error_code Send(http::PlainClient& client,
+                                      std::size_t body_size = 0) {
+  boost::beast::http::request<boost::beast::http::string_body> req(
+      boost::beast::http::verb::post, "/", 11);
+  req.body().assign(body_size, 'x');
+  req.prepare_payload();
+  boost::beast::http::response<boost::beast::http::string_body> resp;
+  try {
+    client.SendRequest(req, resp);
+  } catch (const boost::system::system_error& e) {
+    return e.code();
+  }
+  return {};
+}
+
+// Every phase of a request stalled by the server expires with
+// boost::beast::error::timeout
+void TestClientTimeouts() {
+  using namespace std::chrono_literals;
+  IoContextPool pool(1);
+  std::thread thread([&pool]() { pool.Run(); });
+  SilentServer server;
+
+  // The backlog of a listener which never accepts is full, the SYN of the
+  // client is dropped. The connects start without running fill.
+  boost::asio::io_context fill;
+  boost::asio::ip::tcp::acceptor full(
+      fill, {boost::asio::ip::make_address("127.0.0.1"), 0});
+  full.listen(0);
+  std::vector<boost::asio::ip::tcp::socket> backlog;
+  for (int i = 0; i < 4; ++i) {
+    backlog.emplace_back(fill).async_connect(
+        full.local_endpoint(), [](const boost::system::error_code&) {});
+  }
+  http::PlainClient connecting(pool, "127.0.0.1", full.local_endpoint().port());
+  connecting.set_timeouts(http::ClientTimeouts().set_connect_timeout(200ms));
+  Expect(Send(connecting) == boost::beast::error::timeout,
+         "client: connect timeout");
+
+  // The socket buffers fill up
+  http::PlainClient writing(pool, "127.0.0.1", server.port());
+  writing.set_timeouts(http::ClientTimeouts().set_write_timeout(200ms));
+  Expect(Send(writing, 64 * 1024 * 1024) == boost::beast::error::timeout,
+         "client: write timeout");
+
+  // On a context of the pool the client doesn't know of, the thread waits
+  // for the pool
+  http::PlainClient reading(pool.At(0), "127.0.0.1", server.port());
+  reading.set_timeouts(http::ClientTimeouts().set_read_timeout(200ms));
+  Expect(Send(reading) == boost::beast::error::timeout,
+         "client: read timeout");
+
+  // On a context nothing runs, the thread runs it
+  boost::asio::io_context ioc;
+  http::PlainClient idle(ioc, "127.0.0.1", server.port());
+  idle.set_timeouts(http::ClientTimeouts().set_read_timeout(200ms));
+  Expect(Send(idle) == boost::beast::error::timeout,
+         "client: read timeout on an idle context");
+
+  // The request deadline bounds the lookup, which Cancel() also aborts
+  DnsCache cache(pool, std::make_shared<StalledResolver>());
+  http::PlainClient resolving(pool, "stalled.invalid", server.port());
+  resolving.set_dns_cache(&cache);
+  resolving.set_timeouts(http::ClientTimeouts().set_request_timeout(200ms));
+  Expect(Send(resolving) == boost::beast::error::timeout,
+         "client: request timeout while resolving");
+  boost::beast::http::request<boost::beast::http::empty_body> req(
+      boost::beast::http::verb::get, "/", 11);
+  boost::beast::http::response<boost::beast::http::string_body> resp;
+  auto sent = resolving.AsyncSendRequest(req, resp, boost::asio::use_future);
+  boost::asio::post(resolving.get_executor(),
+                    [&resolving]() { resolving.Cancel(); });
+  boost::system::error_code ec;
+  try {
+    sent.get();
+  } catch (const boost::system::system_error& e) {
+    ec = e.code();
+  }
+  Expect(ec == boost::asio::error::operation_aborted,
+         "client: lookup not cancelled");
+
+  pool.Stop();
+  thread.join();
+  std::cout << "client timeouts: ok" << std::endl;
+}
+
 void TestHttpClient(std::stop_token st, IoContextPool& pool) {
   try {
     std::string username = "admin";
     std::string password = "123456";
-    std::string cnonce = "abce12346";
     std::string device_id = "51010700011209155082";
     std::string url = "/VIID/System/Register";
-    http::PlainClient client(pool.Get(), "192.168.20.142", 8003);
+    http::PlainClient client(pool, "192.168.20.142", 8003);
+    client.set_timeouts(http::ClientTimeouts()
+                            .set_connect_timeout(std::chrono::seconds(3))
+                            .set_request_timeout(std::chrono::seconds(10)));
     boost::json::object obj{{"RegisterObject", {{"DeviceID", device_id}}}};
     boost::beast::http::request<boost::beast::http::string_body> req(
         boost::beast::http::verb::post, url, 11);
@@ -23,31 +160,26 @@ void TestHttpClient(std::stop_token st, IoContextPool& pool) {
     req.body() = boost::json::serialize(obj);
     req.prepare_payload();
     boost::beast::http::response<boost::beast::http::string_body> resp;
+    // Answers the 401 itself, then authorizes the next requests up front
+    client.set_digest_auth(username, password);
     client.SendRequest(req, resp);
     std::cout << resp << std::endl;
-    if (resp.result_int() == 401) {
-      auto www = resp[boost::beast::http::field::www_authenticate];
-      if (www.starts_with("Digest ")) {
-        http::WwwAuthenticateDigest www_digest;
-        if (www_digest.ParseFromString(www.data(), www.size())) {
-          http::AuthorizationDigest auth_digest;
-          auth_digest.cnonce = cnonce;
-          auth_digest.nonce = www_digest.nonce;
-          auth_digest.nc = 1;
-          auth_digest.opaque = www_digest.opaque;
-          auth_digest.qop = "auth";
-          auth_digest.realm = www_digest.realm;
-          auth_digest.response = www_digest.MakeResponse(
-              username, password, "POST", url, 1, cnonce);
-          auth_digest.uri = url;
-          auth_digest.username = username;
-          req.set(boost::beast::http::field::authorization,
-                  auth_digest.ToString());
-          client.SendRequest(req, resp);
-          std::cout << resp << std::endl;
-        }
-      }
-    }
+    // Same connection, without blocking a thread of the pool
+    boost::beast::http::request<boost::beast::http::empty_body> time_req(
+        boost::beast::http::verb::get, "/VIID/System/Time", 11);
+    time_req.set("User-Identify", device_id);
+    client.AsyncSendRequest(time_req, resp, boost::asio::use_future).get();
+    std::cout << resp << std::endl;
+    // Body handed over as it arrives instead of held in memory
+    boost::beast::http::response<http::SinkBody> stream_resp;
+    std::size_t received = 0;
+    stream_resp.body().sink = [&received](const char* data, std::size_t size,
+                                          boost::system::error_code& ec) {
+      received += size;
+    };
+    client.SendRequest(time_req, stream_resp);
+    std::cout << stream_resp.base() << received << " bytes streamed"
+              << std::endl;
   } catch (const std::exception& e) {
     std::cout << e.what() << std::endl;
   }
@@ -1,8 +1,10 @@
 #include <netkit/http/cors_filter.h>
 #include <netkit/http/server.h>
 
+#include <atomic>
 #include <cstdlib>
 #include <unordered_map>
+#include <unordered_set>
 
 using namespace netkit;
 
@@ -26,6 +28,14 @@ class AuthorizationFilter : public http::Filter {
 static std::uint64_t channel_id = 0;
 static std::mutex mutex;
 static std::unordered_map<std::uint64_t, std::string> channel_map;
+static std::unordered_set<http::WebSocket::Ptr> watchers;
+
+static void Notify(std::string&& event) {
+  auto data = std::make_shared<const std::string>(std::move(event));
+  for (const auto& ws : watchers) {
+    ws->Send(data);
+  }
+}
 
 static void UserLogin(const http::Context::Ptr& ctx) {
   ctx->set_user_data(true);
@@ -38,12 +48,14 @@ static void AddChannel(const http::Context::Ptr& ctx) {
   std::lock_guard lock(mutex);
   auto id = ++channel_id;
   channel_map[id] = ctx->GetRequest().body();
+  Notify("add " + std::to_string(id));
   ctx->Ok(std::to_string(id), "text/plain");
 }
 
 static void DeleteChannel(const http::Context::Ptr& ctx, std::uint64_t id) {
   std::lock_guard lock(mutex);
   channel_map.erase(id);
+  Notify("delete " + std::to_string(id));
   ctx->Ok();
 }
 
@@ -52,6 +64,7 @@ static void UpdateChannel(const http::Context::Ptr& ctx, std::uint64_t id) {
   auto it = channel_map.find(id);
   if (it != channel_map.end()) {
     it->second = ctx->GetRequest().body();
+    Notify("update " + std::to_string(id));
   }
   ctx->Ok();
 }
@@ -69,6 +82,26 @@ static void GetChannelList(const http::Context::Ptr& ctx) {
   ctx->Ok(std::move(body), "text/plain");
 }
 
+static void WatchChannel(const http::Context::Ptr& ctx) {
+  ctx->UpgradeWebSocket(
+      http::WebSocketOptions()
+          .set_permessage_deflate(true)
+          .set_high_water_mark(64 * 1024)
+          .set_on_open([](const http::WebSocket::Ptr& ws) {
+            std::lock_guard lock(mutex);
+            watchers.emplace(ws);
+          })
+          .set_on_message([](const http::WebSocket::Ptr& ws,
+                             std::string_view data, bool binary) {
+            ws->Send(std::string(data), binary);
+          })
+          .set_on_close([](const http::WebSocket::Ptr& ws,
+                           const boost::beast::error_code& ec) {
+            std::lock_guard lock(mutex);
+            watchers.erase(ws);
+          }));
+}
+
 void TestHttpServer(std::stop_token st, IoContextPool& pool,
                     const std::string& address, std::uint16_t port) {
   boost::asio::ssl::context ssl_ctx(boost::asio::ssl::context::tlsv12);
@@ -89,15 +122,41 @@ void TestHttpServer(std::stop_token st, IoContextPool& pool,
   server->HandleFunc("/channel/{id}", &DeleteChannel, {"DELETE"});
   server->HandleFunc("/channel/{id}", &UpdateChannel, {"PUT"});
   server->HandleFunc("/channel", &GetChannelList, {"GET"});
+  server->HandleFunc("/channel/watch", &WatchChannel, {"GET"});
 
   std::srand((unsigned int)std::time(nullptr));
 
-  server->ListenAndServe(address, port, true);
+  std::atomic<bool> handed_off = false;
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+  // A second instance takes the port over from this one, which then drains
+  if (!server->ListenAndServeHandoff("@netkit-handoff")) {
+    server->ListenAndServe(address, port, true, true);
+    server->ListenAndServeLocal("@netkit-test");
+  }
+  server->ExposeListeners("@netkit-handoff",
+                          [&handed_off]() { handed_off = true; });
+#else
+  server->ListenAndServe(address, port, true, true);
+#endif
 
-  while (!st.stop_requested()) {
+  while (!st.stop_requested() && !handed_off) {
     using namespace std::chrono_literals;
     std::this_thread::sleep_for(100ms);
   }
 
   server->Close();
+
+  auto deadline =
+      std::chrono::steady_clock::now() + server->settings().read_timeout();
+  while (handed_off && std::chrono::steady_clock::now() < deadline) {
+    std::size_t connections = 0;
+    for (std::size_t i = 0; i < pool.size(); ++i) {
+      connections += pool.load(i).connections();
+    }
+    if (connections == 0) {
+      break;
+    }
+    using namespace std::chrono_literals;
+    std::this_thread::sleep_for(100ms);
+  }
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include <netkit/ssl/ktls.h>
+
+#include <boost/asio/read.hpp>
+#include <boost/asio/use_future.hpp>
+#include <boost/asio/write.hpp>
+#include <iostream>
+#include <thread>
+
+#include "test.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace netkit;
+
+static int keylog_lines = 0;
+static int info_calls = 0;
+
+// A server and a client SSL talking through a BIO pair each
+class SslPair {
+ public:
+  SslPair(SSL_CTX* server_ctx, SSL_CTX* client_ctx)
+      : server_(SSL_new(server_ctx)), client_(SSL_new(client_ctx)) {
+    BIO* server_bio = nullptr;
+    BIO* client_bio = nullptr;
+    BIO_new_bio_pair(&server_bio, 0, &server_net_, 0);
+    BIO_new_bio_pair(&client_bio, 0, &client_net_, 0);
+    SSL_set_bio(server_, server_bio, server_bio);
+    SSL_set_bio(client_, client_bio, client_bio);
+    SSL_set_accept_state(server_);
+    SSL_set_connect_state(client_);
+  }
+
+  ~SslPair() {
+    SSL_free(server_);
+    SSL_free(client_);
+    BIO_free(server_net_);
+    BIO_free(client_net_);
+  }
+
+  SSL* server() noexcept { return server_; }
+
+  SSL* client() noexcept { return client_; }
+
+  bool Handshake() {
+    for (int i = 0; i < 10; ++i) {
+      SSL_do_handshake(client_);
+      Pump();
+      SSL_do_handshake(server_);
+      Pump();
+    }
+    return SSL_is_init_finished(server_) && SSL_is_init_finished(client_);
+  }
+
+  // Moves the pending bytes of each side to the other one
+  void Pump() {
+    char buffer[16384];
+    int size = 0;
+    while ((size = BIO_read(client_net_, buffer, sizeof(buffer))) > 0) {
+      BIO_write(server_net_, buffer, size);
+    }
+    while ((size = BIO_read(server_net_, buffer, sizeof(buffer))) > 0) {
+      BIO_write(client_net_, buffer, size);
+    }
+  }
+
+ private:
+  SSL* server_;
+  SSL* client_;
+  BIO* server_net_ = nullptr;
+  BIO* client_net_ = nullptr;
+};
+
+// Peer of a socket shut down by the KeyUpdate guard reads the end
+static bool IsShutDown(int fd) {
+  char c;
+  return recv(fd, &c, 1, MSG_DONTWAIT) == 0;
+}
+
+static void TestCallbacks() {
+  boost::asio::ssl::context server_ctx(boost::asio::ssl::context::tls_server);
+  MakeSelfSignedCertificate(server_ctx, "localhost");
+  SSL_CTX_set_keylog_callback(server_ctx.native_handle(),
+                              [](const SSL*, const char*) { ++keylog_lines; });
+  SSL_CTX_set_info_callback(server_ctx.native_handle(),
+                            [](const SSL*, int, int) { ++info_calls; });
+  ssl::PrepareKtls(server_ctx);
+  ssl::PrepareKtls(server_ctx);
+  boost::asio::ssl::context client_ctx(boost::asio::ssl::context::tls_client);
+
+  SslPair pair(server_ctx.native_handle(), client_ctx.native_handle());
+  ssl::KtlsSecrets secrets;
+  ssl::AttachKtlsSecrets(pair.server(), &secrets);
+  Expect(pair.Handshake(), "ktls: handshake");
+  Expect(keylog_lines > 0, "ktls: previous keylog callback not called");
+  Expect(info_calls > 0, "ktls: previous info callback not called");
+  auto md = SSL_CIPHER_get_handshake_digest(
+      SSL_get_current_cipher(pair.server()));
+  Expect(secrets.secret_size == static_cast<std::size_t>(EVP_MD_size(md)),
+         "ktls: traffic secret not captured");
+  Expect(secrets.tickets == SSL_CTX_get_num_tickets(server_ctx.native_handle()),
+         "ktls: tickets miscounted");
+
+  // Pretends the sends are offloaded to the first socket of a pair
+  int fds[2];
+  Expect(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "ktls: socketpair");
+  secrets.offloaded_fd = fds[0];
+  char buffer[16];
+  SSL_key_update(pair.client(), SSL_KEY_UPDATE_NOT_REQUESTED);
+  SSL_write(pair.client(), "a", 1);
+  pair.Pump();
+  Expect(SSL_read(pair.server(), buffer, sizeof(buffer)) == 1,
+         "ktls: read after a KeyUpdate");
+  Expect(!IsShutDown(fds[1]), "ktls: KeyUpdate without an answer closed");
+  SSL_key_update(pair.client(), SSL_KEY_UPDATE_REQUESTED);
+  SSL_write(pair.client(), "b", 1);
+  pair.Pump();
+  SSL_read(pair.server(), buffer, sizeof(buffer));
+  Expect(IsShutDown(fds[1]), "ktls: requested KeyUpdate left open");
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// Writes through KtlsStream with a future, offloaded when the kernel can
+static void TestStream() {
+  boost::asio::ssl::context server_ctx(boost::asio::ssl::context::tls_server);
+  MakeSelfSignedCertificate(server_ctx, "localhost");
+  ssl::PrepareKtls(server_ctx);
+  boost::asio::ssl::context client_ctx(boost::asio::ssl::context::tls_client);
+
+  boost::asio::io_context ioc;
+  boost::asio::ip::tcp::acceptor acceptor(
+      ioc, {boost::asio::ip::make_address("127.0.0.1"), 0});
+  boost::beast::ssl_stream<boost::beast::tcp_stream> client(ioc, client_ctx);
+  client.next_layer().connect(acceptor.local_endpoint());
+  ssl::KtlsStream<boost::beast::tcp_stream> server(
+      boost::beast::tcp_stream(acceptor.accept()), server_ctx, true);
+  std::thread thread([&ioc]() {
+    auto work = boost::asio::make_work_guard(ioc);
+    ioc.run_for(std::chrono::seconds(5));
+  });
+  auto handshake = server.ssl_stream().async_handshake(
+      boost::asio::ssl::stream_base::server, boost::asio::use_future);
+  client.handshake(boost::asio::ssl::stream_base::client);
+  handshake.get();
+  bool offloaded = server.Offload();
+  std::string data = "hello";
+  auto written = boost::asio::async_write(server, boost::asio::buffer(data),
+                                          boost::asio::use_future);
+  Expect(written.get() == data.size(), "ktls: write size");
+  char buffer[5];
+  boost::asio::read(client, boost::asio::buffer(buffer));
+  Expect(std::string(buffer, sizeof(buffer)) == data, "ktls: data");
+  std::cout << "ktls: offloaded=" << offloaded << std::endl;
+  ioc.stop();
+  thread.join();
+}
+
+void TestKtls() {
+  TestCallbacks();
+  TestStream();
+}
+#else
+// Linux only
+void TestKtls() {}
+#endif
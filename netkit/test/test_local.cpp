@@ -0,0 +1,97 @@
+#include <netkit/http/client.h>
+#include <netkit/http/server.h>
+
+#include <boost/asio/use_future.hpp>
+#include <fstream>
+#include <iostream>
+
+#include "test.h"
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace netkit;
+
+// Answers "pid uid" of the client
+static void OnWhoAmI(const http::Context::Ptr& ctx) {
+  auto creds = ctx->peer_credentials();
+  if (!creds) {
+    return ctx->Forbidden();
+  }
+  ctx->Ok(std::to_string(creds->pid) + " " + std::to_string(creds->uid),
+          "text/plain");
+}
+
+static bool IsSocketFile(const std::string& path) {
+  struct stat st;
+  return lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode);
+}
+
+static void Exchange(http::LocalClient& client, const std::string& what) {
+  std::string expected =
+      std::to_string(getpid()) + " " + std::to_string(getuid());
+  boost::beast::http::request<boost::beast::http::empty_body> req(
+      boost::beast::http::verb::get, "/whoami", 11);
+  boost::beast::http::response<boost::beast::http::string_body> resp;
+  client.SendRequest(req, resp);
+  Expect(resp.body() == expected, what + ": peer credentials");
+  // Kept alive, the next request goes over the same connection
+  Expect(client.connected(), what + ": kept alive");
+  auto sent = client.AsyncSendRequest(req, resp, boost::asio::use_future);
+  sent.get();
+  Expect(resp.body() == expected, what + ": asynchronous request");
+}
+
+void TestLocalSocket() {
+  IoContextPool pool(1);
+  std::thread thread([&pool]() { pool.Run(); });
+  auto server = std::make_shared<http::PlainServer>(pool);
+  server->HandleFunc("/whoami", &OnWhoAmI, {"GET"});
+
+  // Files other than sockets are never removed to bind
+  std::string path = "/tmp/netkit-test-local.sock";
+  unlink(path.c_str());
+  std::ofstream(path) << "data";
+  bool bound = true;
+  try {
+    server->ListenAndServeLocal(path);
+  } catch (const std::exception&) {
+    bound = false;
+  }
+  Expect(!bound && !IsSocketFile(path), "local: regular file replaced");
+  unlink(path.c_str());
+
+  // A stale socket file is replaced
+  {
+    boost::asio::io_context ioc;
+    boost::asio::local::stream_protocol::acceptor stale(
+        ioc, local::MakeEndpoint(path));
+  }
+  Expect(IsSocketFile(path), "local: stale socket file");
+  server->ListenAndServeLocal(path);
+  http::LocalClient client(pool.At(0), local::MakeEndpoint(path));
+  Exchange(client, "local");
+
+  auto second = std::make_shared<http::PlainServer>(pool);
+  second->HandleFunc("/whoami", &OnWhoAmI, {"GET"});
+  second->ListenAndServeLocal("@netkit-test-local");
+  http::LocalClient abstract_client(pool.At(0),
+                                    local::MakeEndpoint("@netkit-test-local"));
+  Exchange(abstract_client, "local abstract");
+
+  // The listeners close on their thread
+  server->Close();
+  second->Close();
+  for (int i = 0; i < 100 && IsSocketFile(path); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  Expect(!IsSocketFile(path), "local: socket file left");
+  pool.Stop();
+  thread.join();
+  std::cout << "local: ok" << std::endl;
+}
+#else
+// Unix domain sockets only
+void TestLocalSocket() {}
+#endif
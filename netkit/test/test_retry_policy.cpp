@@ -0,0 +1,151 @@
+#include <netkit/http/client_pool.h>
+#include <netkit/http/server.h>
+
+#include <boost/asio/use_future.hpp>
+#include <iostream>
+
+#include "test.h"
+
+using namespace netkit;
+
+static constexpr std::uint16_t kPort = 18087;
+
+// Answers after delay, on the thread of the connection
+static void OkAfter(const http::Context::Ptr& ctx,
+                    std::chrono::milliseconds delay) {
+  auto timer = std::make_shared<boost::asio::steady_timer>(ctx->executor());
+  timer->expires_after(delay);
+  timer->async_wait([ctx, timer](const boost::system::error_code&) {
+    ctx->Ok("ok", "text/plain");
+  });
+}
+
+// Routes of a failing and slow upstream
+static void AddRoutes(http::PlainServer& server) {
+  static std::atomic<int> flaky = 0;
+  static std::atomic<int> hedged = 0;
+  server.HandleFunc(
+      "/fast", [](const http::Context::Ptr& ctx) { ctx->Ok("ok"); }, {"GET"});
+  // 503 twice, then 200
+  server.HandleFunc(
+      "/flaky",
+      [](const http::Context::Ptr& ctx) {
+        if (flaky++ < 2) {
+          return ctx->Response(boost::beast::http::status::service_unavailable);
+        }
+        ctx->Ok("ok");
+      },
+      {"GET"});
+  server.HandleFunc(
+      "/fail",
+      [](const http::Context::Ptr& ctx) {
+        ctx->Response(boost::beast::http::status::service_unavailable);
+      },
+      {"GET"});
+  server.HandleFunc(
+      "/slow",
+      [](const http::Context::Ptr& ctx) {
+        OkAfter(ctx, std::chrono::milliseconds(1000));
+      },
+      {"GET"});
+  // The first attempt stalls, the hedge is answered right away
+  server.HandleFunc(
+      "/hedged",
+      [](const http::Context::Ptr& ctx) {
+        OkAfter(ctx, std::chrono::milliseconds(hedged++ == 0 ? 1000 : 0));
+      },
+      {"GET"});
+}
+
+// Sends GET path, returns the error and the status
+static std::pair<boost::system::error_code, unsigned> Send(
+    http::ClientPool& clients, const std::string& path,
+    const http::RetryPolicy& policy) {
+  boost::beast::http::request<boost::beast::http::empty_body> req(
+      boost::beast::http::verb::get, path, 11);
+  boost::beast::http::response<boost::beast::http::string_body> resp;
+  std::promise<boost::system::error_code> promise;
+  clients.AsyncSendRequest(
+      "http", "127.0.0.1", kPort, req, resp, policy,
+      [&promise](boost::system::error_code ec) { promise.set_value(ec); });
+  auto ec = promise.get_future().get();
+  return {ec, resp.result_int()};
+}
+
+static http::HostStats StatsOf(const http::ClientPool& clients) {
+  auto stats = clients.stats();
+  Expect(stats.size() == 1, "retry: hosts");
+  return stats[0];
+}
+
+static void TestRetries(IoContextPool& pool) {
+  using namespace std::chrono_literals;
+  http::ClientPool clients(pool);
+  auto policy = http::RetryPolicy().set_max_attempts(3).set_backoff(1ms, 5ms);
+  auto [ec, status] = Send(clients, "/flaky", policy);
+  Expect(!ec && status == 200, "retry: not retried up to the success");
+  Expect(StatsOf(clients).retries == 2, "retry: retries counted");
+
+  // The request deadline and the client timeouts fail with the same error
+  policy.set_deadline(100ms);
+  Expect(Send(clients, "/slow", policy).first == boost::beast::error::timeout,
+         "retry: deadline");
+  http::ClientPool timed(pool);
+  timed.set_timeouts(http::ClientTimeouts().set_read_timeout(100ms));
+  Expect(Send(timed, "/slow", http::RetryPolicy()).first ==
+             boost::beast::error::timeout,
+         "retry: read timeout");
+}
+
+// Half the tokens of the host are left after two failures, the next
+// requests are sent once
+static void TestBudget(IoContextPool& pool) {
+  using namespace std::chrono_literals;
+  http::ClientPool clients(pool);
+  auto policy = http::RetryPolicy()
+                    .set_max_attempts(3)
+                    .set_backoff(1ms, 5ms)
+                    .set_budget(4, 0.1);
+  clients.set_retry_policy(policy);
+  for (int i = 0; i < 4; ++i) {
+    auto [ec, status] = Send(clients, "/fail", policy);
+    Expect(!ec && status == 503, "retry budget: last response not returned");
+  }
+  auto stats = StatsOf(clients);
+  Expect(stats.retries == 1 && stats.throttled == 4,
+         "retry budget: retries not throttled");
+}
+
+// Once the latencies of the host are known, a stalled attempt is hedged
+static void TestHedging(IoContextPool& pool) {
+  using namespace std::chrono_literals;
+  http::ClientPool clients(pool);
+  auto policy = http::RetryPolicy().set_max_attempts(2).set_hedging(0.9, 10ms);
+  for (std::size_t i = 0; i < http::LatencyTracker::kMinSamples; ++i) {
+    Send(clients, "/fast", policy);
+  }
+  Expect(StatsOf(clients).hedges == 0, "hedging: hedged fast requests");
+  auto start = std::chrono::steady_clock::now();
+  auto [ec, status] = Send(clients, "/hedged", policy);
+  Expect(!ec && status == 200, "hedging: response");
+  Expect(std::chrono::steady_clock::now() - start < 500ms,
+         "hedging: waited for the stalled attempt");
+  Expect(StatsOf(clients).hedges == 1, "hedging: hedges counted");
+}
+
+void TestRetryPolicy() {
+  IoContextPool pool(2);
+  std::thread thread([&pool]() { pool.Run(); });
+  auto server = std::make_shared<http::PlainServer>(pool);
+  AddRoutes(*server);
+  server->ListenAndServe("127.0.0.1", kPort);
+
+  TestRetries(pool);
+  TestBudget(pool);
+  TestHedging(pool);
+
+  server->Close();
+  pool.Stop();
+  thread.join();
+  std::cout << "retry: ok" << std::endl;
+}
@@ -0,0 +1,225 @@
+#include <netkit/http/client.h>
+#include <netkit/http/server.h>
+
+#include <boost/asio/use_future.hpp>
+#include <iostream>
+#include <vector>
+#include <openssl/x509.h>
+
+#include "test.h"
+
+using namespace netkit;
+
+void MakeSelfSignedCertificate(boost::asio::ssl::context& ssl_ctx,
+                               const std::string& common_name) {
+  EVP_PKEY* pkey = nullptr;
+  auto pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+  EVP_PKEY_keygen_init(pctx);
+  EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1);
+  EVP_PKEY_keygen(pctx, &pkey);
+  EVP_PKEY_CTX_free(pctx);
+
+  auto x509 = X509_new();
+  ASN1_INTEGER_set(X509_get_serialNumber(x509), std::rand());
+  X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+  X509_gmtime_adj(X509_getm_notAfter(x509), 3600L * 24 * 365);
+  X509_set_pubkey(x509, pkey);
+  auto name = X509_get_subject_name(x509);
+  X509_NAME_add_entry_by_txt(
+      name, "CN", MBSTRING_ASC,
+      reinterpret_cast<const unsigned char*>(common_name.c_str()), -1, -1, 0);
+  X509_set_issuer_name(x509, name);
+  X509_sign(x509, pkey, EVP_sha256());
+
+  SSL_CTX_use_certificate(ssl_ctx.native_handle(), x509);
+  SSL_CTX_use_PrivateKey(ssl_ctx.native_handle(), pkey);
+  X509_free(x509);
+  EVP_PKEY_free(pkey);
+}
+
+static void OnHello(const http::Context::Ptr& ctx) {
+  ctx->Ok("Hello", "text/plain");
+}
+
+void TestHandshakeQueue() {
+  ssl::HandshakeStats stats;
+  std::vector<ssl::HandshakeStats::Slot> slots;
+  slots.reserve(4);  // no reallocation while a slot is handed over
+  auto start = [&slots](ssl::HandshakeStats::Slot&& slot) {
+    slots.emplace_back(std::move(slot));
+  };
+  Expect(stats.Begin(2, 1, start) && stats.Begin(2, 1, start),
+         "handshake queue: under the limit");
+  Expect(slots.size() == 2 && stats.pending() == 2, "handshake queue: started");
+  Expect(stats.Begin(2, 1, start), "handshake queue: queued");
+  Expect(!stats.Begin(2, 1, start), "handshake queue: over the queue limit");
+  Expect(slots.size() == 2 && stats.queued() == 1 && stats.rejected() == 1,
+         "handshake queue: waiting");
+  // The slot of a connection torn down mid handshake starts the next one
+  slots.front() = {};
+  Expect(slots.size() == 3 && stats.queued() == 0 && stats.pending() == 2,
+         "handshake queue: handed over");
+  slots.clear();
+  Expect(stats.pending() == 0, "handshake queue: released");
+}
+
+// Sends requests closing the connection, the client connects again for each
+// one and returns the session cache hits
+static std::uint64_t Reconnect(IoContextPool& pool,
+                               boost::asio::ssl::context& client_ctx,
+                               std::uint64_t requests) {
+  ssl::ClientSessionCache sessions;
+  sessions.Attach(client_ctx);
+  http::SslClient client(pool, client_ctx, "127.0.0.1", 18444);
+  for (std::uint64_t i = 0; i < requests; ++i) {
+    boost::beast::http::request<boost::beast::http::empty_body> req(
+        boost::beast::http::verb::get, "/hello", 11);
+    req.keep_alive(false);
+    boost::beast::http::response<boost::beast::http::string_body> resp;
+    client.AsyncSendRequest(req, resp, boost::asio::use_future).get();
+    Expect(resp.body() == "Hello" && !client.connected(),
+           "client sessions: response");
+  }
+  Expect(sessions.hits() + sessions.misses() == requests,
+         "client sessions: handshakes");
+  return sessions.hits();
+}
+
+// The connections are dropped without a close_notify, their sessions are
+// resumed all the same
+void TestClientSessions() {
+  IoContextPool pool(1);
+  std::thread thread([&pool]() { pool.Run(); });
+  boost::asio::ssl::context ssl_ctx(boost::asio::ssl::context::tls_server);
+  MakeSelfSignedCertificate(ssl_ctx, "localhost");
+  auto server = std::make_shared<http::SslServer>(pool, ssl_ctx);
+  server->EnableSessionResumption();
+  server->HandleFunc("/hello", &OnHello, {"GET"});
+  server->ListenAndServe("127.0.0.1", 18444);
+
+  // A TLS 1.2 session is resumed again and again
+  boost::asio::ssl::context tls12_ctx(boost::asio::ssl::context::tls_client);
+  tls12_ctx.set_verify_mode(boost::asio::ssl::verify_none);
+  SSL_CTX_set_max_proto_version(tls12_ctx.native_handle(), TLS1_2_VERSION);
+  Expect(Reconnect(pool, tls12_ctx, 3) == 2, "client sessions: TLS 1.2");
+  // A TLS 1.3 ticket is used once, the resumed connection gets no new one
+  boost::asio::ssl::context tls13_ctx(boost::asio::ssl::context::tls_client);
+  tls13_ctx.set_verify_mode(boost::asio::ssl::verify_none);
+  Expect(Reconnect(pool, tls13_ctx, 2) == 1, "client sessions: TLS 1.3");
+
+  server->Close();
+  pool.Stop();
+  thread.join();
+  std::cout << "client sessions: ok" << std::endl;
+}
+
+void TestSslServer(std::stop_token st, IoContextPool& pool,
+                   const std::string& address, std::uint16_t port) {
+  boost::asio::ssl::context ssl_ctx(boost::asio::ssl::context::tls_server);
+  MakeSelfSignedCertificate(ssl_ctx, "localhost");
+
+  ssl::CertificateStore store(ssl_ctx);
+  {
+    auto ctx = std::make_shared<boost::asio::ssl::context>(
+        boost::asio::ssl::context::tls_server);
+    MakeSelfSignedCertificate(*ctx, "*.example.com");
+    store.Add("*.example.com", ctx);
+  }
+
+  IoContextPool handshake_pool(1);
+  std::thread handshake_thread([&handshake_pool]() { handshake_pool.Run(); });
+
+  auto server = std::make_shared<http::SslServer>(pool, store);
+  server->settings().set_handshake_pool(&handshake_pool).set_handshake_limit(
+      64);
+  server->EnableSessionResumption(
+      ssl::SessionOptions().set_ticket_key_lifetime(std::chrono::seconds(5)));
+  server->EnableKtls();
+  server->EnableHttp2();
+  server->HandleFunc("/hello", &OnHello, {"GET"});
+  server->ListenAndServe(address, port, true);
+
+  boost::asio::ssl::context client_ctx(boost::asio::ssl::context::tls_client);
+  client_ctx.set_verify_mode(boost::asio::ssl::verify_none);
+  const char* server_names[] = {"localhost", "api.example.com"};
+  SSL_SESSION* sessions[] = {nullptr, nullptr};
+  std::size_t index = 0;
+
+  // Reconnects every time, resuming the session of the previous connection
+  boost::asio::ssl::context cached_ctx(boost::asio::ssl::context::tls_client);
+  cached_ctx.set_verify_mode(boost::asio::ssl::verify_none);
+  ssl::ClientSessionCache client_sessions;
+  client_sessions.Attach(cached_ctx);
+  http::SslClient client(pool, cached_ctx, "127.0.0.1", port);
+
+  while (!st.stop_requested()) {
+    index = (index + 1) % 2;
+    auto& session = sessions[index];
+    try {
+      boost::asio::io_context ioc;
+      boost::beast::ssl_stream<boost::beast::tcp_stream> stream(ioc,
+                                                                client_ctx);
+      stream.next_layer().connect(boost::asio::ip::tcp::endpoint(
+          boost::asio::ip::make_address("127.0.0.1"), port));
+      SSL_set_tlsext_host_name(stream.native_handle(), server_names[index]);
+      if (session) {
+        SSL_set_session(stream.native_handle(), session);
+      }
+      stream.handshake(boost::asio::ssl::stream_base::client);
+      auto cert = SSL_get_peer_certificate(stream.native_handle());
+      char common_name[256] = {0};
+      X509_NAME_get_text_by_NID(X509_get_subject_name(cert), NID_commonName,
+                                common_name, sizeof(common_name));
+      X509_free(cert);
+      std::cout << server_names[index] << " -> " << common_name << std::endl;
+      boost::beast::http::request<boost::beast::http::empty_body> req(
+          boost::beast::http::verb::get, "/hello", 11);
+      boost::beast::http::write(stream, req);
+      boost::beast::flat_buffer buffer;
+      boost::beast::http::response<boost::beast::http::string_body> resp;
+      boost::beast::http::read(stream, buffer, resp);
+      if (session) {
+        SSL_SESSION_free(session);
+      }
+      session = SSL_get1_session(stream.native_handle());
+      boost::beast::error_code ec;
+      stream.shutdown(ec);
+    } catch (const std::exception& e) {
+      std::cout << e.what() << std::endl;
+    }
+    try {
+      boost::beast::http::request<boost::beast::http::empty_body> req(
+          boost::beast::http::verb::get, "/hello", 11);
+      req.keep_alive(false);
+      boost::beast::http::response<boost::beast::http::string_body> resp;
+      client.SendRequest(req, resp);
+      std::cout << "client sessions hits=" << client_sessions.hits()
+                << " misses=" << client_sessions.misses() << std::endl;
+    } catch (const std::exception& e) {
+      std::cout << e.what() << std::endl;
+    }
+    auto& stats = server->settings().handshake_stats();
+    std::cout << "full=" << stats.full() << " resumed=" << stats.resumed()
+              << " failed=" << stats.failed()
+              << " offloaded=" << stats.offloaded() << std::endl;
+    for (std::size_t i = 0; i < ssl::LatencyHistogram::kBuckets; ++i) {
+      auto full = stats.full_latency().count(i);
+      auto resumed = stats.resumed_latency().count(i);
+      if (full > 0 || resumed > 0) {
+        std::cout << "  <" << ssl::LatencyHistogram::upper_bound(i).count()
+                  << "us full=" << full << " resumed=" << resumed << std::endl;
+      }
+    }
+    using namespace std::chrono_literals;
+    std::this_thread::sleep_for(1s);
+  }
+
+  for (auto session : sessions) {
+    if (session) {
+      SSL_SESSION_free(session);
+    }
+  }
+  server->Close();
+  handshake_pool.Stop();
+  handshake_thread.join();
+}
@@ -0,0 +1,137 @@
+#include <netkit/http/server.h>
+#include <netkit/supervisor.h>
+#include <netkit/tcp/listener.h>
+
+#include <iostream>
+#include <set>
+#include <thread>
+
+#include "test.h"
+
+#if !defined(_WIN32)
+#include <unistd.h>
+
+using namespace netkit;
+
+static tcp::Listener::NativeHandle Bind(boost::asio::io_context& ioc,
+                                        std::uint16_t port) {
+  boost::asio::ip::tcp::acceptor acceptor(ioc);
+  acceptor.open(boost::asio::ip::tcp::v4());
+  acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+  acceptor.set_option(
+      boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(
+          true));
+  acceptor.bind({boost::asio::ip::make_address("127.0.0.1"), port});
+  acceptor.listen();
+  return acceptor.release();
+}
+
+// Only the sockets sharing an address form a group spread over the pool,
+// a lone socket on another port doesn't
+static void TestAdopt() {
+  IoContextPool pool(2);
+  boost::asio::io_context ioc;
+  std::vector<tcp::Listener::NativeHandle> fds = {
+      Bind(ioc, 18084), Bind(ioc, 18083), Bind(ioc, 18083)};
+  tcp::Listener listener(pool);
+  listener.Adopt(fds, [](boost::asio::ip::tcp::socket&& socket) {});
+  auto context_of = [&listener](std::size_t index) {
+    return &boost::asio::query(listener.executor(index),
+                               boost::asio::execution::context);
+  };
+  Expect(listener.size() == 3, "adopt: acceptors");
+  Expect(context_of(1) == &pool.At(0) && context_of(2) == &pool.At(1),
+         "adopt: reuse-port group not spread");
+  listener.Close();
+}
+
+// GET /path on a new connection, returns the body
+static std::string Get(std::uint16_t port, const std::string& path) {
+  boost::asio::io_context ioc;
+  boost::beast::tcp_stream stream(ioc);
+  stream.connect({boost::asio::ip::make_address("127.0.0.1"), port});
+  boost::beast::http::request<boost::beast::http::empty_body> req(
+      boost::beast::http::verb::get, path, 11);
+  req.keep_alive(false);
+  boost::beast::http::write(stream, req);
+  boost::beast::flat_buffer buffer;
+  boost::beast::http::response<boost::beast::http::string_body> resp;
+  boost::beast::http::read(stream, buffer, resp);
+  return resp.body();
+}
+
+// Two workers on two ports, each one with its own SO_REUSEPORT socket per
+// port. A worker exiting on /crash is forked again.
+static void TestWorkers() {
+  Supervisor supervisor(2);
+  supervisor.set_reuse_port(true);
+  supervisor.Listen("127.0.0.1", 18081);
+  supervisor.Listen("127.0.0.1", 18082);
+  std::thread thread([&supervisor]() {
+    supervisor.Run([&supervisor](std::size_t index,
+                                 const std::vector<Supervisor::NativeHandle>&
+                                     fds) {
+      IoContextPool pool(2);
+      auto server = std::make_shared<http::PlainServer>(pool);
+      server->HandleFunc(
+          "/pid",
+          [](const http::Context::Ptr& ctx) {
+            ctx->Ok(std::to_string(getpid()), "text/plain");
+          },
+          {"GET"});
+      server->HandleFunc(
+          "/crash", [](const http::Context::Ptr& ctx) { _exit(3); }, {"GET"});
+      server->ServeListeners(fds);
+      supervisor.load(index).Track(pool);
+      pool.Run();
+    });
+  });
+
+  // Until both workers answered on both ports
+  std::set<std::string> pids[2];
+  for (int i = 0; i < 500 && (pids[0].size() < 2 || pids[1].size() < 2);
+       ++i) {
+    try {
+      pids[i % 2].insert(Get(18081 + i % 2, "/pid"));
+    } catch (const std::exception&) {
+      // Not listening yet
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  Expect(pids[0].size() == 2 && pids[1].size() == 2,
+         "supervisor: workers not reached on both ports");
+
+  try {
+    Get(18081, "/crash");
+  } catch (const std::exception&) {
+  }
+  std::size_t restarts = 0;
+  for (int i = 0; i < 500 && restarts == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    restarts = supervisor.load(0).restarts() + supervisor.load(1).restarts();
+  }
+  Expect(restarts == 1, "supervisor: crashed worker not restarted");
+  std::set<std::string> after;
+  for (int i = 0; i < 500 && after.size() < 2; ++i) {
+    try {
+      after.insert(Get(18082, "/pid"));
+    } catch (const std::exception&) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  Expect(after.size() == 2 && after != pids[1],
+         "supervisor: restarted worker not serving");
+
+  supervisor.Stop();
+  thread.join();
+}
+
+void TestSupervisor() {
+  TestAdopt();
+  TestWorkers();
+  std::cout << "supervisor: ok" << std::endl;
+}
+#else
+// No fork()
+void TestSupervisor() {}
+#endif
@@ -10,7 +10,7 @@ static void OnNewConnection(const std::shared_ptr<tcp::Listener>& listener,
 void TestTcpListener(std::stop_token st, IoContextPool& pool,
                      const std::string& address, std::uint16_t port) {
   auto listener = std::make_shared<tcp::Listener>(pool);
-  listener->ListenAndAccept(address, port, true,
+  listener->ListenAndAccept(address, port, true, false,
                             [listener](boost::asio::ip::tcp::socket&& socket) {
                               OnNewConnection(listener, std::move(socket));
                             });
@@ -0,0 +1,73 @@
+#include <netkit/http/server.h>
+#include <netkit/work_stealing.h>
+
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "test.h"
+
+using namespace netkit;
+
+// GET /path on a new connection, returns the body
+static std::string Get(std::uint16_t port, const std::string& path) {
+  boost::asio::io_context ioc;
+  boost::beast::tcp_stream stream(ioc);
+  stream.connect({boost::asio::ip::make_address("127.0.0.1"), port});
+  boost::beast::http::request<boost::beast::http::empty_body> req(
+      boost::beast::http::verb::get, path, 11);
+  req.keep_alive(false);
+  boost::beast::http::write(stream, req);
+  boost::beast::flat_buffer buffer;
+  boost::beast::http::response<boost::beast::http::string_body> resp;
+  boost::beast::http::read(stream, buffer, resp);
+  return resp.body();
+}
+
+// 16 tasks split from one request over 4 contexts. They are all pushed
+// onto the deque of the connection, the idle contexts have to steal them.
+void TestWorkStealing() {
+  IoContextPool pool(4);
+  std::thread thread([&pool]() { pool.Run(); });
+  WorkStealingExecutor stealing(pool);
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+
+  auto server = std::make_shared<http::PlainServer>(pool);
+  server->HandleFunc(
+      "/sum",
+      [&](const http::Context::Ptr& ctx) {
+        auto group = stealing.CreateGroup(ctx->executor());
+        auto sum = std::make_shared<std::atomic<int>>(0);
+        for (int i = 1; i <= 16; ++i) {
+          group->Spawn([&, sum, i]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            sum->fetch_add(i);
+            std::lock_guard lock(mutex);
+            threads.insert(std::this_thread::get_id());
+          });
+        }
+        // One thread per context, the handler runs on the connection's
+        group->Then([ctx, sum, id = std::this_thread::get_id()](
+                        std::exception_ptr error) {
+          bool on_connection = std::this_thread::get_id() == id;
+          ctx->Ok(std::to_string(*sum) + (on_connection ? " ok" : " moved"),
+                  "text/plain");
+        });
+      },
+      {"GET"});
+  server->ListenAndServe("127.0.0.1", 18085);
+
+  Expect(Get(18085, "/sum") == "136 ok",
+         "work stealing: continuation not on the connection");
+  Expect(stealing.steals() > 0, "work stealing: no task stolen");
+  Expect(threads.size() > 1, "work stealing: tasks on a single thread");
+  Expect(stealing.queued() == 0, "work stealing: tasks left");
+  std::cout << "work stealing: steals=" << stealing.steals()
+            << " threads=" << threads.size() << std::endl;
+
+  server->Close();
+  pool.Stop();
+  thread.join();
+}
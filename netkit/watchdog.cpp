@@ -0,0 +1,141 @@
+#include "watchdog.h"
+
+#include <algorithm>
+
+#if defined(__linux__) && defined(__GLIBC__)
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include <cstdlib>
+#define NETKIT_STACK_SAMPLES 1
+#endif
+
+namespace netkit {
+
+#if defined(NETKIT_STACK_SAMPLES)
+// One sample at a time across the watchdogs of the process
+static std::mutex sample_mutex;
+static void* sample_frames[64];
+static std::atomic<int> sample_size = -1;
+
+static int SampleSignal() noexcept { return SIGRTMIN + 1; }
+
+static void OnSampleSignal(int) {
+  sample_size.store(backtrace(sample_frames, 64), std::memory_order_release);
+}
+#endif
+
+void StreamSink::OnSlowHandler(const SlowHandler& report) {
+  os_ << "slow handler on context " << report.context << ": "
+      << report.method << " "
+      << (report.route.empty() ? "(unmatched)" : report.route) << " "
+      << report.elapsed.count() << "ms\n";
+  for (const auto& frame : report.stack) {
+    os_ << "  " << frame << "\n";
+  }
+  os_.flush();
+}
+
+void Watchdog::Start() {
+#if defined(NETKIT_STACK_SAMPLES)
+  if (stack_samples_) {
+    // Loads libgcc now, backtrace() would allocate in the signal handler
+    void* frame;
+    backtrace(&frame, 1);
+    struct sigaction action = {};
+    action.sa_handler = OnSampleSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SampleSignal(), &action, nullptr);
+  }
+#endif
+  stopped_ = false;
+  thread_ = std::thread([this]() {
+    std::vector<std::int64_t> reported(pool_.size(), 0);
+    auto interval = std::max(threshold_ / 4, std::chrono::milliseconds(1));
+    std::unique_lock lock(mutex_);
+    while (!cv_.wait_for(lock, interval, [this]() { return stopped_; })) {
+      lock.unlock();
+      Check(reported);
+      lock.lock();
+    }
+  });
+}
+
+void Watchdog::Stop() noexcept {
+  {
+    std::lock_guard lock(mutex_);
+    stopped_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void Watchdog::Check(std::vector<std::int64_t>& reported) {
+  auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+                 .count();
+  for (std::size_t i = 0; i < pool_.size(); ++i) {
+    const auto& load = pool_.load(i);
+    auto start = load.route_start_.load(std::memory_order_acquire);
+    if (start == 0 || start == reported[i] ||
+        std::chrono::nanoseconds(now - start) < threshold_) {
+      continue;
+    }
+    auto pattern = load.route_pattern_.load(std::memory_order_relaxed);
+    auto method = load.route_method_.load(std::memory_order_relaxed);
+    SlowHandler report;
+    report.context = i;
+    report.route = pattern ? *pattern : std::string();
+    report.method = method ? method : "";
+    report.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::nanoseconds(now - start));
+    if (stack_samples_) {
+      report.stack =
+          SampleStack(load.thread_.load(std::memory_order_acquire));
+    }
+    // The handler finished while reading, the fields may be of the next one
+    if (load.route_start_.load(std::memory_order_acquire) != start) {
+      continue;
+    }
+    reported[i] = start;
+    sink_->OnSlowHandler(report);
+  }
+}
+
+std::vector<std::string> Watchdog::SampleStack(
+    std::thread::native_handle_type thread) {
+  std::vector<std::string> stack;
+#if defined(NETKIT_STACK_SAMPLES)
+  if (thread == std::thread::native_handle_type{}) {
+    return stack;
+  }
+  std::lock_guard lock(sample_mutex);
+  sample_size.store(-1, std::memory_order_relaxed);
+  if (pthread_kill(thread, SampleSignal()) != 0) {
+    return stack;
+  }
+  int size = -1;
+  for (int i = 0; i < 100 && size < 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+    size = sample_size.load(std::memory_order_acquire);
+  }
+  if (size <= 0) {
+    return stack;
+  }
+  auto symbols = backtrace_symbols(sample_frames, size);
+  if (symbols) {
+    // Skips the signal handler and the signal trampoline
+    for (int i = 2; i < size; ++i) {
+      stack.emplace_back(symbols[i]);
+    }
+    std::free(symbols);
+  }
+#endif
+  return stack;
+}
+
+}  // namespace netkit
@@ -0,0 +1,98 @@
+#pragma once
+#include <netkit/io_context_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace netkit {
+
+// A route handler holding its io_context longer than the threshold
+struct SlowHandler {
+  // Index of the context in the pool
+  std::size_t context = 0;
+  // Route pattern, empty when the route wasn't matched yet
+  std::string route;
+  std::string method;
+  // Time in the handler when it was noticed
+  std::chrono::milliseconds elapsed{0};
+  // Frames of the io thread, see Watchdog::set_stack_samples()
+  std::vector<std::string> stack;
+};
+
+// Receives the reports of a Watchdog, on its thread
+class WatchdogSink {
+ public:
+  virtual ~WatchdogSink() noexcept {}
+
+  virtual void OnSlowHandler(const SlowHandler& report) = 0;
+};
+
+// One line per report, and one per frame
+class StreamSink : public WatchdogSink {
+ public:
+  explicit StreamSink(std::ostream& os) noexcept : os_(os) {}
+
+  void OnSlowHandler(const SlowHandler& report) override;
+
+ private:
+  std::ostream& os_;
+};
+
+// Thread checking the route handlers of the pool (see
+// IoContextPool::RouteScope), each handler above the threshold is reported
+// once. The io threads only write a few relaxed atomics per request.
+class Watchdog {
+  using Self = Watchdog;
+
+ public:
+  Watchdog(IoContextPool& pool, std::shared_ptr<WatchdogSink> sink) noexcept
+      : pool_(pool), sink_(std::move(sink)) {}
+
+  ~Watchdog() noexcept { Stop(); }
+
+  Watchdog(const Watchdog&) = delete;
+  Watchdog& operator=(const Watchdog&) = delete;
+
+  std::chrono::milliseconds threshold() const noexcept { return threshold_; }
+
+  // Before Start(), the handlers are checked every quarter of it
+  Self& set_threshold(const std::chrono::milliseconds& val) noexcept {
+    threshold_ = val;
+    return *this;
+  }
+
+  // Interrupts the io thread with a signal to take its stack (Linux with
+  // glibc). The frames are those of the handler at the time, not a profile.
+  Self& set_stack_samples(bool val) noexcept {
+    stack_samples_ = val;
+    return *this;
+  }
+
+  void Start();
+
+  void Stop() noexcept;
+
+ private:
+  void Check(std::vector<std::int64_t>& reported);
+
+  std::vector<std::string> SampleStack(std::thread::native_handle_type thread);
+
+ private:
+  IoContextPool& pool_;
+  std::shared_ptr<WatchdogSink> sink_;
+  std::chrono::milliseconds threshold_ = std::chrono::milliseconds(200);
+  bool stack_samples_ = false;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopped_ = false;
+};
+
+}  // namespace netkit
@@ -0,0 +1,125 @@
+#include "work_stealing.h"
+
+#include <algorithm>
+
+namespace netkit {
+
+void TaskGroup::Spawn(std::function<void()>&& task) {
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  executor_.Push({std::move(task), shared_from_this()}, ex_);
+}
+
+void TaskGroup::Then(Continuation&& continuation) {
+  continuation_ = std::move(continuation);
+  Done(nullptr);
+}
+
+void TaskGroup::Done(std::exception_ptr error) noexcept {
+  if (error) {
+    std::lock_guard lock(error_mutex_);
+    if (!error_) {
+      error_ = error;
+    }
+  }
+  if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    boost::asio::post(ex_, [self = shared_from_this()]() {
+      if (self->continuation_) {
+        self->continuation_(self->error_);
+      }
+    });
+  }
+}
+
+WorkStealingExecutor::WorkStealingExecutor(IoContextPool& pool)
+    : pool_(pool) {
+  for (std::size_t i = 0; i < pool_.size(); ++i) {
+    queues_.emplace_back(std::make_unique<Queue>());
+  }
+}
+
+void WorkStealingExecutor::Push(Task&& task,
+                                const boost::asio::any_io_executor& hint) {
+  std::size_t index;
+  if (current_ == this) {
+    index = current_index_;
+  } else {
+    index = pool_.IndexOf(hint);
+    if (index >= queues_.size()) {
+      index = next_index_.fetch_add(1, std::memory_order_relaxed) %
+              queues_.size();
+    }
+  }
+  {
+    std::lock_guard lock(queues_[index]->mutex);
+    queues_[index]->tasks.emplace_back(std::move(task));
+  }
+  auto queued = queued_.fetch_add(1, std::memory_order_release) + 1;
+  // The owner first, then as many contexts as there are tasks to steal
+  auto wake = std::min(queued, queues_.size());
+  for (std::size_t i = 0; i < wake; ++i) {
+    Schedule((index + i) % queues_.size());
+  }
+}
+
+void WorkStealingExecutor::Schedule(std::size_t index) {
+  auto& queue = *queues_[index];
+  if (queue.scheduled.exchange(true, std::memory_order_acq_rel)) {
+    return;
+  }
+  boost::asio::post(pool_.At(index), [this, index]() { RunOne(index); });
+}
+
+void WorkStealingExecutor::RunOne(std::size_t index) {
+  queues_[index]->scheduled.store(false, std::memory_order_release);
+  Task task;
+  if (!Take(index, task)) {
+    return;
+  }
+  auto previous = current_;
+  auto previous_index = current_index_;
+  current_ = this;
+  current_index_ = index;
+  std::exception_ptr error;
+  try {
+    task.func();
+  } catch (...) {
+    error = std::current_exception();
+  }
+  current_ = previous;
+  current_index_ = previous_index;
+  task.group->Done(error);
+  // Back after the io handlers queued meanwhile
+  if (queued_.load(std::memory_order_acquire) > 0) {
+    Schedule(index);
+  }
+}
+
+bool WorkStealingExecutor::Take(std::size_t index, Task& task) {
+  if (queued_.load(std::memory_order_acquire) == 0) {
+    return false;
+  }
+  {
+    auto& own = *queues_[index];
+    std::lock_guard lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  for (std::size_t i = 1; i < queues_.size(); ++i) {
+    auto& victim = *queues_[(index + i) % queues_.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      steals_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace netkit
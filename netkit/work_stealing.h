@@ -0,0 +1,114 @@
+#pragma once
+#include <netkit/io_context_pool.h>
+
+#include <atomic>
+#include <boost/asio/any_io_executor.hpp>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace netkit {
+
+class WorkStealingExecutor;
+
+// Tasks split from one request. The continuation runs on the executor of
+// the group, typically the one of the connection (see Context::executor()),
+// once every task finished. Tasks may spawn more tasks into the group.
+class TaskGroup : public std::enable_shared_from_this<TaskGroup> {
+ public:
+  using Ptr = std::shared_ptr<TaskGroup>;
+
+  // Gets the first exception thrown by a task, nullptr when none did
+  using Continuation = std::function<void(std::exception_ptr)>;
+
+  TaskGroup(WorkStealingExecutor& executor,
+            const boost::asio::any_io_executor& ex) noexcept
+      : executor_(executor), ex_(ex) {}
+
+  void Spawn(std::function<void()>&& task);
+
+  // Once per group, after the first tasks are spawned
+  void Then(Continuation&& continuation);
+
+ private:
+  friend class WorkStealingExecutor;
+
+  void Done(std::exception_ptr error) noexcept;
+
+ private:
+  WorkStealingExecutor& executor_;
+  boost::asio::any_io_executor ex_;
+  // One for Then() besides the tasks
+  std::atomic<std::size_t> pending_ = 1;
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+  Continuation continuation_;
+};
+
+// CPU-bound tasks run by the io threads of a pool in between their
+// handlers. Every context owns a deque: a task spawned from a pool thread
+// is pushed onto its own deque and taken back LIFO, other threads steal
+// FIFO from the front. Each task runs as a handler of its own so the io
+// work of a context is never held for more than one task.
+class WorkStealingExecutor {
+ public:
+  explicit WorkStealingExecutor(IoContextPool& pool);
+
+  WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+  WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+  // Group resuming on ex
+  TaskGroup::Ptr CreateGroup(const boost::asio::any_io_executor& ex) {
+    return std::make_shared<TaskGroup>(*this, ex);
+  }
+
+  // Tasks waiting in the deques
+  std::size_t queued() const noexcept {
+    return queued_.load(std::memory_order_relaxed);
+  }
+
+  // Tasks taken from the deque of another context
+  std::uint64_t steals() const noexcept {
+    return steals_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  friend class TaskGroup;
+
+  struct Task {
+    std::function<void()> func;
+    TaskGroup::Ptr group;
+  };
+
+  struct alignas(64) Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    // A runner is posted to the context and didn't start yet
+    std::atomic<bool> scheduled = false;
+  };
+
+  // Onto the deque of the calling pool thread, of the context of hint
+  // otherwise
+  void Push(Task&& task, const boost::asio::any_io_executor& hint);
+
+  void Schedule(std::size_t index);
+
+  void RunOne(std::size_t index);
+
+  bool Take(std::size_t index, Task& task);
+
+ private:
+  IoContextPool& pool_;
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::atomic<std::size_t> queued_ = 0;
+  std::atomic<std::uint64_t> steals_ = 0;
+  std::atomic<std::size_t> next_index_ = 0;
+  // Executor and context of the task running on this thread
+  static inline thread_local WorkStealingExecutor* current_ = nullptr;
+  static inline thread_local std::size_t current_index_ = 0;
+};
+
+}  // namespace netkit